@@ -12,15 +12,33 @@
 #include <time.h>
 
 ActivityError display_activity(Activity activity) {
-  // Load activity project.
-  Project *project;
-  FileError error = fs_load_project(activity.project_id, &project);
+  // Look up activity project (cached, read-only)
+  const Project *project;
+  FileError error = fs_acquire_project(activity.project_id, &project);
   if (error) {
     printf("Failed to load project with ID %zu (error %d)\n",
            activity.project_id, error);
     return ACTIVITY_DISPLAY_ERROR;
   }
 
+  ActivityError display_error = display_project_activity(activity, project);
+
+  // Hand back project view
+  fs_release_project(project);
+
+  return display_error;
+}
+
+double activity_rate(const Activity *activity, const Project *project) {
+  if (activity->rate.present) { // use custom rate if applicable
+    return activity->rate.value;
+  }
+
+  return project->default_rate;
+}
+
+ActivityError display_project_activity(Activity activity,
+                                       const Project *project) {
   // Retrieve activity time information
   time_t log_time = (time_t)activity.time;
   struct tm activity_time;
@@ -30,12 +48,7 @@ ActivityError display_activity(Activity activity) {
   double duration = ((double)activity.minutes / 60.0) + activity.hours;
 
   // Calculate activity rate
-  double rate;
-  if (activity.rate.present) { // use custom rate if applicable
-    rate = activity.rate.value;
-  } else {
-    rate = project->default_rate;
-  }
+  double rate = activity_rate(&activity, project);
 
   // Calculate earnings
   double earnings = rate * duration;
@@ -49,11 +62,22 @@ ActivityError display_activity(Activity activity) {
       activity.hours, activity.minutes, rate, earnings, project->name,
       activity.description);
 
-  // Free loaded project
-  error = fs_free_project(project);
-  if (error) {
-    printf("Failed to free project (error %d)\n", error);
-    return ACTIVITY_DISPLAY_ERROR;
+  return ACTIVITY_OK;
+}
+
+ActivityError display_activities(Activity **activities, size_t activity_c,
+                                 const ProjectLookup *lookup) {
+  for (size_t i = 0; i < activity_c; i++) {
+    Activity *activity = activities[i];
+
+    // Resolve project from the table, no loading per activity
+    const Project *project = project_lookup_find(lookup, activity->project_id);
+    if (!project) {
+      printf("Failed to find project with ID %zu\n", activity->project_id);
+      return ACTIVITY_DISPLAY_ERROR;
+    }
+
+    PROPAGATE(ActivityError, display_project_activity, (*activity, project));
   }
 
   return ACTIVITY_OK;
@@ -65,30 +89,35 @@ MenuError new_activity_menu(void *_menu_data, void *_item_data) {
   MenuItem set_project_item = {
       .function = (MenuItemFn)set_activity_project,
       .status_check = (StatusCheckFn)set_activity_project_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA | MENU_DEPENDS_PROJECTS,
       .default_prompt = "Select Project",
       .item_data = NULL,
   };
   MenuItem set_description_item = {
       .function = (MenuItemFn)set_activity_description,
       .status_check = (StatusCheckFn)set_activity_description_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
       .default_prompt = "Set Description",
       .item_data = NULL,
   };
   MenuItem set_duration_item = {
       .function = (MenuItemFn)set_activity_duration,
       .status_check = (StatusCheckFn)set_activity_duration_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
       .default_prompt = "Set Duration",
       .item_data = NULL,
   };
   MenuItem set_rate_item = {
       .function = (MenuItemFn)set_activity_custom_rate,
       .status_check = (StatusCheckFn)set_activity_custom_rate_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA | MENU_DEPENDS_PROJECTS,
       .default_prompt = "Set Custom Rate?",
       .item_data = NULL,
   };
   MenuItem save_activity_item = {
       .function = (MenuItemFn)save_activity,
       .status_check = (StatusCheckFn)save_activity_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA | MENU_DEPENDS_PROJECTS,
       .default_prompt = "Save Activity",
       .item_data = NULL,
   };
@@ -113,10 +142,9 @@ MenuError new_activity_menu(void *_menu_data, void *_item_data) {
 ItemStatus new_activity_menu_status(void *_menu_data, void *_item_data) {
   ItemStatus status = {0};
 
-  // Load project list
-  Project **projects;
-  size_t project_c;
-  FileError error = fs_get_project_list(&projects, &project_c);
+  // Load project index
+  ProjectIndex index;
+  FileError error = fs_get_project_index(&index);
   if (error) {
     sprintf(status.prompt, "Failed to load project list (error %d)", error);
     status.available = false;
@@ -124,68 +152,61 @@ ItemStatus new_activity_menu_status(void *_menu_data, void *_item_data) {
   }
 
   // Allow if project count > 0
-  status.available = project_c;
-  if (!project_c) {
+  status.available = index.entry_c;
+  if (!index.entry_c) {
     sprintf(status.prompt,
             "Must create a project before logging activities, see above!");
   }
 
-  // Free project list
-  error = fs_free_project_list(projects, project_c);
-  if (error) {
-    sprintf(status.prompt, "Failed to free project list (error %d)", error);
-    status.available = false;
-  }
+  // Free project index
+  project_index_free(&index);
 
   return status;
 }
 
 // Menu item function for [`set_activity_project`]
-MenuError assign_activity_project_id(Activity *activity, Project *project) {
-  activity->project_id = project->id;
+MenuError assign_activity_project_id(Activity *activity,
+                                     ProjectIndexEntry *entry) {
+  activity->project_id = entry->id;
   return MENU_EXIT;
 }
 
 MenuError set_activity_project(Activity *activity, void *_item_data) {
-  // Load project list
-  Project **projects;
-  size_t project_c;
-  FileError error = fs_get_project_list(&projects, &project_c);
+  // Load project index, names and IDs are all that's needed here
+  ProjectIndex index;
+  FileError error = fs_get_project_index(&index);
   if (error) {
     printf("Failed to get project list (error %d)\n", error);
     return MENU_ITEM_ERROR;
   }
 
   // Allocate dynamic array for menu items
-  MenuItem *items = calloc(project_c, sizeof(MenuItem));
+  MenuItem *items = calloc(index.entry_c, sizeof(MenuItem));
 
   // Construct menu item for each project
-  for (int i = 0; i < project_c; i++) {
+  for (size_t i = 0; i < index.entry_c; i++) {
     MenuItem *item = items + i;
-    Project *project = projects[i];
+    ProjectIndexEntry *entry = index.entries + i;
 
     item->function = (MenuItemFn)assign_activity_project_id;
-    item->item_data = project;
-    item->default_prompt = project->name;
+    item->item_data = entry;
+    item->default_prompt = entry->name;
   }
 
   // Open project ID menu
   Menu menu = {
       .title = "Select Project for Activity",
-      .item_c = &project_c,
+      .item_c = &index.entry_c,
       .items = &items,
       .menu_data = activity,
   };
-  PROPAGATE(MenuError, open_menu, (&menu));
+  MenuError menu_error = open_menu(&menu);
 
-  // Free project list
-  error = fs_free_project_list(projects, project_c);
-  if (error) {
-    printf("Failed to free project list (error %d)\n", error);
-    return MENU_ITEM_ERROR;
-  }
+  // Free menu items and project index
+  free(items);
+  project_index_free(&index);
 
-  return MENU_OK;
+  return menu_error;
 };
 
 ItemStatus set_activity_project_status(Activity *activity, void *_item_data) {
@@ -196,9 +217,9 @@ ItemStatus set_activity_project_status(Activity *activity, void *_item_data) {
 
   // Only update prompt if project ID is assigned
   if (activity->project_id) {
-    // Load project
-    Project *project;
-    FileError error = fs_load_project(activity->project_id, &project);
+    // Look up project, cached between redraws
+    const Project *project;
+    FileError error = fs_acquire_project(activity->project_id, &project);
     if (error) {
       sprintf(status.prompt, "Project ID invalid, please reassign!");
       return status;
@@ -207,13 +228,7 @@ ItemStatus set_activity_project_status(Activity *activity, void *_item_data) {
     // Use project name in prompt
     sprintf(status.prompt, "Update Project (%s)", project->name);
 
-    // Free project
-    error = fs_free_project(project);
-    if (error) {
-      sprintf(status.prompt, "Failed to free project\n");
-      status.available = false;
-      return status;
-    }
+    fs_release_project(project);
   }
 
   return status;
@@ -311,8 +326,8 @@ ItemStatus set_activity_custom_rate_status(Activity *activity,
   } else if (activity->project_id) {
     // If project ID is set and custom rate is not assigned (i.e.
     // `!rate.present`), load project and display default rate.
-    Project *project;
-    FileError error = fs_load_project(activity->project_id, &project);
+    const Project *project;
+    FileError error = fs_acquire_project(activity->project_id, &project);
     if (error) {
       sprintf(status.prompt, "Failed to load project with ID %zu (error %d)",
               activity->project_id, error);
@@ -322,58 +337,49 @@ ItemStatus set_activity_custom_rate_status(Activity *activity,
     sprintf(status.prompt, "Set custom rate? (Project default: £%.2f/hour)",
             project->default_rate);
 
-    error = fs_free_project(project);
-    if (error) {
-      sprintf(status.prompt, "Failed to free project (error %d)", error);
-      status.available = false;
-    }
+    fs_release_project(project);
   }
 
   return status;
 }
 
 MenuError save_activity(Activity *activity, void *_item_data) {
-  // Load activity project
-  Project *project;
-  FileError error = fs_load_project(activity->project_id, &project);
+  // Look up activity project in the index, rather than loading all of it
+  ProjectIndex index;
+  FileError error = fs_get_project_index(&index);
   if (error) {
-    printf("Failed to load project with ID %zu (error %d)\n",
-           activity->project_id, error);
+    printf("Failed to load project index (error %d)\n", error);
+    return MENU_ITEM_ERROR;
+  }
+
+  ProjectIndexEntry *entry = project_index_find(&index, activity->project_id);
+  if (!entry) {
+    printf("Failed to find project with ID %zu\n", activity->project_id);
+    project_index_free(&index);
     return MENU_ITEM_ERROR;
   }
 
   // Assign project's default rate to activity if not already set
   if (!activity->rate.present) {
-    activity->rate.value = project->default_rate;
+    activity->rate.value = entry->default_rate;
     activity->rate.present = true;
   }
   // Assign current timestamp
   activity->time = (unsigned long)time(NULL);
 
-  // Increase activities array size by 1
-  project->activity_c++;
-  project->activities =
-      realloc(project->activities, sizeof(Activity) * project->activity_c);
-  // Copy activity to project activities array
-  memcpy(project->activities + project->activity_c - 1, activity,
-         sizeof(Activity));
-
-  // Save project (and thus activity) to filesystem
-  error = fs_save_project(*project);
+  // Append activity to the project's journal, rather than rewriting the whole
+  // project file
+  error = fs_append_activity(activity);
   if (error) {
-    printf("Failed to save project %s, ID %zu (error %d)\n", project->name,
-           project->id, error);
+    printf("Failed to save activity to project %s, ID %zu (error %d)\n",
+           entry->name, activity->project_id, error);
 
-    fs_free_project(project);
+    project_index_free(&index);
     return MENU_ITEM_ERROR;
   }
 
-  // Free loaded project
-  error = fs_free_project(project);
-  if (error) {
-    printf("Failed to free project (error %d)\n", error);
-    return MENU_ITEM_ERROR;
-  }
+  // Free project index
+  project_index_free(&index);
 
   printf("Saved activity:\n");
   display_activity(*activity);
@@ -402,9 +408,9 @@ ItemStatus save_activity_status(Activity *activity, void *_item_data) {
     if (activity->rate.present) {
       earnings = activity->rate.value * duration;
     } else {
-      // Load and use project's default rate if not assigned on activity
-      Project *project;
-      FileError error = fs_load_project(activity->project_id, &project);
+      // Look up and use project's default rate if not assigned on activity
+      const Project *project;
+      FileError error = fs_acquire_project(activity->project_id, &project);
       if (error) {
         sprintf(status.prompt, "Failed to load project with ID %zu (error %d)",
                 activity->project_id, error);
@@ -414,12 +420,7 @@ ItemStatus save_activity_status(Activity *activity, void *_item_data) {
 
       earnings = project->default_rate * duration;
 
-      error = fs_free_project(project);
-      if (error) {
-        sprintf(status.prompt, "Failed to free project");
-        status.available = false;
-        return status;
-      }
+      fs_release_project(project);
     }
 
     sprintf(status.prompt, "Save Activity (Earnings: £%.2f)", earnings);
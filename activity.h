@@ -4,6 +4,7 @@
 #include "menu.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
 /// Optional type, `value` is undefined if `present` is false.
@@ -22,6 +23,16 @@ typedef enum ActivityError {
   ACTIVITY_DISPLAY_ERROR,
 } ActivityError;
 
+/// Serialised fields of `Activity` in file order, as `X(kind, symbol)`. Used to
+/// generate the project YAML reader and writer (see `project_yaml.h`).
+#define ACTIVITY_TABLE                                                         \
+  X(STRING, description)                                                       \
+  X(UINT, hours)                                                               \
+  X(UINT, minutes)                                                             \
+  X(OPTIONAL_DOUBLE, rate)                                                     \
+  X(UINT, time)                                                                \
+  X(UINT, project_id)
+
 /// A logged work actvity.
 typedef struct Activity {
   /// Optional description for this specific activity.
@@ -46,8 +57,22 @@ typedef struct Activity {
   unsigned long project_id;
 } Activity;
 
+// Defined in project.h, which depends on this header
+typedef struct Project Project;
+typedef struct ProjectLookup ProjectLookup;
+
 /// Prints information about a passed activity.
 ActivityError display_activity(Activity activity);
+/// Prints information about an activity whose project is already loaded.
+ActivityError display_project_activity(Activity activity,
+                                       const Project *project);
+/// Prints a list of activities, resolving their projects through a lookup
+/// table rather than loading each one.
+ActivityError display_activities(Activity **activities, size_t activity_c,
+                                 const ProjectLookup *lookup);
+
+/// Hourly rate for an activity, falling back to its project's default rate.
+double activity_rate(const Activity *activity, const Project *project);
 
 /// Menu for logging a new activity.
 MenuError new_activity_menu(void *_menu_data, void *_item_data);
@@ -0,0 +1,295 @@
+#include "activity_store.h"
+
+#include "filesystem.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STORE_X86 1
+#endif
+
+/// Allocates a hot column, padded so kernels may load a whole vector at once.
+static void *alloc_column(size_t element_size, size_t element_c) {
+  size_t size = element_size * element_c;
+  size = (size + ACTIVITY_STORE_ALIGNMENT - 1) &
+         ~(size_t)(ACTIVITY_STORE_ALIGNMENT - 1);
+  return aligned_alloc(ACTIVITY_STORE_ALIGNMENT,
+                       size ? size : ACTIVITY_STORE_ALIGNMENT);
+}
+
+StoreError activity_store_build(Project **projects, size_t project_c,
+                                ActivityStore *store_out) {
+  // Load everything first, so the columns are sized once
+  size_t activity_c = 0, description_size = 0;
+  for (size_t i = 0; i < project_c; i++) {
+    Activity *activities;
+    size_t project_activity_c;
+    FileError error =
+        fs_get_activities(projects[i], &activities, &project_activity_c);
+    if (error) {
+      printf("Failed to load activities for project %zu (error %d)\n",
+             projects[i]->id, error);
+      return STORE_LOAD_ERROR;
+    }
+
+    activity_c += project_activity_c;
+    for (size_t j = 0; j < project_activity_c; j++) {
+      description_size += strnlen(activities[j].description,
+                                  sizeof(activities[j].description)) +
+                          1;
+    }
+  }
+
+  ActivityStore store = {
+      .times = alloc_column(sizeof(int64_t), activity_c),
+      .minutes = alloc_column(sizeof(double), activity_c),
+      .rates = alloc_column(sizeof(double), activity_c),
+      .minute_counts = alloc_column(sizeof(int64_t), activity_c),
+      .rate_pence = alloc_column(sizeof(int64_t), activity_c),
+      .narrow = true,
+      .project_indices = alloc_column(sizeof(uint32_t), activity_c),
+      .descriptions = malloc(description_size ? description_size : 1),
+      .description_offsets =
+          malloc(sizeof(size_t) * (activity_c ? activity_c : 1)),
+      .activity_c = activity_c,
+  };
+
+  size_t index = 0, description_offset = 0;
+  uint64_t max_product = 0;
+  for (size_t i = 0; i < project_c; i++) {
+    const Project *project = projects[i];
+    for (size_t j = 0; j < project->activity_c; j++, index++) {
+      const Activity *activity = project->activities + j;
+
+      store.times[index] = (int64_t)activity->time;
+      store.minutes[index] = (double)(activity->hours * 60 + activity->minutes);
+      store.rates[index] = activity_rate(activity, project);
+
+      Pence rate_pence;
+      if (!money_from_pounds(store.rates[index], &rate_pence)) {
+        store.inexact_c++;
+      }
+      int64_t minute_count = activity->hours * 60 + activity->minutes;
+      store.minute_counts[index] = minute_count;
+      store.rate_pence[index] = rate_pence;
+      if (rate_pence < 0 || rate_pence > UINT32_MAX || minute_count < 0 ||
+          minute_count > UINT32_MAX) {
+        store.narrow = false;
+      } else if ((uint64_t)rate_pence * minute_count > max_product) {
+        max_product = (uint64_t)rate_pence * minute_count;
+      }
+      store.project_indices[index] = i;
+
+      size_t length =
+          strnlen(activity->description, sizeof(activity->description));
+      memcpy(store.descriptions + description_offset, activity->description,
+             length);
+      store.descriptions[description_offset + length] = '\0';
+      store.description_offsets[index] = description_offset;
+      description_offset += length + 1;
+    }
+  }
+
+  // Kernels keep 64-bit partial sums, which must not be able to overflow
+  if (max_product && activity_c > INT64_MAX / max_product) {
+    store.narrow = false;
+  }
+
+  *store_out = store;
+
+  return STORE_OK;
+}
+
+void activity_store_free(ActivityStore *store) {
+  free(store->times);
+  free(store->minutes);
+  free(store->rates);
+  free(store->minute_counts);
+  free(store->rate_pence);
+  free(store->project_indices);
+  free(store->descriptions);
+  free(store->description_offsets);
+  memset(store, 0, sizeof(ActivityStore));
+}
+
+const char *activity_store_description(const ActivityStore *store,
+                                       size_t index) {
+  return store->descriptions + store->description_offsets[index];
+}
+
+/// Sums exact rate × minutes over `[first, activity_c)` for activities in
+/// range, wide enough that it cannot overflow.
+static __int128 earnings_exact_scalar(const ActivityStore *store, size_t first,
+                                      int64_t start, int64_t end) {
+  __int128 sum = 0;
+  for (size_t i = first; i < store->activity_c; i++) {
+    if (store->times[i] >= start && store->times[i] < end) {
+      sum += (__int128)store->rate_pence[i] * store->minute_counts[i];
+    }
+  }
+  return sum;
+}
+
+/// Sums rate × minutes over `[first, activity_c)` for activities in range.
+static double earnings_scalar(const ActivityStore *store, size_t first,
+                              int64_t start, int64_t end) {
+  double sum = 0;
+  for (size_t i = first; i < store->activity_c; i++) {
+    if (store->times[i] >= start && store->times[i] < end) {
+      sum += store->rates[i] * store->minutes[i];
+    }
+  }
+  return sum;
+}
+
+#ifdef STORE_X86
+/// Four activities per step, out of range products are masked to zero.
+__attribute__((target("avx2"))) static double
+earnings_avx2(const ActivityStore *store, int64_t start, int64_t end) {
+  // start <= time < end, as time > start - 1 and end > time
+  __m256i after_start = _mm256_set1_epi64x(start - 1);
+  __m256i before_end = _mm256_set1_epi64x(end);
+  __m256d sums[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+
+  size_t i = 0;
+  for (; i + 8 <= store->activity_c; i += 8) {
+    // Two independent accumulators, so additions can overlap
+    for (int half = 0; half < 2; half++) {
+      size_t j = i + half * 4;
+      __m256i times = _mm256_load_si256((const __m256i *)(store->times + j));
+      __m256i in_range =
+          _mm256_and_si256(_mm256_cmpgt_epi64(times, after_start),
+                           _mm256_cmpgt_epi64(before_end, times));
+      __m256d products = _mm256_mul_pd(_mm256_load_pd(store->rates + j),
+                                       _mm256_load_pd(store->minutes + j));
+      sums[half] = _mm256_add_pd(
+          sums[half], _mm256_and_pd(products, _mm256_castsi256_pd(in_range)));
+    }
+  }
+
+  __m256d sum = _mm256_add_pd(sums[0], sums[1]);
+  __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(sum),
+                            _mm256_extractf128_pd(sum, 1));
+  double total = _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+
+  return total + earnings_scalar(store, i, start, end);
+}
+
+/// Two activities per step, out of range products are masked to zero.
+__attribute__((target("sse4.2"))) static double
+earnings_sse(const ActivityStore *store, int64_t start, int64_t end) {
+  __m128i after_start = _mm_set1_epi64x(start - 1);
+  __m128i before_end = _mm_set1_epi64x(end);
+  __m128d sum = _mm_setzero_pd();
+
+  size_t i = 0;
+  for (; i + 2 <= store->activity_c; i += 2) {
+    __m128i times = _mm_load_si128((const __m128i *)(store->times + i));
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi64(times, after_start),
+                                     _mm_cmpgt_epi64(before_end, times));
+    __m128d products = _mm_mul_pd(_mm_load_pd(store->rates + i),
+                                  _mm_load_pd(store->minutes + i));
+    sum = _mm_add_pd(sum, _mm_and_pd(products, _mm_castsi128_pd(in_range)));
+  }
+
+  double total = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+
+  return total + earnings_scalar(store, i, start, end);
+}
+
+/// Exact version of `earnings_avx2`, only for narrow stores. Each lane's
+/// product comes from the low 32 bits of its rate and duration.
+__attribute__((target("avx2"))) static __int128
+earnings_exact_avx2(const ActivityStore *store, int64_t start, int64_t end) {
+  __m256i after_start = _mm256_set1_epi64x(start - 1);
+  __m256i before_end = _mm256_set1_epi64x(end);
+  __m256i sum = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 4 <= store->activity_c; i += 4) {
+    __m256i times = _mm256_load_si256((const __m256i *)(store->times + i));
+    __m256i in_range =
+        _mm256_and_si256(_mm256_cmpgt_epi64(times, after_start),
+                         _mm256_cmpgt_epi64(before_end, times));
+    __m256i products = _mm256_mul_epu32(
+        _mm256_load_si256((const __m256i *)(store->rate_pence + i)),
+        _mm256_load_si256((const __m256i *)(store->minute_counts + i)));
+    sum = _mm256_add_epi64(sum, _mm256_and_si256(products, in_range));
+  }
+
+  int64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+  return (__int128)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         earnings_exact_scalar(store, i, start, end);
+}
+
+/// Exact version of `earnings_sse`, only for narrow stores.
+__attribute__((target("sse4.2"))) static __int128
+earnings_exact_sse(const ActivityStore *store, int64_t start, int64_t end) {
+  __m128i after_start = _mm_set1_epi64x(start - 1);
+  __m128i before_end = _mm_set1_epi64x(end);
+  __m128i sum = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 2 <= store->activity_c; i += 2) {
+    __m128i times = _mm_load_si128((const __m128i *)(store->times + i));
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi64(times, after_start),
+                                     _mm_cmpgt_epi64(before_end, times));
+    __m128i products = _mm_mul_epu32(
+        _mm_load_si128((const __m128i *)(store->rate_pence + i)),
+        _mm_load_si128((const __m128i *)(store->minute_counts + i)));
+    sum = _mm_add_epi64(sum, _mm_and_si128(products, in_range));
+  }
+
+  int64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, sum);
+  return (__int128)lanes[0] + lanes[1] +
+         earnings_exact_scalar(store, i, start, end);
+}
+#endif
+
+double activity_store_earnings(const ActivityStore *store, time_t start,
+                               time_t end) {
+  double rate_minutes;
+#ifdef STORE_X86
+  if (__builtin_cpu_supports("avx2")) {
+    rate_minutes = earnings_avx2(store, start, end);
+  } else if (__builtin_cpu_supports("sse4.2")) {
+    rate_minutes = earnings_sse(store, start, end);
+  } else {
+    rate_minutes = earnings_scalar(store, 0, start, end);
+  }
+#else
+  rate_minutes = earnings_scalar(store, 0, start, end);
+#endif
+
+  // Rates are hourly
+  return rate_minutes / 60.0;
+}
+
+bool activity_store_earnings_exact(const ActivityStore *store, time_t start,
+                                   time_t end, MoneyTicks *ticks_out) {
+  __int128 ticks;
+#ifdef STORE_X86
+  if (store->narrow && __builtin_cpu_supports("avx2")) {
+    ticks = earnings_exact_avx2(store, start, end);
+  } else if (store->narrow && __builtin_cpu_supports("sse4.2")) {
+    ticks = earnings_exact_sse(store, start, end);
+  } else {
+    ticks = earnings_exact_scalar(store, 0, start, end);
+  }
+#else
+  ticks = earnings_exact_scalar(store, 0, start, end);
+#endif
+
+  if (ticks > INT64_MAX || ticks < INT64_MIN) {
+    return false;
+  }
+
+  *ticks_out = (MoneyTicks)ticks;
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef ACTIVITY_STORE_H_
+#define ACTIVITY_STORE_H_
+
+#include "activity.h"
+#include "money.h"
+#include "project.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// Alignment of every hot column, enough for AVX2 loads.
+#define ACTIVITY_STORE_ALIGNMENT (32)
+
+typedef enum StoreError {
+  STORE_OK = 0,
+  /// Something went wrong loading a project's activities.
+  STORE_LOAD_ERROR,
+} StoreError;
+
+/// Column-wise copy of the activities of a project list. The fields needed for
+/// sums are packed into their own arrays, so a scan reads 28 bytes per
+/// activity instead of a whole `Activity` (mostly description).
+typedef struct ActivityStore {
+  /// Hot columns, `activity_c` entries each.
+  int64_t *times;
+  /// Duration in minutes.
+  double *minutes;
+  /// Effective hourly rate, the project's default already applied.
+  double *rates;
+  /// Integer copies of the above, for exact sums. Rates are rounded to whole
+  /// pence.
+  int64_t *minute_counts;
+  int64_t *rate_pence;
+  /// Activities whose rate is not a whole number of pence.
+  size_t inexact_c;
+  /// Every integer rate and duration fits in 32 bits and no sum of their
+  /// products can overflow, so exact sums may use 32-bit multiplies.
+  bool narrow;
+  /// Index into the project list the store was built from.
+  uint32_t *project_indices;
+
+  /// Cold column, descriptions packed end to end (each null terminated) and
+  /// only read for display.
+  char *descriptions;
+  size_t *description_offsets;
+
+  size_t activity_c;
+} ActivityStore;
+
+/// Builds a store from a project list (which may be header-only, activities
+/// are loaded as needed), in project order.
+StoreError activity_store_build(Project **projects, size_t project_c,
+                                ActivityStore *store_out);
+/// Frees every column of a store.
+void activity_store_free(ActivityStore *store);
+/// Description of an activity in the store.
+const char *activity_store_description(const ActivityStore *store,
+                                       size_t index);
+
+/// Total earnings of the activities logged in `[start, end)`. Uses AVX2 or
+/// SSE4.2 when the CPU supports them, plain C otherwise.
+double activity_store_earnings(const ActivityStore *store, time_t start,
+                               time_t end);
+/// Exact earnings of the activities logged in `[start, end)`, false if they
+/// overflow. Uses AVX2 or SSE4.2 like `activity_store_earnings`.
+bool activity_store_earnings_exact(const ActivityStore *store, time_t start,
+                                   time_t end, MoneyTicks *ticks_out);
+
+#endif
@@ -0,0 +1,135 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Every allocation is rounded up to this, matching `ArenaBlock.data`.
+#define ARENA_ALIGNMENT (16)
+
+/// Stored directly before each allocation so that it can be resized.
+typedef struct AllocationHeader {
+  size_t size;
+  size_t _padding;
+} AllocationHeader;
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+Arena *arena_create(void) { return calloc(1, sizeof(Arena)); }
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size_t needed = sizeof(AllocationHeader) + align_up(size);
+
+  // Start a new block if the current one is full
+  ArenaBlock *block = arena->blocks;
+  if (!block || block->size - block->used < needed) {
+    size_t block_size = needed > ARENA_BLOCK_SIZE ? needed : ARENA_BLOCK_SIZE;
+    block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block) {
+      return NULL;
+    }
+    block->next = arena->blocks;
+    block->size = block_size;
+    block->used = 0;
+    arena->blocks = block;
+    arena->reserved += block_size;
+  }
+
+  AllocationHeader *header = (AllocationHeader *)(block->data + block->used);
+  header->size = size;
+  block->used += needed;
+  arena->used += needed;
+
+  void *pointer = header + 1;
+  memset(pointer, 0, size);
+  return pointer;
+}
+
+void *arena_realloc(Arena *arena, void *pointer, size_t size) {
+  if (!pointer) {
+    return arena_alloc(arena, size);
+  }
+
+  AllocationHeader *header = (AllocationHeader *)pointer - 1;
+  size_t old_size = header->size;
+
+  // Latest allocation in the current block, grow or shrink in place
+  ArenaBlock *block = arena->blocks;
+  unsigned char *old_end = (unsigned char *)pointer + align_up(old_size);
+  if (block && old_end == block->data + block->used) {
+    size_t old_needed = align_up(old_size);
+    size_t new_needed = align_up(size);
+    if (new_needed <= old_needed ||
+        block->size - block->used >= new_needed - old_needed) {
+      block->used = block->used - old_needed + new_needed;
+      arena->used = arena->used - old_needed + new_needed;
+      if (size > old_size) {
+        memset((unsigned char *)pointer + old_size, 0, size - old_size);
+      }
+      header->size = size;
+      return pointer;
+    }
+  }
+
+  // Otherwise copy into a fresh allocation, the old one is simply abandoned
+  void *resized = arena_alloc(arena, size);
+  if (resized) {
+    memcpy(resized, pointer, old_size < size ? old_size : size);
+  }
+  return resized;
+}
+
+void arena_merge(Arena *destination, Arena *source) {
+  // Splice source blocks in after the destination's current block, so that
+  // the destination keeps allocating from where it was
+  ArenaBlock *last = source->blocks;
+  if (last) {
+    while (last->next) {
+      last = last->next;
+    }
+
+    if (destination->blocks) {
+      last->next = destination->blocks->next;
+      destination->blocks->next = source->blocks;
+    } else {
+      destination->blocks = source->blocks;
+    }
+  }
+
+  destination->reserved += source->reserved;
+  destination->used += source->used;
+  free(source);
+}
+
+void arena_reset(Arena *arena) {
+  ArenaBlock *block = arena->blocks;
+  while (block) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  arena->blocks = NULL;
+  arena->reserved = 0;
+  arena->used = 0;
+}
+
+void arena_destroy(Arena *arena) {
+  if (!arena) {
+    return;
+  }
+
+  arena_reset(arena);
+  free(arena);
+}
+
+void *arena_cyaml_mem(void *context, void *pointer, size_t size) {
+  // A size of 0 means free, released with the arena instead
+  if (!size) {
+    return NULL;
+  }
+
+  return arena_realloc(context, pointer, size);
+}
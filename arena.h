@@ -0,0 +1,46 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+/// Size of a regular arena block, larger allocations get a block of their own.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/// A chunk of memory that allocations are bumped out of.
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  /// Usable bytes in `data`.
+  size_t size;
+  /// Bytes of `data` handed out so far.
+  size_t used;
+  _Alignas(16) unsigned char data[];
+} ArenaBlock;
+
+/// Bump allocator, everything allocated from it is released at once.
+typedef struct Arena {
+  /// Blocks, newest (and only one still being allocated from) first.
+  ArenaBlock *blocks;
+  /// Total bytes reserved from the system for blocks.
+  size_t reserved;
+  /// Total bytes handed out, including allocation headers and padding.
+  size_t used;
+} Arena;
+
+/// Creates an empty arena.
+Arena *arena_create(void);
+/// Allocates zeroed memory from an arena.
+void *arena_alloc(Arena *arena, size_t size);
+/// Resizes an allocation, in place if it was the latest one.
+void *arena_realloc(Arena *arena, void *pointer, size_t size);
+/// Moves every block of `source` into `destination` and destroys `source`.
+void arena_merge(Arena *destination, Arena *source);
+/// Releases every allocation, keeping the arena itself usable.
+void arena_reset(Arena *arena);
+/// Releases every allocation and the arena itself.
+void arena_destroy(Arena *arena);
+
+/// `cyaml_mem_fn_t` compatible allocator, `context` being the arena. Frees are
+/// ignored, memory is released when the arena is.
+void *arena_cyaml_mem(void *context, void *pointer, size_t size);
+
+#endif
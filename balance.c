@@ -1,64 +1,87 @@
 #include "balance.h"
 
 #include "activity.h"
-#include "date.h"
+#include "activity_store.h"
+#include "breakdown.h"
+#include "calendar.h"
 #include "error.h"
 #include "filesystem.h"
 #include "input.h"
 #include "menu.h"
+#include "query.h"
+#include "rollup.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 MenuError balance_menu(void *_menu_data, void *_item_data) {
-  // Load project list to menu data struct
+  // Load header-only projects, each range only reads the partitions it needs
   BalanceMenuData data;
-  FileError error = fs_get_project_list(&data.projects, &data.project_c);
+  FileError error = fs_get_project_headers(&data.projects, &data.project_c);
   if (error) {
     printf("Failed to get project list (error %d)\n", error);
     return MENU_ITEM_ERROR;
   }
+  // Resolve projects by ID from the loaded list, rather than reloading them
+  project_lookup_build(data.projects, data.project_c, &data.lookup);
+  // Daily totals for earnings
+  RollupError rollup_error = rollup_load(&data.rollups);
+  if (rollup_error) {
+    printf("Failed to load rollups (error %d)\n", rollup_error);
+    project_lookup_free(&data.lookup);
+    fs_free_project_list(data.projects, data.project_c);
+    return MENU_ITEM_ERROR;
+  }
   // Store current timestamp for date range calculations
   data.t = time(NULL);
 
-  // Hacky, but works!
-  bool no_predict = false;
-  bool predict = true;
+  // Calculate every window up front, in one pass
+  BalanceWindow windows[BALANCE_WINDOW_C];
+  balance_fixed_windows(data.t, windows);
+  BalanceError balance_error =
+      balance_report_build(data.projects, data.project_c, &data.rollups,
+                           windows, BALANCE_WINDOW_C, &data.report);
+  if (balance_error) {
+    printf("Failed to calculate balance (error %d)\n", balance_error);
+    rollup_free(&data.rollups);
+    project_lookup_free(&data.lookup);
+    fs_free_project_list(data.projects, data.project_c);
+    return MENU_ITEM_ERROR;
+  }
+
+  // One item per window, which just renders it
+  MenuItem items[BALANCE_WINDOW_C + 3];
+  for (size_t i = 0; i < BALANCE_WINDOW_C; i++) {
+    items[i] = (MenuItem){
+        .function = (MenuItemFn)show_balance,
+        .default_prompt = data.report.windows[i].prompt,
+        .status_check = NULL,
+        .item_data = data.report.windows + i,
+    };
+  }
 
-  MenuItem daily = {
-      .function = (MenuItemFn)daily_balance,
-      .default_prompt = "Balance today",
+  items[BALANCE_WINDOW_C] = (MenuItem){
+      .function = (MenuItemFn)custom_balance,
+      .default_prompt = "Balance for custom range",
       .status_check = NULL,
       .item_data = NULL,
   };
-  MenuItem week_so_far = {
-      .function = (MenuItemFn)weekly_balance,
-      .default_prompt = "Balance so far this week",
-      .status_check = NULL,
-      .item_data = &no_predict,
-  };
-  MenuItem whole_week = {
-      .function = (MenuItemFn)weekly_balance,
-      .default_prompt = "Balance for whole week",
+  items[BALANCE_WINDOW_C + 1] = (MenuItem){
+      .function = (MenuItemFn)breakdown_balance,
+      .default_prompt = "Breakdown",
       .status_check = NULL,
-      .item_data = &predict,
-  };
-  MenuItem month_so_far = {
-      .function = (MenuItemFn)monthly_balance,
-      .default_prompt = "Balance so far this month",
-      .status_check = NULL,
-      .item_data = &no_predict,
+      .item_data = NULL,
   };
-  MenuItem whole_month = {
-      .function = (MenuItemFn)monthly_balance,
-      .default_prompt = "Balance for whole month",
+  items[BALANCE_WINDOW_C + 2] = (MenuItem){
+      .function = (MenuItemFn)verify_rollups,
+      .default_prompt = "Verify rollups",
       .status_check = NULL,
-      .item_data = &predict,
+      .item_data = NULL,
   };
 
-  MenuItem items[] = {daily, week_so_far, whole_week, month_so_far,
-                      whole_month};
   size_t item_c = sizeof(items) / sizeof(MenuItem);
   MenuItem *items_pointer = items;
 
@@ -69,7 +92,10 @@ MenuError balance_menu(void *_menu_data, void *_item_data) {
                .title = "Calculate..."};
   PROPAGATE(MenuError, open_menu, (&menu));
 
-  // Free project list
+  // Free report, rollups, lookup table and project list
+  balance_report_free(&data.report);
+  rollup_free(&data.rollups);
+  project_lookup_free(&data.lookup);
   error = fs_free_project_list(data.projects, data.project_c);
   if (error) {
     printf("Failed to free project list (error %d)", error);
@@ -79,239 +105,445 @@ MenuError balance_menu(void *_menu_data, void *_item_data) {
   return MENU_OK;
 }
 
-MenuError daily_balance(BalanceMenuData *menu_data, void *_item_data) {
-  // Filter activities that were logged today, storing to dynamic array
-  printf("\nActivities today:\n");
-  size_t filtered_activity_c = 0;
-  Activity **filtered_activities = NULL;
-  for (int project_index = 0; project_index < menu_data->project_c;
-       project_index++) {
-    Project *project = menu_data->projects[project_index];
-    for (int activity_index = 0; activity_index < project->activity_c;
-         activity_index++) {
-      Activity *activity = project->activities + activity_index;
-
-      time_t activity_time = (time_t)activity->time;
-
-      if (is_same_day(menu_data->t, activity_time)) {
-        display_activity(*activity);
-        filtered_activity_c++;
-        filtered_activities = realloc(filtered_activities,
-                                      sizeof(Activity *) * filtered_activity_c);
-
-        filtered_activities[filtered_activity_c - 1] = activity;
-      }
-    }
-  }
-  if (!filtered_activity_c) {
+MenuError show_balance(BalanceMenuData *menu_data, BalanceWindow *window) {
+  // Activities were already collected when the report was built
+  printf("\nActivities %s:\n", window->label);
+  if (window->activity_c) {
+    display_activities(window->activities, window->activity_c,
+                       &menu_data->lookup);
+  } else {
     printf("N/A\n");
   }
 
-  // Calculate balance info
-  double balance, expenses, earnings;
-  BalanceError error = calc_balance(1, filtered_activities, filtered_activity_c,
-                                    &balance, &expenses, &earnings);
-  if (error) {
-    printf("Failed to calculate balance (error %d)\n", error);
-    return MENU_ITEM_ERROR;
+  // Format date range, a single day if that's all it covers
+  struct tm first_tm, last_tm;
+  localtime_r(&window->first_day, &first_tm);
+  localtime_r(&window->last_day, &last_tm);
+  if (calendar_day(window->first_day) == calendar_day(window->last_day)) {
+    printf("\nCalculated for %.4d/%.2d/%.2d:\n", first_tm.tm_year + 1900,
+           first_tm.tm_mon + 1, first_tm.tm_mday);
+  } else {
+    printf("\nCalculated for %.4d/%.2d/%.2d-%.4d/%.2d/%.2d:\n",
+           first_tm.tm_year + 1900, first_tm.tm_mon + 1, first_tm.tm_mday,
+           last_tm.tm_year + 1900, last_tm.tm_mon + 1, last_tm.tm_mday);
   }
 
-  // Format current day
-  struct tm tm;
-  localtime_r(&menu_data->t, &tm);
-  printf("\nCalculated for %.4d/%.2d/%.2d:\n", tm.tm_year + 1900, tm.tm_mon + 1,
-         tm.tm_mday);
-
   // Display balance
-  printf("Earnings: +£%.2f\n", earnings);
-  printf("Expenses: -£%.2f\n", expenses);
-  if (balance >= 0) {
-    printf("Balance: +£%.2f\n", balance);
+  printf("Earnings: +£%.2f\n", window->earnings);
+  printf("Expenses: -£%.2f\n", window->expenses);
+  if (window->balance >= 0) {
+    printf("Balance: +£%.2f\n", window->balance);
   } else {
-    printf("Balance: -£%.2f\n", -balance);
+    printf("Balance: -£%.2f\n", -window->balance);
   }
 
-  // Cleanup
-  free(filtered_activities);
   wait_for_enter();
 
   return MENU_OK;
 }
 
-MenuError weekly_balance(BalanceMenuData *menu_data, bool *predict) {
-  // Determine week start and end timestamp
-  struct tm week_start_tm;
-  localtime_r(&menu_data->t, &week_start_tm);
-  // Get to midnight
-  week_start_tm.tm_hour = 0;
-  week_start_tm.tm_min = 0;
-  week_start_tm.tm_sec = 0;
-  // Offset to monday
-  week_start_tm.tm_mday -= week_start_tm.tm_wday - 1;
-  // Convert to timestamps
-  time_t week_start = mktime(&week_start_tm);
-  time_t week_end = week_start + 7 * 24 * 60 * 60;
-
-  // Filter by activities this week, storing to dynamic array
-  printf("\nActivities this week:\n");
-  size_t filtered_activity_c = 0;
-  Activity **filtered_activities = NULL;
-  for (int project_index = 0; project_index < menu_data->project_c;
-       project_index++) {
-    Project *project = menu_data->projects[project_index];
-    for (int activity_index = 0; activity_index < project->activity_c;
-         activity_index++) {
-      Activity *activity = project->activities + activity_index;
-
-      time_t activity_time = (time_t)activity->time;
-
-      if (activity_time >= week_start && activity_time < week_end) {
-        display_activity(*activity);
-        filtered_activity_c++;
-        filtered_activities = realloc(filtered_activities,
-                                      sizeof(Activity *) * filtered_activity_c);
-
-        filtered_activities[filtered_activity_c - 1] = activity;
-      }
-    }
+/// Reads a window's date range from the user, both ends inclusive.
+static void read_window_range(BalanceWindow *window) {
+  printf("Enter start date (YYYY/MM/DD)\n: ");
+  while (read_date(&window->first_day)) {
+    printf("Invalid input\n: ");
   }
-  if (!filtered_activity_c) {
-    printf("N/A\n");
+  printf("Enter end date (YYYY/MM/DD)\n: ");
+  while (read_date(&window->last_day) || window->last_day < window->first_day) {
+    printf("Invalid input\n: ");
   }
 
-  struct tm week_end_tm, current_tm;
-  localtime_r(&week_end, &week_end_tm);
-  localtime_r(&menu_data->t, &current_tm);
+  // Range ends at the start of the day after the last day
+  int64_t first_day = calendar_day(window->first_day);
+  int64_t last_day = calendar_day(window->last_day);
+  window->start = window->first_day;
+  window->end = calendar_day_start(last_day + 1);
+  window->days = last_day - first_day + 1;
+}
 
-  // Determine number of days to calculate expenses for
-  unsigned int days;
-  if (*predict) {
-    days = 7;
-  } else {
-    days = current_tm.tm_wday + 1;
-  }
+MenuError custom_balance(BalanceMenuData *menu_data, void *_item_data) {
+  BalanceWindow window = {.label = "in range"};
+  read_window_range(&window);
 
-  // Calculate balance information
-  double balance, expenses, earnings;
+  // Same engine as the fixed windows, just with the one window
+  BalanceReport report;
   BalanceError error =
-      calc_balance(days, filtered_activities, filtered_activity_c, &balance,
-                   &expenses, &earnings);
+      balance_report_build(menu_data->projects, menu_data->project_c,
+                           &menu_data->rollups, &window, 1, &report);
   if (error) {
     printf("Failed to calculate balance (error %d)\n", error);
     return MENU_ITEM_ERROR;
   }
 
-  // Determine end date for balance calculations
-  week_end_tm.tm_mday -= 1;
-  mktime(&week_end_tm);
+  MenuError menu_error = show_balance(menu_data, report.windows);
+  balance_report_free(&report);
 
-  struct tm end_tm;
-  if (*predict) {
-    end_tm = week_end_tm;
-  } else {
-    end_tm = current_tm;
+  return menu_error;
+}
+
+/// Prints the label for a breakdown group, e.g. a project name or a date.
+static void print_group_label(const BalanceMenuData *menu_data,
+                              BreakdownKey key, const BreakdownGroup *group) {
+  int year, month, day;
+  switch (key) {
+  case BREAKDOWN_PROJECT: {
+    const Project *project =
+        project_lookup_find(&menu_data->lookup, group->key);
+    printf("%s", project ? project->name : "(Deleted project)");
+    break;
+  }
+  case BREAKDOWN_DAY:
+    calendar_civil_from_days(group->key, &year, &month, &day);
+    printf("%.4d/%.2d/%.2d", year, month, day);
+    break;
+  case BREAKDOWN_WEEK:
+    calendar_civil_from_days(group->key, &year, &month, &day);
+    printf("Week of %.4d/%.2d/%.2d", year, month, day);
+    break;
+  case BREAKDOWN_MONTH:
+    printf("%.4d/%.2d", (int)(group->key / 12), (int)(group->key % 12) + 1);
+    break;
   }
+}
 
-  // Format date range
-  printf("\nCalculated for %.4d/%.2d/%.2d-%.4d/%.2d/%.2d:\n",
-         week_start_tm.tm_year + 1900, week_start_tm.tm_mon + 1,
-         week_start_tm.tm_mday, end_tm.tm_year + 1900, end_tm.tm_mon + 1,
-         end_tm.tm_mday);
-  // Display balance
-  printf("Earnings: +£%.2f\n", earnings);
-  printf("Expenses: -£%.2f\n", expenses);
-  if (balance >= 0) {
-    printf("Balance: +£%.2f\n", balance);
-  } else {
-    printf("Balance: -£%.2f\n", -balance);
+MenuError breakdown_balance(BalanceMenuData *menu_data, void *_item_data) {
+  BreakdownKey key;
+  bool chosen = false;
+  while (!chosen) {
+    printf("By [P]roject, [D]ay, [W]eek or [M]onth? ([C]ancel)\n: ");
+    char input = tolower(getc(stdin));
+    flush_input_buffer();
+
+    chosen = true;
+    switch (input) {
+    case 'p':
+      key = BREAKDOWN_PROJECT;
+      break;
+    case 'd':
+      key = BREAKDOWN_DAY;
+      break;
+    case 'w':
+      key = BREAKDOWN_WEEK;
+      break;
+    case 'm':
+      key = BREAKDOWN_MONTH;
+      break;
+    case 'c':
+      return MENU_OK;
+    default:
+      chosen = false;
+    }
+  }
+
+  BalanceWindow window = {0};
+  read_window_range(&window);
+
+  // One walk over the rollup rows in range, grouped as it goes
+  Breakdown breakdown;
+  breakdown_build(&menu_data->rollups, key, calendar_day(window.start),
+                  calendar_day(window.end), &breakdown);
+  breakdown_sort(&breakdown);
+
+  printf("\nBreakdown:\n");
+  if (!breakdown.group_c) {
+    printf("N/A\n");
   }
+  for (size_t i = 0; i < breakdown.group_c; i++) {
+    const BreakdownGroup *group = breakdown.groups + i;
+    print_group_label(menu_data, key, group);
+    printf(" | Duration: %.2lu:%.2lu | Activities: %zu | Earnings: £%.2f | "
+           "Average rate: £%.2f/hour\n",
+           group->minutes / 60, group->minutes % 60, group->activity_c,
+           breakdown_earnings(group), breakdown_average_rate(group));
+  }
+  breakdown_free(&breakdown);
 
-  // Cleanup
-  free(filtered_activities);
   wait_for_enter();
 
   return MENU_OK;
 }
 
-MenuError monthly_balance(BalanceMenuData *menu_data, bool *predict) {
-  // Filter by activities logged this month
-  printf("\nActivities this month:\n");
-  size_t filtered_activity_c = 0;
-  Activity **filtered_activities = NULL;
-  for (int project_index = 0; project_index < menu_data->project_c;
-       project_index++) {
-    Project *project = menu_data->projects[project_index];
-    for (int activity_index = 0; activity_index < project->activity_c;
-         activity_index++) {
-      Activity *activity = project->activities + activity_index;
-
-      time_t activity_time = (time_t)activity->time;
-
-      if (is_same_month(menu_data->t, activity_time)) {
-        display_activity(*activity);
-        filtered_activity_c++;
-        filtered_activities = realloc(filtered_activities,
-                                      sizeof(Activity *) * filtered_activity_c);
-
-        filtered_activities[filtered_activity_c - 1] = activity;
-      }
-    }
-  }
-  if (!filtered_activity_c) {
-    printf("N/A\n");
+/// Rebuilds the rollups and reloads the menu's table and report from them,
+/// then cross-checks the report. The menu keeps its old table and report
+/// unless both reloaded.
+static MenuError check_rollups(BalanceMenuData *menu_data) {
+  // Rebuild from every activity and compare against the stored rollups
+  printf("\nVerifying rollups...\n");
+  size_t difference_c;
+  RollupError error = rollup_verify(&difference_c);
+  if (error) {
+    printf("Failed to verify rollups (error %d)\n", error);
+    return MENU_ITEM_ERROR;
   }
 
-  struct tm current_time;
-  localtime_r(&menu_data->t, &current_time);
-
-  // Determine days for expenses calculations
-  unsigned int days;
-  if (*predict) {
-    days = days_this_month();
+  if (difference_c) {
+    printf("%zu rows differed, rollups have been rebuilt\n", difference_c);
   } else {
-    days = current_time.tm_mday;
+    printf("Rollups match the logged activities\n");
   }
 
-  // Calculate balance
-  double balance, expenses, earnings;
-  BalanceError error =
-      calc_balance(days, filtered_activities, filtered_activity_c, &balance,
-                   &expenses, &earnings);
+  // Pick up the rebuilt table, refreshing the report's earnings from it
+  RollupTable rollups;
+  error = rollup_load(&rollups);
   if (error) {
-    printf("Failed to calculate balance (error %d)\n", error);
+    printf("Failed to reload rollups (error %d)\n", error);
     return MENU_ITEM_ERROR;
   }
 
-  // Format date range
-  int year = current_time.tm_year + 1900;
-  int month = current_time.tm_mon + 1;
-  printf("\nCalculated for %.4d/%.2d/01-%.4d/%.2d/%.2d:\n", year, month, year,
-         month, days);
-  // Display balance
-  printf("Earnings: +£%.2f\n", earnings);
-  printf("Expenses: -£%.2f\n", expenses);
-  if (balance >= 0) {
-    printf("Balance: +£%.2f\n", balance);
-  } else {
-    printf("Balance: -£%.2f\n", -balance);
+  BalanceReport report;
+  BalanceError balance_error = balance_report_build(
+      menu_data->projects, menu_data->project_c, &rollups,
+      menu_data->report.windows, menu_data->report.window_c, &report);
+  if (balance_error) {
+    printf("Failed to calculate balance (error %d)\n", balance_error);
+    rollup_free(&rollups);
+    return MENU_ITEM_ERROR;
+  }
+  rollup_free(&menu_data->rollups);
+  menu_data->rollups = rollups;
+  // Menu items point at the windows, so update them in place
+  balance_report_free(&menu_data->report);
+  menu_data->report = report;
+
+  // Cross-check every window's earnings against the raw activities, summed
+  // independently of the rollups
+  ActivityStore store;
+  if (activity_store_build(menu_data->projects, menu_data->project_c,
+                           &store)) {
+    printf("Failed to load activities for cross-check\n");
+    return MENU_ITEM_ERROR;
+  }
+  for (size_t i = 0; i < report.window_c; i++) {
+    BalanceWindow *window = menu_data->report.windows + i;
+
+    // Fixed-point totals must match exactly
+    if (money_fixed_point()) {
+      MoneyTicks raw_ticks;
+      if (!activity_store_earnings_exact(&store, window->start, window->end,
+                                         &raw_ticks)) {
+        printf("%s: earnings overflow\n", window->prompt);
+      } else if (raw_ticks != window->earnings_ticks) {
+        printf("%s: rollups give £%.2f, activities give £%.2f\n",
+               window->prompt, window->earnings,
+               money_to_pounds(money_ticks_to_pence(raw_ticks)));
+      }
+      continue;
+    }
+
+    double raw_earnings =
+        activity_store_earnings(&store, window->start, window->end);
+    double difference = raw_earnings - window->earnings;
+    if (difference > 0.005 || difference < -0.005) {
+      printf("%s: rollups give £%.2f, activities give £%.2f\n",
+             window->prompt, window->earnings, raw_earnings);
+    }
   }
+  activity_store_free(&store);
+
+  return MENU_OK;
+}
 
-  // Cleanup
-  free(filtered_activities);
+MenuError verify_rollups(BalanceMenuData *menu_data, void *_item_data) {
+  MenuError error = check_rollups(menu_data);
+
+  // Leave the results, or what went wrong, on screen until the menu redraws
   wait_for_enter();
 
-  return MENU_OK;
+  return error;
 }
 
-BalanceError calc_balance(unsigned int days, Activity **activities,
-                          size_t activity_c, double *balance_out,
-                          double *expenses_out, double *earnings_out) {
-  // Get expenses and earnings
+void balance_fixed_windows(time_t t,
+                           BalanceWindow windows_out[BALANCE_WINDOW_C]) {
+  // Work in day numbers, only converting back to times for boundaries
+  int64_t day = calendar_day(t);
+  int year, month, day_of_month;
+  calendar_civil_from_days(day, &year, &month, &day_of_month);
+
+  // Weeks start on monday
+  int64_t week_first_day = day - calendar_weekday(day);
+  int64_t month_first_day = day - (day_of_month - 1);
+  int64_t month_day_c = calendar_days_in_month(year, month);
+
+  time_t today = calendar_day_start(day);
+  time_t tomorrow = calendar_day_start(day + 1);
+  time_t week_start = calendar_day_start(week_first_day);
+  time_t week_end = calendar_day_start(week_first_day + 7);
+  time_t month_start = calendar_day_start(month_first_day);
+  time_t month_end = calendar_day_start(month_first_day + month_day_c);
+
+  // Whole periods count activities the same as so far, only the expenses
+  // (and the range shown) differ
+  windows_out[BALANCE_TODAY] = (BalanceWindow){
+      .prompt = "Balance today",
+      .label = "today",
+      .start = today,
+      .end = tomorrow,
+      .first_day = today,
+      .last_day = today,
+  };
+  windows_out[BALANCE_WEEK_SO_FAR] = (BalanceWindow){
+      .prompt = "Balance so far this week",
+      .label = "this week",
+      .start = week_start,
+      .end = week_end,
+      .first_day = week_start,
+      .last_day = today,
+  };
+  windows_out[BALANCE_WHOLE_WEEK] = (BalanceWindow){
+      .prompt = "Balance for whole week",
+      .label = "this week",
+      .start = week_start,
+      .end = week_end,
+      .first_day = week_start,
+      .last_day = calendar_day_start(week_first_day + 6),
+  };
+  windows_out[BALANCE_MONTH_SO_FAR] = (BalanceWindow){
+      .prompt = "Balance so far this month",
+      .label = "this month",
+      .start = month_start,
+      .end = month_end,
+      .first_day = month_start,
+      .last_day = today,
+  };
+  windows_out[BALANCE_WHOLE_MONTH] = (BalanceWindow){
+      .prompt = "Balance for whole month",
+      .label = "this month",
+      .start = month_start,
+      .end = month_end,
+      .first_day = month_start,
+      .last_day = calendar_day_start(month_first_day + month_day_c - 1),
+  };
+
+  // Expenses cover every day shown
+  for (size_t i = 0; i < BALANCE_WINDOW_C; i++) {
+    windows_out[i].days = calendar_day(windows_out[i].last_day) -
+                          calendar_day(windows_out[i].first_day) + 1;
+  }
+}
+
+/// Orders activity pointers by time.
+static int compare_activity_time(const void *a, const void *b) {
+  unsigned long time_a = (*(Activity *const *)a)->time;
+  unsigned long time_b = (*(Activity *const *)b)->time;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+/// Index of the first activity logged at or after `time`, in a time-sorted
+/// pointer array.
+static size_t activity_lower_bound(Activity **activities, size_t activity_c,
+                                   time_t time) {
+  size_t low = 0, high = activity_c;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if ((time_t)activities[middle]->time < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/// Rounds exact earnings and expenses to whole pence, and takes the balance
+/// between them in pence so that it adds up to exactly what is shown.
+static void fixed_point_balance(MoneyTicks earnings_ticks, double expenses,
+                                double *balance_out, double *expenses_out,
+                                double *earnings_out) {
+  Pence earnings_pence = money_ticks_to_pence(earnings_ticks);
+  // Daily expenses are rarely whole pence, so this rounds rather than fails
+  Pence expenses_pence;
+  money_from_pounds(expenses, &expenses_pence);
+
+  *earnings_out = money_to_pounds(earnings_pence);
+  *expenses_out = money_to_pounds(expenses_pence);
+  *balance_out = money_to_pounds(earnings_pence - expenses_pence);
+}
+
+BalanceError balance_report_build(Project **projects, size_t project_c,
+                                  const RollupTable *rollups,
+                                  const BalanceWindow *windows,
+                                  size_t window_c, BalanceReport *report_out) {
+  BalanceReport report = {.window_c = window_c};
+  memcpy(report.windows, windows, sizeof(BalanceWindow) * window_c);
+
+  // Range covering every window
+  time_t start = windows[0].start, end = windows[0].end;
+  for (size_t i = 1; i < window_c; i++) {
+    start = windows[i].start < start ? windows[i].start : start;
+    end = windows[i].end > end ? windows[i].end : end;
+  }
+
+  // Query it once, then slice it per window
+  ActivityQuery query = {.start = start, .end = end};
+  if (query_activities(projects, project_c, &query, &report.activities,
+                       &report.activity_c)) {
+    return BALANCE_QUERY_ERROR;
+  }
+  qsort(report.activities, report.activity_c, sizeof(Activity *),
+        compare_activity_time);
+
+  for (size_t i = 0; i < window_c; i++) {
+    BalanceWindow *window = report.windows + i;
+    size_t first = activity_lower_bound(report.activities, report.activity_c,
+                                        window->start);
+    size_t last = activity_lower_bound(report.activities, report.activity_c,
+                                       window->end);
+    window->activities = report.activities + first;
+    window->activity_c = last - first;
+
+    // Earnings from the rollup index, O(log days) however long the window
+    RollupTotals totals;
+    rollup_sum(rollups, calendar_day(window->start), calendar_day(window->end),
+               &totals);
+    window->earnings = totals.earnings;
+    window->earnings_ticks = totals.earnings_ticks;
+  }
+
+  // Expenses are the same per day, so only read the preferences once
+  double daily_expenses;
+  BalanceError error = calc_expenses(1, &daily_expenses);
+  if (error) {
+    free(report.activities);
+    return error;
+  }
+  for (size_t i = 0; i < window_c; i++) {
+    BalanceWindow *window = report.windows + i;
+    window->expenses = daily_expenses * window->days;
+    window->balance = window->earnings - window->expenses;
+    if (money_fixed_point()) {
+      fixed_point_balance(window->earnings_ticks, window->expenses,
+                          &window->balance, &window->expenses,
+                          &window->earnings);
+    }
+  }
+
+  *report_out = report;
+
+  return BALANCE_OK;
+}
+
+void balance_report_free(BalanceReport *report) {
+  free(report->activities);
+  report->activities = NULL;
+  report->activity_c = 0;
+}
+
+BalanceError calc_balance(unsigned int days, const RollupTable *rollups,
+                          int64_t first_day, int64_t end_day,
+                          double *balance_out, double *expenses_out,
+                          double *earnings_out) {
+  // Get expenses and earnings, summed through the rollup index rather than
+  // from every activity
   PROPAGATE(BalanceError, calc_expenses, (days, expenses_out));
-  PROPAGATE(BalanceError, calc_earnings,
-            (activities, activity_c, earnings_out));
+  RollupTotals totals;
+  rollup_sum(rollups, first_day, end_day, &totals);
+  *earnings_out = totals.earnings;
 
   *balance_out = *earnings_out - *expenses_out;
+  if (money_fixed_point()) {
+    fixed_point_balance(totals.earnings_ticks, *expenses_out, balance_out,
+                        expenses_out, earnings_out);
+  }
 
   return BALANCE_OK;
 }
@@ -330,41 +562,3 @@ BalanceError calc_expenses(unsigned int days, double *expenses_out) {
 
   return BALANCE_OK;
 }
-
-BalanceError calc_earnings(Activity **activities, size_t activity_c,
-                           double *earnings_out) {
-  double earnings = 0;
-  for (int i = 0; i < activity_c; i++) {
-    Activity *activity = activities[i];
-
-    // Get activity duration
-    double duration = ((double)activity->minutes / 60.0) + activity->hours;
-
-    // Use activity rate if available
-    if (activity->rate.present) {
-      earnings += activity->rate.value * duration;
-    } else {
-      // Otherwise, default to project rate
-      Project *project;
-      FileError error = fs_load_project(activity->project_id, &project);
-      if (error) {
-        printf("Failed to load project with ID %zu (error %d)\n",
-               activity->project_id, error);
-        return BALANCE_EARNINGS_ERROR;
-      }
-
-      earnings += project->default_rate * duration;
-
-      // Don't forget to free the project!
-      error = fs_free_project(project);
-      if (error) {
-        printf("Failed to free project (error %d)\n", error);
-        return BALANCE_EARNINGS_ERROR;
-      }
-    }
-  }
-
-  *earnings_out = earnings;
-
-  return BALANCE_OK;
-}
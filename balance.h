@@ -3,8 +3,10 @@
 
 #include "activity.h"
 #include "menu.h"
+#include "money.h"
 #include "preferences.h"
 #include "project.h"
+#include "rollup.h"
 
 #include <time.h>
 
@@ -14,39 +16,112 @@ typedef enum BalanceError {
   BALANCE_EXPENSES_ERROR,
   /// Something went wrong calculating earnings.
   BALANCE_EARNINGS_ERROR,
+  /// Something went wrong querying activities.
+  BALANCE_QUERY_ERROR,
 } BalanceError;
 
+/// The fixed windows shown in the balance menu, in menu order.
+typedef enum BalanceWindowKind {
+  BALANCE_TODAY = 0,
+  BALANCE_WEEK_SO_FAR,
+  BALANCE_WHOLE_WEEK,
+  BALANCE_MONTH_SO_FAR,
+  BALANCE_WHOLE_MONTH,
+  /// Number of fixed windows.
+  BALANCE_WINDOW_C,
+} BalanceWindowKind;
+
+/// A date range to calculate the balance for, and its results once filled in
+/// by `balance_report_build`.
+typedef struct BalanceWindow {
+  /// Menu prompt
+  char *prompt;
+  /// Shown as "Activities {label}:"
+  const char *label;
+
+  /// Activities logged in `[start, end)` (both local midnights) are counted
+  time_t start;
+  time_t end;
+  /// First and last day shown in the date range
+  time_t first_day;
+  time_t last_day;
+  /// Days of expenses to count
+  unsigned int days;
+
+  /// Activities in the window, sorted by time (borrowed from the report)
+  Activity **activities;
+  size_t activity_c;
+  /// Exact earnings, which in fixed-point mode the totals below are rounded
+  /// from
+  MoneyTicks earnings_ticks;
+  double earnings;
+  double expenses;
+  double balance;
+} BalanceWindow;
+
+/// Every window's balance, calculated together.
+typedef struct BalanceReport {
+  BalanceWindow windows[BALANCE_WINDOW_C];
+  size_t window_c;
+
+  /// Every activity in any window, sorted by time, windows point into this
+  Activity **activities;
+  size_t activity_c;
+} BalanceReport;
+
 /// Data passed to each balance calculation menu item.
 typedef struct BalanceMenuData {
-  /// Projects list (array of Project pointers)
+  /// Header-only projects list (array of Project pointers)
   Project **projects;
   /// Project count
   size_t project_c;
+  /// ID lookup table over `projects`
+  ProjectLookup lookup;
+  /// Daily earnings totals
+  RollupTable rollups;
 
   /// Time of menu opening
   time_t t;
+  /// Fixed windows for `t`, built once when the menu opens
+  BalanceReport report;
 } BalanceMenuData;
 
 /// Menu for calculating the balance for various date ranges.
 MenuError balance_menu(void *_menu_data, void *_item_data);
 
-/// Menu item to show the balance for today.
-MenuError daily_balance(BalanceMenuData *menu_data, void *_item_data);
-/// Menu item to show the balance this month.
-MenuError monthly_balance(BalanceMenuData *menu_data, bool *predict);
-/// Menu item to show the balance this week.
-MenuError weekly_balance(BalanceMenuData *menu_data, bool *predict);
+/// Menu item to show the balance for one window of the report.
+MenuError show_balance(BalanceMenuData *menu_data, BalanceWindow *window);
+/// Menu item to show the balance between two dates entered by the user.
+MenuError custom_balance(BalanceMenuData *menu_data, void *_item_data);
+/// Menu item to break earnings down by project, day, week or month, between
+/// two dates entered by the user.
+MenuError breakdown_balance(BalanceMenuData *menu_data, void *_item_data);
+/// Menu item to rebuild the daily rollups and report any drift.
+MenuError verify_rollups(BalanceMenuData *menu_data, void *_item_data);
+
+/// Sets up the fixed windows (today, this week and this month) around a time.
+void balance_fixed_windows(time_t t,
+                           BalanceWindow windows_out[BALANCE_WINDOW_C]);
+/// Fills in a set of windows (at most `BALANCE_WINDOW_C`) in one pass: a single
+/// query over the range covering all of them, sliced per window, with earnings
+/// from the rollup index. Free with `balance_report_free`.
+BalanceError balance_report_build(Project **projects, size_t project_c,
+                                  const RollupTable *rollups,
+                                  const BalanceWindow *windows,
+                                  size_t window_c, BalanceReport *report_out);
+/// Frees the activity list of a report.
+void balance_report_free(BalanceReport *report);
 
-/// Calculates the balance for a given set of days and activities, returning the
-/// balance, expenses, and earnings for this period.
-BalanceError calc_balance(unsigned int days, Activity **activities,
-                          size_t activity_c, double *balance_out,
-                          double *expenses_out, double *earnings_out);
+/// Calculates the balance for a given set of days, with earnings for the
+/// activities logged on the days `[first_day, end_day)` (see `calendar_day`)
+/// taken from the rollup index. Returns the balance, expenses, and earnings for
+/// this period, calculated in whole pence in fixed-point mode.
+BalanceError calc_balance(unsigned int days, const RollupTable *rollups,
+                          int64_t first_day, int64_t end_day,
+                          double *balance_out, double *expenses_out,
+                          double *earnings_out);
 
 /// Calculates the expenses for a given set of days.
 BalanceError calc_expenses(unsigned int days, double *expenses_out);
-/// Calculates the total earnings for a given set of activities.
-BalanceError calc_earnings(Activity **activities, size_t activity_c,
-                           double *earnings_out);
 
 #endif
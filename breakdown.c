@@ -0,0 +1,138 @@
+#include "breakdown.h"
+
+#include "calendar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/// Starting hash table size.
+#define BREAKDOWN_INITIAL_SLOTS (64)
+
+/// Fibonacci hashing, spreads sequential keys (days, IDs) over the table.
+static size_t slot_for(const Breakdown *breakdown, int64_t key) {
+  uint64_t hash = (uint64_t)key * 0x9e3779b97f4a7c15ull;
+  return (size_t)(hash >> 32) & (breakdown->slot_c - 1);
+}
+
+/// Resizes the hash table, reinserting every group. Groups are given room to
+/// fill half of it.
+static void resize_slots(Breakdown *breakdown, size_t slot_c) {
+  breakdown->groups =
+      realloc(breakdown->groups, sizeof(BreakdownGroup) * (slot_c / 2));
+
+  free(breakdown->slots);
+  breakdown->slots = malloc(sizeof(size_t) * slot_c);
+  breakdown->slot_c = slot_c;
+  memset(breakdown->slots, 0xff, sizeof(size_t) * slot_c);
+
+  for (size_t i = 0; i < breakdown->group_c; i++) {
+    size_t slot = slot_for(breakdown, breakdown->groups[i].key);
+    while (breakdown->slots[slot] != SIZE_MAX) {
+      slot = (slot + 1) & (slot_c - 1);
+    }
+    breakdown->slots[slot] = i;
+  }
+}
+
+/// Finds the group for a key, adding an empty one if there is none yet.
+static BreakdownGroup *find_group(Breakdown *breakdown, int64_t key) {
+  // Linear probing, the table is never more than half full
+  size_t slot = slot_for(breakdown, key);
+  while (breakdown->slots[slot] != SIZE_MAX) {
+    BreakdownGroup *group = breakdown->groups + breakdown->slots[slot];
+    if (group->key == key) {
+      return group;
+    }
+    slot = (slot + 1) & (breakdown->slot_c - 1);
+  }
+
+  size_t index = breakdown->group_c++;
+  breakdown->groups[index] = (BreakdownGroup){.key = key};
+  breakdown->slots[slot] = index;
+
+  // Group pointer is only handed out after resizing, which moves groups
+  if (breakdown->group_c * 2 >= breakdown->slot_c) {
+    resize_slots(breakdown, breakdown->slot_c * 2);
+  }
+
+  return breakdown->groups + index;
+}
+
+/// Key shared by every row for a day, for the date keys.
+static int64_t day_key(BreakdownKey key, int64_t day) {
+  switch (key) {
+  case BREAKDOWN_WEEK:
+    return day - calendar_weekday(day);
+  case BREAKDOWN_MONTH: {
+    int year, month, day_of_month;
+    calendar_civil_from_days(day, &year, &month, &day_of_month);
+    return (int64_t)year * 12 + month - 1;
+  }
+  default:
+    return day;
+  }
+}
+
+void breakdown_build(const RollupTable *rollups, BreakdownKey key,
+                     int64_t first_day, int64_t end_day,
+                     Breakdown *breakdown_out) {
+  Breakdown breakdown = {.key = key};
+  resize_slots(&breakdown, BREAKDOWN_INITIAL_SLOTS);
+
+  // Rows are sorted by day, so each day's key is only worked out once
+  int64_t last_day = first_day - 1, last_day_key = 0;
+  for (size_t i = rollup_lower_bound(rollups, first_day);
+       i < rollups->row_c && rollups->rows[i].day < end_day; i++) {
+    const RollupRow *row = rollups->rows + i;
+    if (key != BREAKDOWN_PROJECT && row->day != last_day) {
+      last_day = row->day;
+      last_day_key = day_key(key, row->day);
+    }
+
+    BreakdownGroup *group = find_group(
+        &breakdown,
+        key == BREAKDOWN_PROJECT ? (int64_t)row->project_id : last_day_key);
+    group->earnings += row->earnings;
+    group->earnings_ticks += row->earnings_ticks;
+    group->minutes += row->minutes;
+    group->activity_c += row->activity_c;
+  }
+
+  *breakdown_out = breakdown;
+}
+
+static int compare_groups(const void *a, const void *b) {
+  int64_t key_a = ((const BreakdownGroup *)a)->key;
+  int64_t key_b = ((const BreakdownGroup *)b)->key;
+  return (key_a > key_b) - (key_a < key_b);
+}
+
+void breakdown_sort(Breakdown *breakdown) {
+  // Sorting moves groups, so the slots would point at the wrong ones
+  free(breakdown->slots);
+  breakdown->slots = NULL;
+  breakdown->slot_c = 0;
+
+  qsort(breakdown->groups, breakdown->group_c, sizeof(BreakdownGroup),
+        compare_groups);
+}
+
+void breakdown_free(Breakdown *breakdown) {
+  free(breakdown->groups);
+  free(breakdown->slots);
+  memset(breakdown, 0, sizeof(Breakdown));
+}
+
+double breakdown_earnings(const BreakdownGroup *group) {
+  if (money_fixed_point()) {
+    return money_to_pounds(money_ticks_to_pence(group->earnings_ticks));
+  }
+  return group->earnings;
+}
+
+double breakdown_average_rate(const BreakdownGroup *group) {
+  if (!group->minutes) {
+    return 0;
+  }
+  return breakdown_earnings(group) * 60 / group->minutes;
+}
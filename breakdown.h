@@ -0,0 +1,59 @@
+#ifndef BREAKDOWN_H_
+#define BREAKDOWN_H_
+
+#include "money.h"
+#include "rollup.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// What a breakdown groups rollup rows by.
+typedef enum BreakdownKey {
+  /// Project ID.
+  BREAKDOWN_PROJECT = 0,
+  /// Day number, see `calendar_day`.
+  BREAKDOWN_DAY,
+  /// Day number of the monday starting the week.
+  BREAKDOWN_WEEK,
+  /// `year * 12 + month - 1`, month being one-based.
+  BREAKDOWN_MONTH,
+} BreakdownKey;
+
+/// Totals for every activity sharing a key.
+typedef struct BreakdownGroup {
+  int64_t key;
+  double earnings;
+  MoneyTicks earnings_ticks;
+  unsigned long minutes;
+  size_t activity_c;
+} BreakdownGroup;
+
+/// Groups, in a hash table keyed by `BreakdownGroup.key`.
+typedef struct Breakdown {
+  BreakdownKey key;
+  /// Groups in the order they were first seen, or by key once sorted.
+  BreakdownGroup *groups;
+  size_t group_c;
+
+  /// Open addressing table of indices into `groups`, `SIZE_MAX` if empty. Its
+  /// size is always a power of two, at least twice the group count.
+  size_t *slots;
+  size_t slot_c;
+} Breakdown;
+
+/// Groups the rollup rows for the days `[first_day, end_day)` in a single walk,
+/// each row being added to its group in (amortised) constant time.
+void breakdown_build(const RollupTable *rollups, BreakdownKey key,
+                     int64_t first_day, int64_t end_day,
+                     Breakdown *breakdown_out);
+/// Sorts the groups by key for display, after which the hash table is gone.
+void breakdown_sort(Breakdown *breakdown);
+/// Frees a breakdown's groups.
+void breakdown_free(Breakdown *breakdown);
+
+/// Earnings of a group, rounded to pence in fixed-point mode.
+double breakdown_earnings(const BreakdownGroup *group);
+/// Average effective hourly rate of a group, 0 if no time was logged.
+double breakdown_average_rate(const BreakdownGroup *group);
+
+#endif
@@ -0,0 +1,134 @@
+#include "calendar.h"
+
+#include <stdlib.h>
+
+/// Seconds in a day without DST changes.
+#define SECONDS_PER_DAY (24 * 60 * 60)
+
+bool calendar_is_leap_year(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int calendar_days_in_month(int year, int month) {
+  static const int DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (month == 2 && calendar_is_leap_year(year)) {
+    return 29;
+  }
+  return DAYS[month - 1];
+}
+
+int64_t calendar_days_from_civil(int year, int month, int day) {
+  // Years start in March here, so that the leap day comes last
+  int64_t shifted_year = (int64_t)year - (month <= 2);
+  int64_t era = (shifted_year >= 0 ? shifted_year : shifted_year - 399) / 400;
+  int64_t year_of_era = shifted_year - era * 400;
+  int64_t day_of_year =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+                       year_of_era / 100 + day_of_year;
+
+  return era * 146097 + day_of_era - 719468;
+}
+
+void calendar_civil_from_days(int64_t days, int *year_out, int *month_out,
+                              int *day_out) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t day_of_era = days - era * 146097;
+  int64_t year_of_era = (day_of_era - day_of_era / 1460 +
+                         day_of_era / 36524 - day_of_era / 146096) /
+                        365;
+  int64_t day_of_year =
+      day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  int64_t month_index = (5 * day_of_year + 2) / 153;
+  int64_t month = month_index < 10 ? month_index + 3 : month_index - 9;
+
+  *year_out = year_of_era + era * 400 + (month <= 2);
+  *month_out = month;
+  *day_out = day_of_year - (153 * month_index + 2) / 5 + 1;
+}
+
+int calendar_weekday(int64_t day) {
+  // 1970/01/01 was a thursday
+  int64_t weekday = (day + 3) % 7;
+  return weekday < 0 ? weekday + 7 : weekday;
+}
+
+int64_t calendar_day(time_t time) {
+  struct tm tm;
+  localtime_r(&time, &tm);
+  return calendar_days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1,
+                                  tm.tm_mday);
+}
+
+time_t calendar_day_start(int64_t day) {
+  int year, month, day_of_month;
+  calendar_civil_from_days(day, &year, &month, &day_of_month);
+  struct tm tm = {
+      .tm_year = year - 1900,
+      .tm_mon = month - 1,
+      .tm_mday = day_of_month,
+      .tm_isdst = -1,
+  };
+  time_t guess = mktime(&tm);
+
+  // Midnight is normally the first second of the day
+  if (calendar_day(guess) == day && calendar_day(guess - 1) < day) {
+    return guess;
+  }
+
+  // Otherwise a DST change has moved it, find the first second on the day
+  time_t low = guess - CALENDAR_DST_WINDOW;
+  time_t high = guess + CALENDAR_DST_WINDOW;
+  while (low < high) {
+    time_t middle = low + (high - low) / 2;
+    if (calendar_day(middle) >= day) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+void calendar_build(time_t start, time_t end, Calendar *calendar_out) {
+  int64_t first_day = calendar_day(start);
+  int64_t last_day = calendar_day(end);
+  size_t day_c = last_day >= first_day ? last_day - first_day + 1 : 0;
+
+  time_t *day_starts = malloc(sizeof(time_t) * (day_c + 1));
+  for (size_t i = 0; i <= day_c; i++) {
+    day_starts[i] = calendar_day_start(first_day + i);
+  }
+
+  calendar_out->first_day = first_day;
+  calendar_out->day_starts = day_starts;
+  calendar_out->day_c = day_c;
+}
+
+int64_t calendar_lookup(const Calendar *calendar, time_t time) {
+  if (!calendar->day_c || time < calendar->day_starts[0] ||
+      time >= calendar->day_starts[calendar->day_c]) {
+    return calendar_day(time);
+  }
+
+  // Days are a fixed length apart give or take DST, so guess and then adjust
+  size_t index = (time - calendar->day_starts[0]) / SECONDS_PER_DAY;
+  if (index >= calendar->day_c) {
+    index = calendar->day_c - 1;
+  }
+  while (time < calendar->day_starts[index]) {
+    index--;
+  }
+  while (time >= calendar->day_starts[index + 1]) {
+    index++;
+  }
+
+  return calendar->first_day + index;
+}
+
+void calendar_free(Calendar *calendar) {
+  free(calendar->day_starts);
+  calendar->day_starts = NULL;
+  calendar->day_c = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef CALENDAR_H_
+#define CALENDAR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// Seconds either side of midnight searched when a DST change moves the start
+/// of a day, more than any real-world shift.
+#define CALENDAR_DST_WINDOW (3 * 60 * 60)
+
+/// Local day boundaries over a range of time, so that bucketing timestamps by
+/// day needs no `localtime_r` calls.
+typedef struct Calendar {
+  /// Day number (see `calendar_day`) of the first day covered.
+  int64_t first_day;
+  /// Start of each day covered, followed by the end of the last one.
+  time_t *day_starts;
+  /// Days covered, `day_starts` holds one more entry than this.
+  size_t day_c;
+} Calendar;
+
+/// Is this (civil) year a leap year?
+bool calendar_is_leap_year(int year);
+/// Number of days in a month (1-12).
+int calendar_days_in_month(int year, int month);
+/// Converts a civil date (month and day 1-based) to days since 1970/01/01.
+int64_t calendar_days_from_civil(int year, int month, int day);
+/// Converts days since 1970/01/01 back to a civil date (month and day
+/// 1-based).
+void calendar_civil_from_days(int64_t days, int *year_out, int *month_out,
+                              int *day_out);
+/// Day of the week, 0 being monday.
+int calendar_weekday(int64_t day);
+
+/// Local calendar day of a timestamp, as days since 1970/01/01.
+int64_t calendar_day(time_t time);
+/// First second of a local calendar day. Usually midnight, but DST changes can
+/// skip or repeat it.
+time_t calendar_day_start(int64_t day);
+
+/// Precomputes the local day boundaries covering `[start, end]`.
+void calendar_build(time_t start, time_t end, Calendar *calendar_out);
+/// Local calendar day of a timestamp, from the table if it is in range.
+int64_t calendar_lookup(const Calendar *calendar, time_t time);
+/// Frees a calendar's table.
+void calendar_free(Calendar *calendar);
+
+#endif
@@ -0,0 +1,496 @@
+#include "cli.h"
+
+#include "activity.h"
+#include "balance.h"
+#include "calendar.h"
+#include "error.h"
+#include "filesystem.h"
+#include "input.h"
+#include "project_index.h"
+#include "rollup.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// Longest import line accepted, a full description plus every other field.
+#define IMPORT_LINE_SIZE (512)
+
+/// State shared by every command in one invocation.
+typedef struct CliBatch {
+  /// Activities logged or imported but not yet written.
+  Activity *queued;
+  size_t queued_c;
+  size_t capacity;
+
+  /// Loaded on first use, to check projects and look up default rates.
+  ProjectIndex index;
+  bool index_loaded;
+
+  /// Time the invocation started, the default time of logged activities.
+  time_t t;
+
+  /// Where `import -` reads from, and output and errors are written to.
+  FILE *in;
+  FILE *out;
+  FILE *err;
+} CliBatch;
+
+typedef CliError (*CliCommandFn)(CliBatch *batch, int argc, char **argv);
+
+/// A subcommand, `argv` being everything after its name.
+typedef struct CliCommand {
+  const char *name;
+  const char *usage;
+  CliCommandFn function;
+} CliCommand;
+
+static CliError log_command(CliBatch *batch, int argc, char **argv);
+static CliError import_command(CliBatch *batch, int argc, char **argv);
+static CliError balance_command(CliBatch *batch, int argc, char **argv);
+static CliError list_command(CliBatch *batch, int argc, char **_argv);
+static CliError help_command(CliBatch *batch, int _argc, char **_argv);
+
+static const CliCommand COMMANDS[] = {
+    {"log",
+     "log --project ID --duration HH:MM|MMM --desc TEXT [--rate RATE] "
+     "[--time UNIX_TIME]",
+     log_command},
+    {"import",
+     "import FILE|-  (lines: ID<tab>DURATION<tab>DESCRIPTION[<tab>RATE"
+     "[<tab>UNIX_TIME]])",
+     import_command},
+    {"balance", "balance [--from YYYY/MM/DD] [--to YYYY/MM/DD]",
+     balance_command},
+    {"list", "list", list_command},
+    {"help", "help", help_command},
+};
+#define COMMAND_C (sizeof(COMMANDS) / sizeof(CliCommand))
+
+static CliError help_command(CliBatch *batch, int _argc, char **_argv) {
+  fprintf(batch->out,
+          "Usage: freeman [COMMAND [ARGS...] [" CLI_SEPARATOR
+          " COMMAND [ARGS...]]...]\n"
+          "Without a command, opens the interactive menu.\n\nCommands:\n");
+  for (size_t i = 0; i < COMMAND_C; i++) {
+    fprintf(batch->out, "  %s\n", COMMANDS[i].usage);
+  }
+  fprintf(batch->out, "  serve  (answer commands from a resident process)\n");
+  fprintf(batch->out,
+          "\nLogged and imported activities are saved once every command has "
+          "run,\nor before a balance or list. If a command fails, activities "
+          "saved before\nit are kept and the rest are dropped.\n");
+
+  return CLI_OK;
+}
+
+/// Finds the value following an option, NULL if the option is not given.
+/// Options without a value, or not in `options`, are usage errors.
+static CliError get_options(CliBatch *batch, int argc, char **argv,
+                            const char **options, const char **values_out,
+                            size_t option_c) {
+  memset(values_out, 0, sizeof(char *) * option_c);
+
+  for (int i = 0; i < argc; i += 2) {
+    size_t option = 0;
+    while (option < option_c && strcmp(argv[i], options[option])) {
+      option++;
+    }
+
+    if (option == option_c) {
+      fprintf(batch->err, "Unknown option `%s`\n", argv[i]);
+      return CLI_USAGE_ERROR;
+    }
+    if (i + 1 >= argc) {
+      fprintf(batch->err, "Option `%s` needs a value\n", argv[i]);
+      return CLI_USAGE_ERROR;
+    }
+
+    values_out[option] = argv[i + 1];
+  }
+
+  return CLI_OK;
+}
+
+static CliError load_index(CliBatch *batch) {
+  if (batch->index_loaded) {
+    return CLI_OK;
+  }
+
+  FileError error = fs_get_project_index(&batch->index);
+  if (error) {
+    fprintf(batch->err, "Failed to read project index (FileError %d)\n", error);
+    return CLI_FILE_ERROR;
+  }
+  batch->index_loaded = true;
+
+  return CLI_OK;
+}
+
+/// Builds an activity from its fields as strings (rate and time optional), and
+/// queues it to be written.
+static CliError queue_activity(CliBatch *batch, const char *project,
+                               const char *duration, const char *description,
+                               const char *rate, const char *logged_at) {
+  Activity activity = {.time = (unsigned long)batch->t};
+
+  if (!project || validate_int_string(project) || *project == '-') {
+    fprintf(batch->err, "Invalid project ID `%s`\n", project ? project : "");
+    return CLI_USAGE_ERROR;
+  }
+  activity.project_id = strtoul(project, NULL, 10);
+
+  PROPAGATE(CliError, load_index, (batch));
+  ProjectIndexEntry *entry =
+      project_index_find(&batch->index, activity.project_id);
+  if (!entry) {
+    fprintf(batch->err, "No project with ID %zu\n", activity.project_id);
+    return CLI_USAGE_ERROR;
+  }
+
+  char duration_buffer[INPUT_BUFFER_SIZE];
+  if (!duration || strlen(duration) >= sizeof(duration_buffer)) {
+    fprintf(batch->err, "Invalid duration `%s`\n", duration ? duration : "");
+    return CLI_USAGE_ERROR;
+  }
+  strcpy(duration_buffer, duration);
+  if (*duration == '-' ||
+      parse_duration(duration_buffer, &activity.hours, &activity.minutes) ||
+      !(activity.hours || activity.minutes)) {
+    fprintf(batch->err, "Invalid duration `%s`\n", duration);
+    return CLI_USAGE_ERROR;
+  }
+
+  if (!description || !*description ||
+      strlen(description) >= sizeof(activity.description)) {
+    fprintf(batch->err, "Description must be 1 to %zu characters\n",
+            sizeof(activity.description) - 1);
+    return CLI_USAGE_ERROR;
+  }
+  strcpy(activity.description, description);
+
+  // Logged activities carry their rate, the project's default if not given
+  activity.rate.present = true;
+  activity.rate.value = entry->default_rate;
+  if (rate && *rate) {
+    if (validate_float_string(rate)) {
+      fprintf(batch->err, "Invalid rate `%s`\n", rate);
+      return CLI_USAGE_ERROR;
+    }
+    activity.rate.value = atof(rate);
+  }
+
+  if (logged_at && *logged_at) {
+    if (validate_int_string(logged_at) || *logged_at == '-') {
+      fprintf(batch->err, "Invalid time `%s`\n", logged_at);
+      return CLI_USAGE_ERROR;
+    }
+    activity.time = strtoul(logged_at, NULL, 10);
+  }
+
+  if (batch->queued_c == batch->capacity) {
+    batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+    batch->queued = realloc(batch->queued, sizeof(Activity) * batch->capacity);
+  }
+  batch->queued[batch->queued_c++] = activity;
+
+  return CLI_OK;
+}
+
+/// Orders queued activities by project, then by time.
+static int compare_queued(const void *a, const void *b) {
+  const Activity *activity_a = a, *activity_b = b;
+  if (activity_a->project_id != activity_b->project_id) {
+    return activity_a->project_id < activity_b->project_id ? -1 : 1;
+  }
+  return (activity_a->time > activity_b->time) -
+         (activity_a->time < activity_b->time);
+}
+
+/// Writes every queued activity, once per project.
+static CliError flush_queue(CliBatch *batch) {
+  if (!batch->queued_c) {
+    return CLI_OK;
+  }
+
+  qsort(batch->queued, batch->queued_c, sizeof(Activity), compare_queued);
+
+  // Projects deleted since they were checked fail the whole batch before
+  // anything is written
+  if (batch->index_loaded) {
+    project_index_free(&batch->index);
+    batch->index_loaded = false;
+  }
+  PROPAGATE(CliError, load_index, (batch));
+  for (size_t i = 0; i < batch->queued_c; i++) {
+    ProjectId id = batch->queued[i].project_id;
+    if ((!i || id != batch->queued[i - 1].project_id) &&
+        !project_index_find(&batch->index, id)) {
+      fprintf(batch->err, "No project with ID %zu, nothing was saved\n", id);
+      return CLI_USAGE_ERROR;
+    }
+  }
+
+  size_t first = 0;
+  while (first < batch->queued_c) {
+    ProjectId id = batch->queued[first].project_id;
+    size_t last = first;
+    while (last < batch->queued_c && batch->queued[last].project_id == id) {
+      last++;
+    }
+
+    // A single activity only needs a journal record, more are cheaper as one
+    // rewrite of the project file
+    FileError error =
+        last - first == 1
+            ? fs_append_activity(batch->queued + first)
+            : fs_append_activities(id, batch->queued + first, last - first);
+    if (error) {
+      // Projects are written one at a time, those reported above are saved
+      fprintf(batch->err,
+              "Failed to save activities to project %zu (error %d), %zu of "
+              "%zu activities were not saved\n",
+              id, error, batch->queued_c - first, batch->queued_c);
+      if (first) {
+        fprintf(batch->err, "The %zu activities logged above were saved\n",
+                first);
+      }
+      return CLI_FILE_ERROR;
+    }
+
+    ProjectIndexEntry *entry = project_index_find(&batch->index, id);
+    fprintf(batch->out, "Logged %zu %s to %s (ID %zu)\n", last - first,
+            last - first == 1 ? "activity" : "activities",
+            entry ? entry->name : "project", id);
+    first = last;
+  }
+
+  batch->queued_c = 0;
+  return CLI_OK;
+}
+
+static CliError log_command(CliBatch *batch, int argc, char **argv) {
+  static const char *OPTIONS[] = {"--project", "--duration", "--desc",
+                                  "--rate", "--time"};
+  const char *values[5];
+  PROPAGATE(CliError, get_options,
+            (batch, argc, argv, OPTIONS, values, 5));
+
+  return queue_activity(batch, values[0], values[1], values[2], values[3],
+                        values[4]);
+}
+
+static CliError import_command(CliBatch *batch, int argc, char **argv) {
+  if (argc != 1) {
+    fprintf(batch->err, "Usage: %s\n", COMMANDS[1].usage);
+    return CLI_USAGE_ERROR;
+  }
+
+  bool from_stdin = !strcmp(argv[0], "-");
+  FILE *file = from_stdin ? batch->in : fopen(argv[0], "r");
+  if (!file) {
+    fprintf(batch->err, "Failed to open `%s`\n", argv[0]);
+    return CLI_IMPORT_ERROR;
+  }
+
+  char line[IMPORT_LINE_SIZE];
+  size_t line_number = 0;
+  CliError error = CLI_OK;
+  while (!error && fgets(line, sizeof(line), file)) {
+    line_number++;
+
+    size_t length = strcspn(line, "\r\n");
+    if (!line[length] && !feof(file)) {
+      fprintf(batch->err, "%s:%zu: Line too long\n", argv[0], line_number);
+      error = CLI_IMPORT_ERROR;
+      break;
+    }
+    line[length] = '\0';
+
+    // Blank lines and comments are skipped
+    if (!*line || *line == '#') {
+      continue;
+    }
+
+    char *rest = line;
+    char *fields[5] = {0};
+    for (int i = 0; i < 5 && rest; i++) {
+      fields[i] = strsep(&rest, "\t");
+    }
+    if (rest || !fields[2]) {
+      fprintf(batch->err, "%s:%zu: Expected 3 to 5 tab separated fields\n",
+              argv[0], line_number);
+      error = CLI_IMPORT_ERROR;
+      break;
+    }
+
+    error = queue_activity(batch, fields[0], fields[1], fields[2], fields[3],
+                           fields[4]);
+    if (error) {
+      fprintf(batch->err, "%s:%zu: Invalid activity\n", argv[0], line_number);
+    }
+  }
+
+  if (!error && ferror(file)) {
+    fprintf(batch->err, "Failed to read `%s`\n", argv[0]);
+    error = CLI_IMPORT_ERROR;
+  }
+  if (!from_stdin) {
+    fclose(file);
+  }
+
+  return error;
+}
+
+/// Gets the rollup table, kept loaded between invocations in the same process
+/// (see `server.h`) until the rollup file changes.
+static CliError get_rollups(CliBatch *batch, const RollupTable **rollups_out) {
+  static struct {
+    bool loaded;
+    RollupTable table;
+  } resident;
+
+  if (!resident.loaded || !rollup_is_current(&resident.table)) {
+    if (resident.loaded) {
+      rollup_free(&resident.table);
+      resident.loaded = false;
+    }
+
+    RollupError error = rollup_load(&resident.table);
+    if (error) {
+      fprintf(batch->err, "Failed to load rollups (error %d)\n", error);
+      return CLI_BALANCE_ERROR;
+    }
+    resident.loaded = true;
+  }
+
+  *rollups_out = &resident.table;
+  return CLI_OK;
+}
+
+static CliError balance_command(CliBatch *batch, int argc, char **argv) {
+  static const char *OPTIONS[] = {"--from", "--to"};
+  const char *values[2];
+  PROPAGATE(CliError, get_options,
+            (batch, argc, argv, OPTIONS, values, 2));
+
+  // Days default to today, either end can be given alone
+  time_t dates[2];
+  for (int i = 0; i < 2; i++) {
+    dates[i] = calendar_day_start(calendar_day(batch->t));
+    char buffer[INPUT_BUFFER_SIZE];
+    if (!values[i]) {
+      continue;
+    }
+    if (strlen(values[i]) >= sizeof(buffer) ||
+        parse_date(strcpy(buffer, values[i]), dates + i)) {
+      fprintf(batch->err, "Invalid date `%s`, expected YYYY/MM/DD\n",
+              values[i]);
+      return CLI_USAGE_ERROR;
+    }
+  }
+  int64_t first_day = calendar_day(dates[0]);
+  int64_t last_day = calendar_day(dates[1]);
+  if (last_day < first_day) {
+    fprintf(batch->err, "End date is before start date\n");
+    return CLI_USAGE_ERROR;
+  }
+
+  // Anything logged earlier in this invocation counts
+  PROPAGATE(CliError, flush_queue, (batch));
+
+  const RollupTable *rollups;
+  PROPAGATE(CliError, get_rollups, (batch, &rollups));
+
+  double balance, expenses, earnings;
+  BalanceError error =
+      calc_balance(last_day - first_day + 1, rollups, first_day, last_day + 1,
+                   &balance, &expenses, &earnings);
+  if (error) {
+    fprintf(batch->err, "Failed to calculate balance (error %d)\n", error);
+    return CLI_BALANCE_ERROR;
+  }
+
+  int year, month, day;
+  calendar_civil_from_days(first_day, &year, &month, &day);
+  fprintf(batch->out, "%.4d/%.2d/%.2d", year, month, day);
+  if (last_day != first_day) {
+    calendar_civil_from_days(last_day, &year, &month, &day);
+    fprintf(batch->out, "-%.4d/%.2d/%.2d", year, month, day);
+  }
+  fprintf(batch->out,
+          " | Earnings: +£%.2f | Expenses: -£%.2f | Balance: %s£%.2f\n",
+          earnings, expenses, balance >= 0 ? "+" : "-",
+          balance >= 0 ? balance : -balance);
+
+  return CLI_OK;
+}
+
+static CliError list_command(CliBatch *batch, int argc, char **_argv) {
+  if (argc) {
+    fprintf(batch->err, "Usage: list\n");
+    return CLI_USAGE_ERROR;
+  }
+
+  // Counts include anything logged earlier in this invocation
+  PROPAGATE(CliError, flush_queue, (batch));
+
+  // Always read fresh, writes change activity counts
+  if (batch->index_loaded) {
+    project_index_free(&batch->index);
+    batch->index_loaded = false;
+  }
+  PROPAGATE(CliError, load_index, (batch));
+
+  for (size_t i = 0; i < batch->index.entry_c; i++) {
+    const ProjectIndexEntry *entry = batch->index.entries + i;
+    fprintf(batch->out,
+            "%zu | %s | Default rate: £%.2f/hour | Activities: %zu\n",
+            entry->id, entry->name, entry->default_rate, entry->activity_c);
+  }
+
+  return CLI_OK;
+}
+
+CliError cli_run(int argc, char **argv, FILE *in, FILE *out, FILE *err) {
+  CliBatch batch = {.t = time(NULL), .in = in, .out = out, .err = err};
+  CliError error = CLI_OK;
+
+  // Each command runs up to the next separator
+  int start = 0;
+  while (!error && start < argc) {
+    int end = start;
+    while (end < argc && strcmp(argv[end], CLI_SEPARATOR)) {
+      end++;
+    }
+
+    size_t command = 0;
+    while (command < COMMAND_C && strcmp(argv[start], COMMANDS[command].name)) {
+      command++;
+    }
+    if (command == COMMAND_C) {
+      fprintf(err, "Unknown command `%s`, see `freeman help`\n", argv[start]);
+      error = CLI_USAGE_ERROR;
+      break;
+    }
+
+    error = COMMANDS[command].function(&batch, end - start - 1,
+                                       argv + start + 1);
+    start = end + 1;
+  }
+
+  // Whatever is still queued is only written if every command succeeded, a
+  // `balance` or `list` has already written what was queued before it
+  if (!error) {
+    error = flush_queue(&batch);
+  }
+
+  free(batch.queued);
+  if (batch.index_loaded) {
+    project_index_free(&batch.index);
+  }
+
+  return error;
+}
@@ -0,0 +1,33 @@
+#ifndef CLI_H_
+#define CLI_H_
+
+#include <stdio.h>
+
+/// Separates commands run in one invocation, e.g.
+/// `freeman log ... + log ... + balance`.
+#define CLI_SEPARATOR "+"
+
+typedef enum CliError {
+  CLI_OK = 0,
+  /// Unknown command, missing or invalid argument.
+  CLI_USAGE_ERROR,
+  /// Something went wrong reading or writing project files.
+  CLI_FILE_ERROR,
+  /// Something went wrong reading an import file.
+  CLI_IMPORT_ERROR,
+  /// Something went wrong calculating a balance.
+  CLI_BALANCE_ERROR,
+} CliError;
+
+/// Runs commands given on the command line (without the program name), without
+/// any menus. Logged and imported activities are queued and written once per
+/// project, before a balance or list and when every command has run. A batch
+/// is therefore only all-or-nothing up to its first balance or list: if a
+/// command fails, or a queued project no longer exists, nothing still queued is
+/// written, but anything written before is kept. Should writing one project
+/// fail, those already written are reported.
+///
+/// `import -` reads from `in`, output goes to `out` and errors to `err`.
+CliError cli_run(int argc, char **argv, FILE *in, FILE *out, FILE *err);
+
+#endif
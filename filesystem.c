@@ -1,13 +1,24 @@
 #include "filesystem.h"
 
+#include "arena.h"
 #include "error.h"
+#include "journal.h"
 #include "preferences.h"
+#include "project_yaml.h"
+#include "rollup.h"
+#include "snapshot.h"
 
 #include <cyaml/cyaml.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -27,6 +38,16 @@ FileError fs_expand_from_home(const char *path, char *path_out) {
   return FILE_OK;
 }
 
+FileError fs_get_temp_path(const char *path, char *path_out) {
+  int length =
+      snprintf(path_out, sizeof(Filepath), "%s.%d.tmp", path, getpid());
+  if (length < 0 || length >= (int)sizeof(Filepath)) {
+    return FILE_PATH_ERROR;
+  }
+
+  return FILE_OK;
+}
+
 FileError fs_ensure(void) {
   // Check config directory
   Filepath config_dir;
@@ -67,6 +88,14 @@ static const cyaml_config_t CYAML_CONFIG = {
     .log_level = CYAML_LOG_WARNING,
 };
 
+/// CYAML config allocating everything it loads from an arena.
+static cyaml_config_t arena_config(Arena *arena) {
+  cyaml_config_t config = CYAML_CONFIG;
+  config.mem_fn = arena_cyaml_mem;
+  config.mem_ctx = arena;
+  return config;
+}
+
 // Preferences YAML schema, generated with X macro tables
 static const cyaml_schema_field_t PREFERENCES_MAPPING_SCHEMA[] = {
 // Everything is a double which makes this easy
@@ -81,6 +110,71 @@ static const cyaml_schema_value_t PREFERENCES_SCHEMA = {
                         PREFERENCES_MAPPING_SCHEMA),
 };
 
+/// Preferences as last read or written, with the file's identity at the time.
+/// Reused until the file is replaced or modified behind our back.
+static struct {
+  bool valid;
+  Preferences preferences;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec mtime;
+} preferences_cache;
+
+/// Records the preferences file's identity (`stat` taken before it was read)
+/// alongside its contents.
+static void cache_preferences(const struct stat *st,
+                              const Preferences *preferences) {
+  preferences_cache.valid = true;
+  preferences_cache.preferences = *preferences;
+  preferences_cache.device = st->st_dev;
+  preferences_cache.inode = st->st_ino;
+  preferences_cache.size = st->st_size;
+  preferences_cache.mtime = st->st_mtim;
+}
+
+/// Is the cached copy still what the preferences file holds?
+static bool preferences_cache_current(const struct stat *st) {
+  return preferences_cache.valid && st->st_dev == preferences_cache.device &&
+         st->st_ino == preferences_cache.inode &&
+         st->st_size == preferences_cache.size &&
+         st->st_mtim.tv_sec == preferences_cache.mtime.tv_sec &&
+         st->st_mtim.tv_nsec == preferences_cache.mtime.tv_nsec;
+}
+
+/// Changes to the preferences seen so far, and the file's identity when last
+/// polled, see `fs_preferences_changes`.
+static struct {
+  unsigned long change_c;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec mtime;
+} preferences_changes;
+
+unsigned long fs_preferences_changes(void) {
+  Filepath preferences_file;
+  struct stat st = {0};
+  if (fs_expand_from_home(PREFERENCES_FILE, preferences_file) ||
+      stat(preferences_file, &st)) {
+    memset(&st, 0, sizeof(st));
+  }
+
+  if (st.st_dev != preferences_changes.device ||
+      st.st_ino != preferences_changes.inode ||
+      st.st_size != preferences_changes.size ||
+      st.st_mtim.tv_sec != preferences_changes.mtime.tv_sec ||
+      st.st_mtim.tv_nsec != preferences_changes.mtime.tv_nsec) {
+    preferences_changes.device = st.st_dev;
+    preferences_changes.inode = st.st_ino;
+    preferences_changes.size = st.st_size;
+    preferences_changes.mtime = st.st_mtim;
+    preferences_changes.change_c++;
+  }
+
+  return preferences_changes.change_c;
+}
+
 FileError fs_init_preferences(void) {
   Filepath preferences_file;
   PROPAGATE(FileError, fs_expand_from_home,
@@ -106,9 +200,20 @@ FileError fs_set_preferences(Preferences preferences) {
   cyaml_err_t error = cyaml_save_file(preferences_file, &CYAML_CONFIG,
                                       &PREFERENCES_SCHEMA, &preferences, 0);
   if (error) {
+    preferences_cache.valid = false;
     return FILE_CYAML_SAVE_ERROR;
   }
 
+  // Counted even if the file's stamp looks the same
+  preferences_changes.change_c++;
+
+  // Write through, so the next read does not parse what was just written
+  struct stat st;
+  preferences_cache.valid = !stat(preferences_file, &st);
+  if (preferences_cache.valid) {
+    cache_preferences(&st, &preferences);
+  }
+
   return FILE_OK;
 }
 
@@ -117,6 +222,15 @@ FileError fs_get_preferences(Preferences *preferences_out) {
   PROPAGATE(FileError, fs_expand_from_home,
             (PREFERENCES_FILE, preferences_file));
 
+  // Only parse the file if it has changed since it was last read or written.
+  // Stamped before reading, so a write racing the read is seen next time.
+  struct stat st;
+  bool stamped = !stat(preferences_file, &st);
+  if (stamped && preferences_cache_current(&st)) {
+    *preferences_out = preferences_cache.preferences;
+    return FILE_OK;
+  }
+
   // Load preferences file (cyaml allocated)
   Preferences *loaded_preferences;
   cyaml_err_t error =
@@ -128,6 +242,9 @@ FileError fs_get_preferences(Preferences *preferences_out) {
 
   // Copy cyaml allocated preferences to caller-owned struct
   memcpy(preferences_out, loaded_preferences, sizeof(Preferences));
+  if (stamped) {
+    cache_preferences(&st, preferences_out);
+  }
 
   // Free cyaml allocated preferences
   error = cyaml_free(&CYAML_CONFIG, &PREFERENCES_SCHEMA, loaded_preferences, 0);
@@ -172,23 +289,163 @@ static const cyaml_schema_field_t PROJECT_MAPPING_SCHEMA[] = {
     CYAML_FIELD_SEQUENCE_COUNT("activities", CYAML_FLAG_POINTER_NULL, Project,
                                activities, activity_c, &ACTIVITY_VALUE_SCHEMA,
                                0, CYAML_UNLIMITED),
+    // Optional so that projects saved before journalling still load
+    CYAML_FIELD_UINT("journal_seq", CYAML_FLAG_OPTIONAL, Project, journal_seq),
+    // Likewise for projects saved before versioning
+    CYAML_FIELD_UINT("version", CYAML_FLAG_OPTIONAL, Project, version),
     CYAML_FIELD_END,
 };
 static const cyaml_schema_value_t PROJECT_VALUE_SCHEMA = {
     CYAML_VALUE_MAPPING(CYAML_FLAG_POINTER, Project, PROJECT_MAPPING_SCHEMA),
 };
 
+FileError fs_cyaml_load_project(const char *path, Arena *arena,
+                                Project **project_out) {
+  cyaml_config_t config = arena_config(arena);
+  cyaml_err_t error = cyaml_load_file(path, &config, &PROJECT_VALUE_SCHEMA,
+                                      (void **)project_out, 0);
+  return error ? FILE_CYAML_LOAD_ERROR : FILE_OK;
+}
+
+FileError fs_cyaml_save_project(const Project *project, const char *path) {
+  cyaml_err_t error = cyaml_save_file(path, &CYAML_CONFIG,
+                                      &PROJECT_VALUE_SCHEMA, project, 0);
+  return error ? FILE_CYAML_SAVE_ERROR : FILE_OK;
+}
+
 FileError fs_get_project_path(unsigned long id, char *path_out) {
-  PROPAGATE(FileError, fs_expand_from_home, (PROJECTS_DIRECTORY, path_out));
+  return fs_get_project_file(id, "yaml", path_out);
+}
+
+FileError fs_get_project_file(ProjectId id, const char *extension,
+                              char *path_out) {
+  Filepath project_dir;
+  PROPAGATE(FileError, fs_expand_from_home, (PROJECTS_DIRECTORY, project_dir));
 
-  // {project_dir}/{id}.yaml
-  if (!sprintf(path_out, "%s/%zu.yaml", path_out, id)) {
+  // {project_dir}/{id}.{extension}
+  if (!sprintf(path_out, "%s/%zu.%s", project_dir, id, extension)) {
     return FILE_PATH_ERROR;
   }
 
   return FILE_OK;
 }
 
+bool fs_parse_project_filename(const char *name, ProjectId *id_out) {
+  // Filename stem is the project ID, journals and temporary files stored
+  // alongside have other extensions
+  char *stem_end;
+  ProjectId id = strtoul(name, &stem_end, 10);
+  if (stem_end == name || strcmp(stem_end, ".yaml")) {
+    return false;
+  }
+
+  *id_out = id;
+  return true;
+}
+
+/// Takes an advisory lock on a lock file, creating it if need be. `operation`
+/// is passed to `flock`, with `LOCK_NB` a held lock gives `FILE_LOCK_ERROR`.
+/// Locks are per open file, so a process holding one cannot take it again.
+/// Release with `fs_unlock`.
+static FileError lock_file(const char *path, int operation, int *fd_out) {
+  // Read-only, closing a file opened for writing would wake `project_cache`
+  int fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, DEFAULT_PERMISSIONS);
+  if (fd < 0) {
+    return FILE_LOCK_ERROR;
+  }
+
+  int locked;
+  do {
+    locked = flock(fd, operation);
+  } while (locked && errno == EINTR);
+  if (locked) {
+    close(fd);
+    return FILE_LOCK_ERROR;
+  }
+
+  *fd_out = fd;
+  return FILE_OK;
+}
+
+void fs_unlock(int fd) { close(fd); }
+
+/// Locks a project's files, waiting for the lock unless `wait` is false. Always
+/// taken before the index lock.
+static FileError lock_project(ProjectId id, bool wait, int *fd_out) {
+  Filepath lock_path;
+  PROPAGATE(FileError, fs_get_project_file, (id, LOCK_EXTENSION, lock_path));
+  return lock_file(lock_path, wait ? LOCK_EX : LOCK_EX | LOCK_NB, fd_out);
+}
+
+FileError fs_lock_index(bool exclusive, int *fd_out) {
+  Filepath lock_path;
+  PROPAGATE(FileError, fs_expand_from_home, (INDEX_LOCK_FILE, lock_path));
+  return lock_file(lock_path, exclusive ? LOCK_EX : LOCK_SH, fd_out);
+}
+
+/// Checks if a project has a project file, it may have been deleted while
+/// waiting for its lock.
+static bool project_exists(ProjectId id) {
+  Filepath project_path;
+  return !fs_get_project_path(id, project_path) && !access(project_path, F_OK);
+}
+
+static FileError load_project(ProjectId id, Arena *arena,
+                              Project **project_out);
+static bool snapshot_is_current(ProjectId id);
+
+/// Number of threads used to load project lists, 0 meaning one per core.
+static unsigned int load_thread_c = 0;
+
+void fs_set_load_threads(unsigned int thread_c) { load_thread_c = thread_c; }
+
+/// Work shared between project loading threads.
+typedef struct ProjectLoadJob {
+  /// IDs to load, sorted.
+  const ProjectId *ids;
+  size_t id_c;
+  /// Index of the next ID to be claimed by a worker.
+  size_t next;
+
+  /// Loaded project per ID, NULL if loading failed.
+  Project **projects;
+  /// Load error per ID.
+  FileError *errors;
+} ProjectLoadJob;
+
+/// A single loading thread's view of the job.
+typedef struct ProjectLoadWorker {
+  ProjectLoadJob *job;
+  /// Arena the worker loads into, merged into the list's arena afterwards.
+  Arena *arena;
+} ProjectLoadWorker;
+
+/// Worker loop, claims IDs until there are none left. Each slot is only ever
+/// written by the thread that claimed it.
+static void *load_projects_worker(void *_worker) {
+  ProjectLoadWorker *worker = _worker;
+  ProjectLoadJob *job = worker->job;
+
+  while (true) {
+    size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (i >= job->id_c) {
+      break;
+    }
+
+    job->projects[i] = NULL;
+    job->errors[i] =
+        load_project(job->ids[i], worker->arena, job->projects + i);
+  }
+
+  return NULL;
+}
+
+static int compare_ids(const void *a, const void *b) {
+  ProjectId id_a = *(const ProjectId *)a;
+  ProjectId id_b = *(const ProjectId *)b;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
 FileError fs_get_project_list(Project ***projects_out, size_t *project_c_out) {
   Filepath project_dir;
   PROPAGATE(FileError, fs_expand_from_home, (PROJECTS_DIRECTORY, project_dir));
@@ -199,39 +456,109 @@ FileError fs_get_project_list(Project ***projects_out, size_t *project_c_out) {
     return FILE_DIRECTORY_ERROR;
   }
 
-  // Init projects array
-  Project **projects = NULL;
-  size_t project_c = 0;
+  // Collect project IDs first, loading happens afterwards
+  ProjectId *ids = NULL;
+  size_t id_c = 0, id_capacity = 0;
 
   // Iterate over each entry in projects directory
   struct dirent *entry;
-  Filepath project_path;
   while ((entry = readdir(directory))) {
-    if (entry->d_type == DT_REG) { // Only look for normal files
-      // Get absolute path
-      sprintf(project_path, "%s/%s", project_dir, entry->d_name);
-
-      // Resize array
-      project_c++;
-      projects = realloc(projects, sizeof(Project *) * project_c);
-
-      // Load Project
-      cyaml_err_t error =
-          cyaml_load_file(project_path, &CYAML_CONFIG, &PROJECT_VALUE_SCHEMA,
-                          (void **)projects + project_c - 1, NULL);
-      if (error) {
-        project_c--; // Don't necessarily have to reallocate as long as the
-                     // counter is kept up-to-date
-        printf("Failed to load project %s (error %d)\n", project_path, error);
+    // Only look for normal project files
+    ProjectId id;
+    if (entry->d_type == DT_REG &&
+        fs_parse_project_filename(entry->d_name, &id)) {
+      // Resize array geometrically
+      if (id_c == id_capacity) {
+        id_capacity = id_capacity ? id_capacity * 2 : 16;
+        ids = realloc(ids, sizeof(ProjectId) * id_capacity);
       }
+      ids[id_c++] = id;
     }
   }
 
   // Close directory
   if (closedir(directory)) {
+    free(ids);
     return FILE_DIRECTORY_ERROR;
   }
 
+  // Stable order regardless of directory order or thread scheduling
+  qsort(ids, id_c, sizeof(ProjectId), compare_ids);
+
+  ProjectLoadJob job = {
+      .ids = ids,
+      .id_c = id_c,
+      .next = 0,
+      .projects = calloc(id_c ? id_c : 1, sizeof(Project *)),
+      .errors = calloc(id_c ? id_c : 1, sizeof(FileError)),
+  };
+
+  // One thread per core by default, never more threads than projects
+  long thread_c = load_thread_c;
+  if (!thread_c) {
+    thread_c = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (thread_c > 0 && (size_t)thread_c > id_c) {
+    thread_c = id_c;
+  }
+
+  if (thread_c < 1) {
+    thread_c = 1;
+  }
+
+  // Every worker gets its own arena, so allocation needs no locking
+  ProjectLoadWorker *workers = malloc(sizeof(ProjectLoadWorker) * thread_c);
+  for (long i = 0; i < thread_c; i++) {
+    workers[i].job = &job;
+    workers[i].arena = arena_create();
+  }
+
+  if (thread_c == 1) {
+    // Load everything on this thread, in ID order
+    load_projects_worker(workers);
+  } else {
+    // Fan projects out over worker threads, this thread included
+    pthread_t *threads = malloc(sizeof(pthread_t) * (thread_c - 1));
+    long started_c = 0;
+    while (started_c < thread_c - 1 &&
+           !pthread_create(threads + started_c, NULL, load_projects_worker,
+                           workers + started_c + 1)) {
+      started_c++;
+    }
+    load_projects_worker(workers);
+    for (long i = 0; i < started_c; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+  }
+
+  // Merge worker arenas, so the whole list is released with one arena
+  Arena *arena = workers[0].arena;
+  for (long i = 1; i < thread_c; i++) {
+    arena_merge(arena, workers[i].arena);
+  }
+  free(workers);
+
+  // Collect loaded projects in ID order, reporting any that failed
+  Project **projects = job.projects;
+  size_t project_c = 0;
+  for (size_t i = 0; i < id_c; i++) {
+    if (job.errors[i]) {
+      printf("Failed to load project %zu.yaml (error %d)\n", ids[i],
+             job.errors[i]);
+      continue;
+    }
+    projects[project_c] = job.projects[i];
+    projects[project_c]->arena = arena;
+    project_c++;
+  }
+  if (!project_c) {
+    arena_destroy(arena);
+  }
+
+  free(job.errors);
+  free(ids);
+
   // Return project list and count
   *projects_out = projects;
   *project_c_out = project_c;
@@ -239,61 +566,469 @@ FileError fs_get_project_list(Project ***projects_out, size_t *project_c_out) {
   return FILE_OK;
 }
 
-FileError fs_save_project(Project project) {
-  Filepath project_path;
+FileError fs_get_project_headers(Project ***projects_out,
+                                 size_t *project_c_out) {
+  // Everything needed is already in the index, no project files are read
+  ProjectIndex index;
+  PROPAGATE(FileError, fs_get_project_index, (&index));
+
+  Project **projects = calloc(index.entry_c ? index.entry_c : 1,
+                              sizeof(Project *));
+  Arena *arena = index.entry_c ? arena_create() : NULL;
+  for (size_t i = 0; i < index.entry_c; i++) {
+    ProjectIndexEntry *entry = index.entries + i;
+
+    Project *project = arena_alloc(arena, sizeof(Project));
+    project->id = entry->id;
+    memcpy(project->name, entry->name, sizeof(project->name));
+    project->default_rate = entry->default_rate;
+    project->activity_c = entry->activity_c;
+    project->activities = NULL;
+    project->activities_loaded = false;
+    project->arena = arena;
+
+    projects[i] = project;
+  }
+
+  *projects_out = projects;
+  *project_c_out = index.entry_c;
+  project_index_free(&index);
+
+  return FILE_OK;
+}
+
+FileError fs_get_activities(Project *project, Activity **activities_out,
+                            size_t *activity_c_out) {
+  if (!project->activities_loaded) {
+    // Load the full project into the same arena. The name and rate listed
+    // from the index may be older than the version loaded with them, so they
+    // are taken from the same load
+    Project *loaded;
+    PROPAGATE(FileError, load_project, (project->id, project->arena, &loaded));
+
+    memcpy(project->name, loaded->name, sizeof(project->name));
+    project->default_rate = loaded->default_rate;
+    project->activities = loaded->activities;
+    project->activity_c = loaded->activity_c;
+    project->journal_seq = loaded->journal_seq;
+    project->version = loaded->version;
+    project->mapping = loaded->mapping;
+    project->mapping_size = loaded->mapping_size;
+    project->partitions = loaded->partitions;
+    project->partition_c = loaded->partition_c;
+    project->activities_loaded = true;
+  }
+
+  *activities_out = project->activities;
+  *activity_c_out = project->activity_c;
+
+  return FILE_OK;
+}
+
+/// Visits a run of loaded activities, returning false if told to stop.
+static bool visit_activities(const Activity *activities, size_t activity_c,
+                             const ProjectStreamHeader *header,
+                             ProjectStreamFn fn, void *context) {
+  for (size_t i = 0; i < activity_c; i++) {
+    ActivitySummary summary = activity_summarise(activities + i);
+    if (!fn(context, header, &summary)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FileError fs_stream_activities(ProjectId id, ProjectStreamFn fn,
+                               void *context) {
+  // Only ever holds a snapshot header or a journal's worth of activities
+  Arena *arena = arena_create();
+
+  ProjectStreamHeader header = {.id = id};
+  Project *project;
+  bool more = true;
+  if (snapshot_is_current(id) && !snapshot_load(id, arena, &project)) {
+    // Mapped activities are visited in place, pages are dropped as they go
+    header.default_rate = project->default_rate;
+    header.journal_seq = project->journal_seq;
+    more = visit_activities(project->activities, project->activity_c, &header,
+                            fn, context);
+    munmap(project->mapping, project->mapping_size);
+  } else {
+    Filepath project_path;
+    FileError error = fs_get_project_path(id, project_path);
+    ProjectStreamError stream_error =
+        error ? PROJECT_STREAM_OPEN_ERROR
+              : project_stream_file(project_path, fn, context, &header);
+    more = stream_error != PROJECT_STREAM_STOPPED;
+    if (stream_error && more) {
+      arena_destroy(arena);
+      return FILE_STREAM_ERROR;
+    }
+  }
+
+  // Then anything logged since the project file was written, through an
+  // empty project so the journal is read exactly as on a full load
+  if (more) {
+    Project tail = {
+        .id = id,
+        .journal_seq = header.journal_seq,
+        .activities_loaded = true,
+        .arena = arena,
+    };
+    if (journal_replay(&tail)) {
+      arena_destroy(arena);
+      return FILE_JOURNAL_ERROR;
+    }
+    visit_activities(tail.activities, tail.activity_c, &header, fn, context);
+  }
+
+  arena_destroy(arena);
+
+  return FILE_OK;
+}
+
+FileError fs_get_activities_between(Project *project, time_t start, time_t end,
+                                    Activity **activities_out,
+                                    size_t *activity_c_out) {
+  // Only maps the snapshot for header-only projects, pages of partitions
+  // outside the range are never read
+  Activity *activities;
+  size_t activity_c;
+  PROPAGATE(FileError, fs_get_activities, (project, &activities, &activity_c));
+
+  size_t first, last;
+  snapshot_partition_range(project, start, end, &first, &last);
+
+  *activities_out = activities + first;
+  *activity_c_out = last - first;
+
+  return FILE_OK;
+}
+
+/// Updates the project index and rollups after a project has been written.
+static FileError update_index(const Project *project) {
+  int lock_fd;
+  PROPAGATE(FileError, fs_lock_index, (true, &lock_fd));
+
+  // Journal records up to `journal_seq` now live in the project file, restart
+  // the journal after them (any newer records are kept)
+  FileError error = FILE_OK;
+  size_t journal_c;
+  if (journal_reset(project->id, project->journal_seq, &journal_c)) {
+    error = FILE_JOURNAL_ERROR;
+  } else if (project_index_update(project, journal_c)) {
+    error = FILE_INDEX_ERROR;
+  } else if (rollup_replace_project(project->id)) {
+    // Covers rate changes as well as journal records folded in
+    error = FILE_ROLLUP_ERROR;
+  }
+
+  fs_unlock(lock_fd);
+  return error;
+}
+
+/// Writes a project as its next version. The project must be locked, and at
+/// the version on disk.
+static FileError write_project(Project project) {
+  // Saving a header-only project would erase its activities
+  if (!project.activities_loaded) {
+    printf("Refusing to save project %zu before its activities are loaded\n",
+           project.id);
+    return FILE_CYAML_SAVE_ERROR;
+  }
+  project.version++;
+
+  Filepath project_path, temp_path;
   PROPAGATE(FileError, fs_get_project_path, (project.id, project_path));
+  PROPAGATE(FileError, fs_get_temp_path, (project_path, temp_path));
 
-  cyaml_err_t error = cyaml_save_file(project_path, &CYAML_CONFIG,
-                                      &PROJECT_VALUE_SCHEMA, &project, 0);
+  // Write to a temporary file first so a crash never leaves a torn project
+  if (project_yaml_save(&project, temp_path)) {
+    remove(temp_path);
+    return FILE_CYAML_SAVE_ERROR;
+  }
 
-  if (error) {
+  if (rename(temp_path, project_path)) {
+    remove(temp_path);
     return FILE_CYAML_SAVE_ERROR;
   }
 
+  // Written after the YAML, so that the snapshot is the newer of the two
+  if (snapshot_save(&project)) {
+    return FILE_SNAPSHOT_ERROR;
+  }
+
+  project_cache_invalidate(project.id);
+
+  return update_index(&project);
+}
+
+/// Stream callback skipping every activity, to reach the fields after them.
+static bool skip_activity(void *_context, const ProjectStreamHeader *_header,
+                          const ActivitySummary *_activity) {
+  return true;
+}
+
+/// Reads the version of a project as it is on disk, 0 if it has never been
+/// saved or has been deleted. The project must be locked. Only the snapshot
+/// header is read if the snapshot is current, otherwise the YAML is streamed
+/// without keeping its activities. A YAML file only libcyaml accepts is loaded
+/// in full.
+static FileError stored_version(ProjectId id, unsigned long *version_out) {
+  if (!project_exists(id)) {
+    *version_out = 0;
+    return FILE_OK;
+  }
+
+  unsigned long version;
+  if (!snapshot_is_current(id) || snapshot_project_version(id, &version)) {
+    Filepath project_path;
+    PROPAGATE(FileError, fs_get_project_path, (id, project_path));
+    ProjectStreamHeader header;
+    if (!project_stream_file(project_path, skip_activity, NULL, &header)) {
+      version = header.version;
+    } else {
+      Project *project;
+      PROPAGATE(FileError, fs_load_project, (id, &project));
+      version = project->version;
+      PROPAGATE(FileError, fs_free_project, (project));
+    }
+  }
+
+  // Files written before versioning count as the first version, as on load
+  *version_out = version ? version : 1;
+
   return FILE_OK;
 }
 
-FileError fs_load_project(unsigned long id, Project **project_out) {
-  Filepath project_path;
-  PROPAGATE(FileError, fs_get_project_path, (id, project_path));
+FileError fs_save_project(Project project) {
+  int lock_fd;
+  PROPAGATE(FileError, lock_project, (project.id, true, &lock_fd));
 
-  // Load project and return to calling function (cyaml allocated, caller owned)
-  cyaml_err_t error =
-      cyaml_load_file(project_path, &CYAML_CONFIG, &PROJECT_VALUE_SCHEMA,
-                      (void **)project_out, 0);
+  // Never overwrite changes made since this copy was loaded
+  unsigned long version;
+  FileError error = stored_version(project.id, &version);
+  if (!error && version != project.version) {
+    error = FILE_CONFLICT_ERROR;
+  }
+  if (!error) {
+    error = write_project(project);
+  }
+
+  fs_unlock(lock_fd);
+  return error;
+}
 
+FileError fs_get_project_index(ProjectIndex *index_out) {
+  // Nothing in the projects directory has changed since last time
+  if (project_cache_get_index(index_out)) {
+    return FILE_OK;
+  }
+
+  IndexError error = project_index_load(index_out);
   if (error) {
-    return FILE_CYAML_LOAD_ERROR;
+    printf("Failed to load project index (error %d)\n", error);
+    return FILE_INDEX_ERROR;
   }
+  project_cache_put_index(index_out);
 
   return FILE_OK;
 }
 
-FileError fs_free_project(Project *project) {
-  cyaml_err_t error =
-      cyaml_free(&CYAML_CONFIG, &PROJECT_VALUE_SCHEMA, project, 0);
+/// Checks if a project's snapshot exists and is at least as new as its YAML,
+/// i.e. the YAML has not been edited by hand since the snapshot was written.
+static bool snapshot_is_current(ProjectId id) {
+  Filepath project_path, snapshot_path;
+  if (fs_get_project_path(id, project_path) ||
+      fs_get_project_file(id, SNAPSHOT_EXTENSION, snapshot_path)) {
+    return false;
+  }
+
+  struct stat project_stat, snapshot_stat;
+  if (stat(project_path, &project_stat) ||
+      stat(snapshot_path, &snapshot_stat)) {
+    return false;
+  }
 
+  struct timespec project_time = project_stat.st_mtim;
+  struct timespec snapshot_time = snapshot_stat.st_mtim;
+  return snapshot_time.tv_sec > project_time.tv_sec ||
+         (snapshot_time.tv_sec == project_time.tv_sec &&
+          snapshot_time.tv_nsec >= project_time.tv_nsec);
+}
+
+/// Orders activities by time.
+static int compare_activity_time(const void *a, const void *b) {
+  unsigned long time_a = ((const Activity *)a)->time;
+  unsigned long time_b = ((const Activity *)b)->time;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+/// Puts a loaded project's activities in time order, given that the first
+/// `sorted_c` already are. Journal activities are almost always newer than the
+/// snapshot, so this is usually just a check of the journal tail.
+static void sort_activities(Project *project, size_t sorted_c) {
+  size_t i = sorted_c ? sorted_c : 1;
+  while (i < project->activity_c &&
+         project->activities[i - 1].time <= project->activities[i].time) {
+    i++;
+  }
+  if (i >= project->activity_c) {
+    return;
+  }
+
+  // Snapshot mappings are private, so sorting in place leaves the file alone.
+  // Partition boundaries no longer hold though.
+  qsort(project->activities, project->activity_c, sizeof(Activity),
+        compare_activity_time);
+  project->partitions = NULL;
+  project->partition_c = 0;
+}
+
+/// Loads a project into an arena, which then owns everything but the snapshot
+/// mapping (if any).
+static FileError load_project(ProjectId id, Arena *arena,
+                              Project **project_out) {
+  // Use the snapshot in place if nothing has changed since it was written
+  if (!snapshot_is_current(id) || snapshot_load(id, arena, project_out)) {
+    Filepath project_path;
+    PROPAGATE(FileError, fs_get_project_path, (id, project_path));
+    struct stat parsed_stat;
+    bool parsed_stat_ok = !stat(project_path, &parsed_stat);
+
+    // Load project and return to calling function (arena allocated). Files
+    // laid out as `fs_save_project` writes them take the specialised parser,
+    // anything else (hand edits, older files) falls back to libcyaml.
+    if (project_yaml_load(project_path, arena, project_out)) {
+      PROPAGATE(FileError, fs_cyaml_load_project,
+                (project_path, arena, project_out));
+    }
+
+    (*project_out)->arena = arena;
+    (*project_out)->mapping = NULL;
+    (*project_out)->mapping_size = 0;
+    (*project_out)->partitions = NULL;
+    (*project_out)->partition_c = 0;
+    (*project_out)->activities_loaded = true;
+
+    // Refresh the snapshot so the next load can skip parsing, not fatal. Only
+    // if nobody is writing the project and the YAML is still the one parsed,
+    // a snapshot newer than the YAML would hide its changes.
+    int lock_fd;
+    if (parsed_stat_ok && !lock_project(id, false, &lock_fd)) {
+      struct stat current_stat;
+      if (!stat(project_path, &current_stat) &&
+          current_stat.st_ino == parsed_stat.st_ino &&
+          current_stat.st_dev == parsed_stat.st_dev &&
+          current_stat.st_mtim.tv_sec == parsed_stat.st_mtim.tv_sec &&
+          current_stat.st_mtim.tv_nsec == parsed_stat.st_mtim.tv_nsec) {
+        SnapshotError snapshot_error = snapshot_save(*project_out);
+        if (snapshot_error) {
+          printf("Failed to write snapshot for project %zu (error %d)\n", id,
+                 snapshot_error);
+        }
+      }
+      fs_unlock(lock_fd);
+    }
+  }
+
+  // Files written before versioning count as the first version, 0 is kept
+  // for projects that have never been saved
+  if (!(*project_out)->version) {
+    (*project_out)->version = 1;
+  }
+
+  // Partitioned snapshots are already in time order, anything else is checked
+  size_t sorted_c =
+      (*project_out)->partition_c ? (*project_out)->activity_c : 0;
+
+  // Apply activities logged since the project file was last written
+  if (journal_replay(*project_out)) {
+    if ((*project_out)->mapping) {
+      munmap((*project_out)->mapping, (*project_out)->mapping_size);
+    }
+    return FILE_JOURNAL_ERROR;
+  }
+
+  sort_activities(*project_out, sorted_c);
+
+  return FILE_OK;
+}
+
+FileError fs_load_project(unsigned long id, Project **project_out) {
+  // Single projects get an arena of their own
+  Arena *arena = arena_create();
+
+  FileError error = load_project(id, arena, project_out);
   if (error) {
-    printf("Error while freeing project (error %d)\n", error);
-    return FILE_CYAML_FREE_ERROR;
+    arena_destroy(arena);
+    return error;
+  }
+
+  return FILE_OK;
+}
+
+FileError fs_acquire_project(ProjectId id, const Project **project_out) {
+  if (project_cache_acquire(id, project_out)) {
+    return FILE_OK;
   }
 
+  // Cache takes ownership of the loaded project
+  Project *project;
+  PROPAGATE(FileError, fs_load_project, (id, &project));
+  *project_out = project_cache_insert(project);
+
+  return FILE_OK;
+}
+
+void fs_release_project(const Project *project) {
+  project_cache_release(project);
+}
+
+FileError fs_resize_activities(Project *project, size_t activity_c) {
+  // Mapped activities can grow into the room left after the snapshot, past
+  // that they have to move into the arena
+  if (project->mapping) {
+    unsigned char *mapping_end =
+        (unsigned char *)project->mapping + project->mapping_size;
+    if ((unsigned char *)(project->activities + activity_c) <= mapping_end) {
+      return FILE_OK;
+    }
+  }
+  snapshot_detach(project);
+
+  Activity *activities = arena_realloc(project->arena, project->activities,
+                                       sizeof(Activity) * activity_c);
+  if (activity_c && !activities) {
+    return FILE_CREATE_ERROR;
+  }
+  project->activities = activities;
+
+  return FILE_OK;
+}
+
+FileError fs_free_project(Project *project) {
+  // The project itself lives in the arena, so unmap before releasing it
+  if (project->mapping) {
+    munmap(project->mapping, project->mapping_size);
+  }
+  arena_destroy(project->arena);
+
   return FILE_OK;
 }
 
 FileError fs_free_project_list(Project **projects, size_t project_c) {
-  // Free each project indiviually according to YAML schema
+  // Mappings are per project, everything else is in one arena for the list
   for (int i = 0; i < project_c; i++) {
     Project *project = projects[i];
 
-    cyaml_err_t error =
-        cyaml_free(&CYAML_CONFIG, &PROJECT_VALUE_SCHEMA, project, 0);
-    if (error) {
-      printf("Error while freeing project %d of %zu...\n", i + 1,
-             project_c + 1);
-      return FILE_CYAML_FREE_ERROR;
+    if (project->mapping) {
+      munmap(project->mapping, project->mapping_size);
     }
   }
+  if (project_c) {
+    arena_destroy(projects[0]->arena);
+  }
 
   // Free project pointer array
   free(projects);
@@ -305,12 +1040,175 @@ FileError fs_delete_project(Project project) {
   Filepath project_path;
   PROPAGATE(FileError, fs_get_project_path, (project.id, project_path));
 
+  int lock_fd;
+  PROPAGATE(FileError, lock_project, (project.id, true, &lock_fd));
+
   // Erase file
   int error = remove(project_path);
   if (error) {
     printf("Failed to delete project (error %d)\n", error);
+    fs_unlock(lock_fd);
     return FILE_DELETE_ERROR;
   }
 
+  // Erase the snapshot and any activities still waiting in the journal
+  if (snapshot_delete(project.id) || journal_delete(project.id)) {
+    fs_unlock(lock_fd);
+    return FILE_DELETE_ERROR;
+  }
+
+  project_cache_invalidate(project.id);
+
+  int index_lock_fd;
+  FileError file_error = fs_lock_index(true, &index_lock_fd);
+  if (!file_error) {
+    if (project_index_remove(project.id)) {
+      file_error = FILE_INDEX_ERROR;
+    } else if (rollup_remove_project(project.id)) {
+      file_error = FILE_ROLLUP_ERROR;
+    }
+    fs_unlock(index_lock_fd);
+  }
+
+  fs_unlock(lock_fd);
+  return file_error;
+}
+
+/// Folds a project's journal back into its project file. The project must be
+/// locked.
+static FileError compact_project(ProjectId id) {
+  // Loading replays the journal, saving folds it into the project file
+  Project *project;
+  PROPAGATE(FileError, fs_load_project, (id, &project));
+
+  FileError error = write_project(*project);
+  if (error) {
+    fs_free_project(project);
+    return error;
+  }
+
+  return fs_free_project(project);
+}
+
+/// Counts a journalled activity in the project index and rollups. The index
+/// must be locked.
+static FileError index_activity(const Activity *activity) {
+  if (project_index_add_activity(activity->project_id)) {
+    return FILE_INDEX_ERROR;
+  }
+
+  // Logged activities normally carry their rate, otherwise it is the project's
+  double rate = activity->rate.value;
+  if (!activity->rate.present) {
+    ProjectIndex index;
+    PROPAGATE(FileError, fs_get_project_index, (&index));
+    ProjectIndexEntry *entry = project_index_find(&index, activity->project_id);
+    rate = entry ? entry->default_rate : 0;
+    project_index_free(&index);
+  }
+
+  return rollup_add_activity(activity, rate) ? FILE_ROLLUP_ERROR : FILE_OK;
+}
+
+/// Appends an activity to its project's journal and counts it. The project
+/// must be locked.
+static FileError journal_activity(const Activity *activity,
+                                  size_t *record_c_out) {
+  // Held from appending to counting, so a rebuild of the rollups in between
+  // cannot count it twice
+  int lock_fd;
+  PROPAGATE(FileError, fs_lock_index, (true, &lock_fd));
+
+  JournalError journal_error =
+      journal_append(activity->project_id, activity, record_c_out);
+  if (journal_error) {
+    fs_unlock(lock_fd);
+    printf("Failed to append to journal (error %d)\n", journal_error);
+    return FILE_JOURNAL_ERROR;
+  }
+  project_cache_invalidate(activity->project_id);
+
+  FileError error = index_activity(activity);
+
+  fs_unlock(lock_fd);
+  return error;
+}
+
+/// Appends an activity to its project's journal. The project must be locked.
+static FileError append_activity(const Activity *activity) {
+  if (!project_exists(activity->project_id)) {
+    return FILE_CONFLICT_ERROR;
+  }
+
+  size_t record_c;
+  PROPAGATE(FileError, journal_activity, (activity, &record_c));
+
+  // Keep the journal short so that loading stays cheap. Snapshots in older
+  // formats are also migrated on their first write.
+  uint32_t version;
+  bool old_snapshot = !snapshot_version(activity->project_id, &version) &&
+                      version < SNAPSHOT_VERSION;
+  if (record_c >= JOURNAL_COMPACT_THRESHOLD || old_snapshot) {
+    PROPAGATE(FileError, compact_project, (activity->project_id));
+  }
+
   return FILE_OK;
 }
+
+FileError fs_append_activity(const Activity *activity) {
+  // Appends read the journal to find its end, so concurrent ones must queue
+  int lock_fd;
+  PROPAGATE(FileError, lock_project, (activity->project_id, true, &lock_fd));
+
+  FileError error = append_activity(activity);
+
+  fs_unlock(lock_fd);
+  return error;
+}
+
+/// Appends a batch of activities to a project. The project must be locked.
+static FileError append_activities(ProjectId id, const Activity *activities,
+                                   size_t activity_c) {
+  if (!project_exists(id)) {
+    return FILE_CONFLICT_ERROR;
+  }
+
+  // Loading replays the journal, so the new activities follow everything
+  // already logged and saving folds the lot into the project file
+  Project *project;
+  PROPAGATE(FileError, fs_load_project, (id, &project));
+
+  FileError error =
+      fs_resize_activities(project, project->activity_c + activity_c);
+  if (!error) {
+    memcpy(project->activities + project->activity_c, activities,
+           sizeof(Activity) * activity_c);
+    project->activity_c += activity_c;
+    error = write_project(*project);
+  }
+
+  FileError free_error = fs_free_project(project);
+  return error ? error : free_error;
+}
+
+FileError fs_append_activities(ProjectId id, const Activity *activities,
+                               size_t activity_c) {
+  // Held from loading to saving, so nothing logged in between is lost
+  int lock_fd;
+  PROPAGATE(FileError, lock_project, (id, true, &lock_fd));
+
+  FileError error = append_activities(id, activities, activity_c);
+
+  fs_unlock(lock_fd);
+  return error;
+}
+
+FileError fs_compact_project(ProjectId id) {
+  int lock_fd;
+  PROPAGATE(FileError, lock_project, (id, true, &lock_fd));
+
+  FileError error = compact_project(id);
+
+  fs_unlock(lock_fd);
+  return error;
+}
@@ -1,7 +1,9 @@
 #ifndef FILESYSTEM_H_
 #define FILESYSTEM_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
 
 /// Config directory relative to user home.
 #define CONFIG_DIRECTORY ".config/freeman"
@@ -9,6 +11,16 @@
 #define PREFERENCES_FILE CONFIG_DIRECTORY "/preferences.yaml"
 /// Projects directory relative to use home.
 #define PROJECTS_DIRECTORY CONFIG_DIRECTORY "/projects"
+/// Project metadata index relative to user home.
+#define PROJECT_INDEX_FILE CONFIG_DIRECTORY "/projects.index"
+/// Daily earnings rollups relative to user home.
+#define ROLLUP_FILE CONFIG_DIRECTORY "/rollups.bin"
+/// Lock held while updating the project index or rollups, relative to user
+/// home.
+#define INDEX_LOCK_FILE CONFIG_DIRECTORY "/index.lock"
+/// File extension of a project's lock file, held while writing any of its
+/// files. Left behind once the project is deleted.
+#define LOCK_EXTENSION "lock"
 /// Default permissions to use for newly created files and directories.
 #define DEFAULT_PERMISSIONS 0755
 
@@ -33,38 +45,140 @@ typedef enum FileError {
   FILE_PATH_ERROR,
   /// Error browsing a directory.
   FILE_DIRECTORY_ERROR,
+  /// Something went wrong reading or writing an activity journal.
+  FILE_JOURNAL_ERROR,
+  /// Something went wrong writing a binary project snapshot.
+  FILE_SNAPSHOT_ERROR,
+  /// Something went wrong reading or updating the project index.
+  FILE_INDEX_ERROR,
+  /// Something went wrong updating the daily rollups.
+  FILE_ROLLUP_ERROR,
+  /// Something went wrong streaming a project file.
+  FILE_STREAM_ERROR,
+  /// Something went wrong taking a lock.
+  FILE_LOCK_ERROR,
+  /// The project was written or deleted by someone else since it was loaded.
+  FILE_CONFLICT_ERROR,
 } FileError;
 
 /// Ensures that the filesystem is readable, initialising it if not.
 FileError fs_ensure(void);
 /// Expands a path relative to the home directory.
 FileError fs_expand_from_home(const char *path, char *path_out);
+/// Gets the path of a temporary file to write before renaming it over `path`,
+/// unique to this process.
+FileError fs_get_temp_path(const char *path, char *path_out);
+/// Locks the project index and rollups, which every project shares. Shared
+/// locks are for reading, exclusive ones for writing. Taken after any project
+/// lock. Release with `fs_unlock`.
+FileError fs_lock_index(bool exclusive, int *fd_out);
+/// Releases a lock.
+void fs_unlock(int fd);
 
 #include "preferences.h"
 
 /// Initialises the preferences file.
 FileError fs_init_preferences(void);
-/// Reads and deserialises the preferences file.
+/// Reads and deserialises the preferences file. The result is cached, the file
+/// is only parsed again once its inode, size or mtime changes.
 FileError fs_get_preferences(Preferences *preferences_out);
-/// Serialises preferences and writes to the preferences file.
+/// Serialises preferences and writes to the preferences file, updating the
+/// cache.
 FileError fs_set_preferences(Preferences preferences);
+/// Counts changes to the preferences file so far, whether written by this
+/// process or another.
+unsigned long fs_preferences_changes(void);
 
 #include "project.h"
+#include "project_cache.h"
+#include "project_index.h"
+#include "project_stream.h"
+
+/// Reads a project file with libcyaml into a project allocated from the arena.
+/// Used for files `project_yaml_load` does not accept, and as the reference it
+/// is tested against.
+FileError fs_cyaml_load_project(const char *path, Arena *arena,
+                                Project **project_out);
+/// Writes a project file with libcyaml. Projects are saved with
+/// `project_yaml_save`, this is the reference it is tested against.
+FileError fs_cyaml_save_project(const Project *project, const char *path);
 
 /// Write a new project file.
 FileError fs_get_project_path(ProjectId id, char *path_out);
+/// Gets the path of a file belonging to a project, `{project_dir}/{id}.{extension}`.
+FileError fs_get_project_file(ProjectId id, const char *extension,
+                              char *path_out);
+/// Checks if a filename is a project file (`{id}.yaml`), returning its ID.
+bool fs_parse_project_filename(const char *name, ProjectId *id_out);
+/// Sets how many threads `fs_get_project_list` loads projects with, 0 (the
+/// default) meaning one per core. 1 loads everything on the calling thread.
+void fs_set_load_threads(unsigned int thread_c);
 /// Browses the projects directory and returns an (owned) list of all loaded
-/// projects.
+/// projects, sorted by ID. Projects are loaded in parallel, any that fail to
+/// load are reported and skipped.
 FileError fs_get_project_list(Project ***projects_out, size_t *project_c_out);
-/// Saves a project to the projects directory.
+/// Loads the project index, for callers that only need project names, rates
+/// and counts. Free with `project_index_free`.
+FileError fs_get_project_index(ProjectIndex *index_out);
+/// Returns an (owned) list of header-only projects, sorted by ID. Only `id`,
+/// `name`, `default_rate` and `activity_c` are filled in, from the project
+/// index, activities are loaded on first access through `fs_get_activities`.
+/// Free with `fs_free_project_list`.
+FileError fs_get_project_headers(Project ***projects_out,
+                                 size_t *project_c_out);
+/// Gets a project's activities, loading them first if the project was loaded
+/// header-only. Loading also refreshes its name, rate and version, so that
+/// changes saved since it was listed are not reverted by saving it.
+FileError fs_get_activities(Project *project, Activity **activities_out,
+                            size_t *activity_c_out);
+/// Visits every activity of a project one at a time, without loading it: the
+/// snapshot is read in place if current, otherwise the YAML is streamed, then
+/// any journal records are visited. Memory use does not grow with the project.
+FileError fs_stream_activities(ProjectId id, ProjectStreamFn fn,
+                               void *context);
+/// Gets the activities of a project that may have been logged in
+/// `[start, end)`, in time order. Only the monthly partitions overlapping the
+/// range are read, so the result can include a few activities either side of
+/// it, callers still filter by time.
+FileError fs_get_activities_between(Project *project, time_t start, time_t end,
+                                    Activity **activities_out,
+                                    size_t *activity_c_out);
+/// Saves a project to the projects directory, with its lock held. Fails with
+/// `FILE_CONFLICT_ERROR` if the file is no longer at `project.version`, i.e.
+/// someone else has written (or deleted) it since the project was loaded. New
+/// projects (version 0) must not exist yet.
 FileError fs_save_project(Project project);
 /// Deletes a project.
 FileError fs_delete_project(Project project);
-/// Loads a specific project from the projects directory, returning a caller-owned pointer to this project.
+/// Loads a specific project from the projects directory, returning a
+/// caller-owned pointer to this project.
+///
+/// The binary snapshot is used in place when it is at least as new as the
+/// YAML, otherwise the YAML is parsed and the snapshot refreshed from it.
 FileError fs_load_project(ProjectId id, Project **project_out);
-/// Frees an individual loaded project.
+/// Resizes a loaded project's activity array (without changing `activity_c`),
+/// whichever way it was loaded.
+FileError fs_resize_activities(Project *project, size_t activity_c);
+/// Returns a shared, read-only view of a project from the in-process cache,
+/// only loading it if it has changed on disk. Hand back with
+/// `fs_release_project`, never `fs_free_project`.
+FileError fs_acquire_project(ProjectId id, const Project **project_out);
+/// Hands back a view from `fs_acquire_project`.
+void fs_release_project(const Project *project);
+/// Frees an individual loaded project (never one from a project list).
 FileError fs_free_project(Project *project);
-/// Frees a project list.
+/// Frees a project list, releasing the arena shared by all of its projects.
 FileError fs_free_project_list(Project **projects, size_t project_c);
 
+/// Appends a single activity to its project's journal without rewriting the
+/// project file, compacting once the journal grows too long. Fails with
+/// `FILE_CONFLICT_ERROR` if the project no longer exists.
+FileError fs_append_activity(const Activity *activity);
+/// Appends a batch of activities to a project with a single rewrite of its
+/// project file, folding in its journal as well.
+FileError fs_append_activities(ProjectId id, const Activity *activities,
+                               size_t activity_c);
+/// Folds a project's journal back into its project file.
+FileError fs_compact_project(ProjectId id);
+
 #endif
@@ -1,10 +1,12 @@
 #include "input.h"
 
+#include "calendar.h"
 #include "error.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 void flush_input_buffer(void) {
   int ch;
@@ -49,6 +51,11 @@ InputError read_duration(unsigned long *hours_out, unsigned long *minutes_out) {
   char input[INPUT_BUFFER_SIZE];
   PROPAGATE(InputError, read_string, (input));
 
+  return parse_duration(input, hours_out, minutes_out);
+}
+
+InputError parse_duration(char *input, unsigned long *hours_out,
+                          unsigned long *minutes_out) {
   // If HH:MM is provided, minutes will be MM and hours will be HH, if MMM is
   // provided then hours will be MMM.
   char *second = input;
@@ -88,6 +95,35 @@ InputError read_duration(unsigned long *hours_out, unsigned long *minutes_out) {
   return INPUT_OK;
 }
 
+InputError read_date(time_t *date_out) {
+  char input[INPUT_BUFFER_SIZE];
+  PROPAGATE(InputError, read_string, (input));
+
+  return parse_date(input, date_out);
+}
+
+InputError parse_date(char *input, time_t *date_out) {
+  char *rest = input;
+  char *year_str = strsep(&rest, "/");
+  char *month_str = strsep(&rest, "/");
+  char *day_str = rest;
+
+  if (!month_str || !day_str || validate_int_string(year_str) ||
+      validate_int_string(month_str) || validate_int_string(day_str)) {
+    return INPUT_INVALID;
+  }
+
+  int year = atoi(year_str), month = atoi(month_str), day = atoi(day_str);
+  if (month < 1 || month > 12 || day < 1 ||
+      day > calendar_days_in_month(year, month)) {
+    return INPUT_INVALID;
+  }
+
+  *date_out = calendar_day_start(calendar_days_from_civil(year, month, day));
+
+  return INPUT_OK;
+}
+
 InputError read_int(int *val_out) {
   char input[INPUT_BUFFER_SIZE];
   PROPAGATE(InputError, read_string, (input));
@@ -2,6 +2,7 @@
 #define INPUT_H_
 
 #include <stdlib.h>
+#include <time.h>
 
 #define INPUT_BUFFER_SIZE (128)
 
@@ -26,6 +27,15 @@ InputError read_double(double *val_out);
 InputError read_string(char *buffer);
 /// Reads a time duration (HH:MM or MMM) from stdin
 InputError read_duration(unsigned long *hours_out, unsigned long *minutes_out);
+/// Reads a date (YYYY/MM/DD) from stdin, as local midnight at its start
+InputError read_date(time_t *date_out);
+
+/// Parses a time duration (HH:MM or MMM), modifying the string.
+InputError parse_duration(char *input, unsigned long *hours_out,
+                          unsigned long *minutes_out);
+/// Parses a date (YYYY/MM/DD) as local midnight at its start, modifying the
+/// string.
+InputError parse_date(char *input, time_t *date_out);
 
 /// Checks if a string is a valid float
 InputError validate_float_string(const char *input);
@@ -0,0 +1,313 @@
+#include "journal.h"
+
+#include "filesystem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Lookup table for the reflected IEEE polynomial.
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_table(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    }
+    crc_table[i] = crc;
+  }
+}
+
+uint32_t journal_checksum(const void *data, size_t length) {
+  // Built on first use, projects may be loaded from several threads at once
+  pthread_once(&crc_table_once, build_crc_table);
+
+  const unsigned char *bytes = data;
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < length; i++) {
+    crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+
+  return crc ^ 0xffffffff;
+}
+
+/// Reads every intact record from an open journal, stopping at the first torn
+/// or corrupt record. `valid_end_out` is the offset just past the last intact
+/// record. An empty file yields a fresh header with no records.
+static JournalError journal_read(int fd, JournalFileHeader *header_out,
+                                 JournalRecord **records_out,
+                                 size_t *record_c_out, off_t *valid_end_out) {
+  *records_out = NULL;
+  *record_c_out = 0;
+
+  // Missing or torn header, treat as a brand new journal
+  ssize_t read_c = pread(fd, header_out, sizeof(JournalFileHeader), 0);
+  if (read_c < 0) {
+    return JOURNAL_READ_ERROR;
+  }
+  if ((size_t)read_c < sizeof(JournalFileHeader)) {
+    header_out->magic = JOURNAL_MAGIC;
+    header_out->version = JOURNAL_VERSION;
+    header_out->base_seq = 0;
+    *valid_end_out = 0;
+    return JOURNAL_OK;
+  }
+  if (header_out->magic != JOURNAL_MAGIC ||
+      header_out->version != JOURNAL_VERSION) {
+    return JOURNAL_FORMAT_ERROR;
+  }
+
+  off_t offset = sizeof(JournalFileHeader);
+  JournalRecord *records = NULL;
+  size_t record_c = 0;
+  size_t record_capacity = 0;
+
+  while (true) {
+    JournalRecordHeader record_header;
+    if (pread(fd, &record_header, sizeof(record_header), offset) !=
+        sizeof(record_header)) {
+      break; // End of journal, or torn header
+    }
+    if (record_header.length != sizeof(JournalRecord)) {
+      break; // Garbage length, nothing after this can be trusted
+    }
+
+    JournalRecord record;
+    if (pread(fd, &record, sizeof(record), offset + sizeof(record_header)) !=
+        sizeof(record)) {
+      break; // Torn payload
+    }
+    if (journal_checksum(&record, sizeof(record)) != record_header.checksum) {
+      break; // Partially written payload
+    }
+
+    // Grow geometrically, journals are bounded by compaction anyway
+    if (record_c == record_capacity) {
+      record_capacity = record_capacity ? record_capacity * 2 : 16;
+      records = realloc(records, sizeof(JournalRecord) * record_capacity);
+    }
+    records[record_c++] = record;
+
+    offset += sizeof(record_header) + sizeof(record);
+  }
+
+  *records_out = records;
+  *record_c_out = record_c;
+  *valid_end_out = offset;
+
+  return JOURNAL_OK;
+}
+
+JournalError journal_append(ProjectId id, const Activity *activity,
+                            size_t *record_c_out) {
+  Filepath journal_path;
+  if (fs_get_project_file(id, JOURNAL_EXTENSION, journal_path)) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  int fd = open(journal_path, O_RDWR | O_CREAT, DEFAULT_PERMISSIONS);
+  if (fd < 0) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  // Recover the journal, finding where the next record belongs
+  JournalFileHeader header;
+  JournalRecord *records;
+  size_t record_c;
+  off_t valid_end;
+  JournalError error =
+      journal_read(fd, &header, &records, &record_c, &valid_end);
+  if (error) {
+    close(fd);
+    return error;
+  }
+
+  uint64_t seq = record_c ? records[record_c - 1].seq : header.base_seq;
+  free(records);
+
+  // Write a fresh header if the file was empty
+  if (!valid_end) {
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      close(fd);
+      return JOURNAL_WRITE_ERROR;
+    }
+    valid_end = sizeof(header);
+  }
+
+  // Drop any torn tail so the new record is reachable on replay
+  if (ftruncate(fd, valid_end)) {
+    close(fd);
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  // Frame and write the new record in a single write
+  struct {
+    JournalRecordHeader header;
+    JournalRecord record;
+  } frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.record.seq = seq + 1;
+  frame.record.activity = *activity;
+  frame.header.length = sizeof(JournalRecord);
+  frame.header.checksum = journal_checksum(&frame.record, sizeof(JournalRecord));
+
+  if (pwrite(fd, &frame, sizeof(frame), valid_end) != sizeof(frame) ||
+      fsync(fd)) {
+    close(fd);
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  if (close(fd)) {
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  if (record_c_out) {
+    *record_c_out = record_c + 1;
+  }
+
+  return JOURNAL_OK;
+}
+
+JournalError journal_replay(Project *project) {
+  Filepath journal_path;
+  if (fs_get_project_file(project->id, JOURNAL_EXTENSION, journal_path)) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  // No journal means nothing has been logged since the last save
+  int fd = open(journal_path, O_RDONLY);
+  if (fd < 0) {
+    return errno == ENOENT ? JOURNAL_OK : JOURNAL_OPEN_ERROR;
+  }
+
+  JournalFileHeader header;
+  JournalRecord *records;
+  size_t record_c;
+  off_t valid_end;
+  JournalError error =
+      journal_read(fd, &header, &records, &record_c, &valid_end);
+  close(fd);
+  if (error) {
+    return error;
+  }
+
+  // Count records not yet folded into the project file
+  size_t new_c = 0;
+  for (size_t i = 0; i < record_c; i++) {
+    if (records[i].seq > project->journal_seq) {
+      new_c++;
+    }
+  }
+
+  if (new_c) {
+    if (fs_resize_activities(project, project->activity_c + new_c)) {
+      free(records);
+      return JOURNAL_READ_ERROR;
+    }
+
+    for (size_t i = 0; i < record_c; i++) {
+      if (records[i].seq > project->journal_seq) {
+        project->activities[project->activity_c++] = records[i].activity;
+        project->journal_seq = records[i].seq;
+      }
+    }
+  }
+
+  free(records);
+
+  return JOURNAL_OK;
+}
+
+JournalError journal_reset(ProjectId id, unsigned long base_seq,
+                           size_t *kept_c_out) {
+  Filepath journal_path, temp_path;
+  if (fs_get_project_file(id, JOURNAL_EXTENSION, journal_path) ||
+      fs_get_temp_path(journal_path, temp_path)) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  // Read whatever is currently in the journal, if anything
+  JournalFileHeader header;
+  JournalRecord *records = NULL;
+  size_t record_c = 0;
+  off_t valid_end;
+  int fd = open(journal_path, O_RDONLY);
+  if (fd >= 0) {
+    JournalError error =
+        journal_read(fd, &header, &records, &record_c, &valid_end);
+    close(fd);
+    if (error) {
+      return error;
+    }
+  } else if (errno != ENOENT) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  // Write the new journal to a temporary file
+  fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, DEFAULT_PERMISSIONS);
+  if (fd < 0) {
+    free(records);
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  header.magic = JOURNAL_MAGIC;
+  header.version = JOURNAL_VERSION;
+  header.base_seq = base_seq;
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header);
+
+  // Carry over records that were logged after the snapshot was taken
+  size_t kept_c = 0;
+  for (size_t i = 0; ok && i < record_c; i++) {
+    if (records[i].seq <= base_seq) {
+      continue;
+    }
+    kept_c++;
+
+    JournalRecordHeader record_header = {
+        .length = sizeof(JournalRecord),
+        .checksum = journal_checksum(records + i, sizeof(JournalRecord)),
+    };
+    ok = write(fd, &record_header, sizeof(record_header)) ==
+             sizeof(record_header) &&
+         write(fd, records + i, sizeof(JournalRecord)) == sizeof(JournalRecord);
+  }
+  free(records);
+
+  ok = ok && !fsync(fd);
+  if (close(fd) || !ok) {
+    remove(temp_path);
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  // Atomically replace the old journal
+  if (rename(temp_path, journal_path)) {
+    remove(temp_path);
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  if (kept_c_out) {
+    *kept_c_out = kept_c;
+  }
+
+  return JOURNAL_OK;
+}
+
+JournalError journal_delete(ProjectId id) {
+  Filepath journal_path;
+  if (fs_get_project_file(id, JOURNAL_EXTENSION, journal_path)) {
+    return JOURNAL_OPEN_ERROR;
+  }
+
+  if (remove(journal_path) && errno != ENOENT) {
+    return JOURNAL_WRITE_ERROR;
+  }
+
+  return JOURNAL_OK;
+}
@@ -0,0 +1,75 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include "activity.h"
+#include "project.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// File extension of a project's activity journal, stored next to its YAML.
+#define JOURNAL_EXTENSION "journal"
+/// Identifies a journal file ("FMJL").
+#define JOURNAL_MAGIC (0x4c4a4d46)
+/// Current journal format version.
+#define JOURNAL_VERSION (1)
+/// Number of records after which a journal is folded back into its project.
+#define JOURNAL_COMPACT_THRESHOLD (256)
+
+typedef enum JournalError {
+  JOURNAL_OK = 0,
+  /// Something went wrong opening or creating the journal file.
+  JOURNAL_OPEN_ERROR,
+  /// Something went wrong reading the journal file.
+  JOURNAL_READ_ERROR,
+  /// Something went wrong writing to the journal file.
+  JOURNAL_WRITE_ERROR,
+  /// The journal file header is not one we understand.
+  JOURNAL_FORMAT_ERROR,
+} JournalError;
+
+/// Written once at the start of every journal file.
+typedef struct JournalFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  /// Sequence number already folded into the project file when this journal
+  /// was started, records continue from here.
+  uint64_t base_seq;
+} JournalFileHeader;
+
+/// Frames every record so that a torn write at the tail can be detected.
+typedef struct JournalRecordHeader {
+  /// Length of the payload following this header.
+  uint32_t length;
+  /// CRC-32 of the payload.
+  uint32_t checksum;
+} JournalRecordHeader;
+
+/// Payload of a single journal record.
+typedef struct JournalRecord {
+  /// Monotonic sequence number, compared against `Project.journal_seq` so that
+  /// records already folded into the project file are never replayed twice.
+  uint64_t seq;
+  /// The logged activity.
+  Activity activity;
+} JournalRecord;
+
+/// Appends an activity to a project's journal, dropping any torn tail first.
+/// Returns the number of records now in the journal.
+JournalError journal_append(ProjectId id, const Activity *activity,
+                            size_t *record_c_out);
+/// Appends every journal record newer than `project->journal_seq` to the
+/// project's activities, updating `journal_seq` to match.
+JournalError journal_replay(Project *project);
+/// Rewrites a project's journal so that it starts after `base_seq`, keeping any
+/// records that have not yet been folded into the project file. Returns the
+/// number of records kept.
+JournalError journal_reset(ProjectId id, unsigned long base_seq,
+                           size_t *kept_c_out);
+/// Removes a project's journal.
+JournalError journal_delete(ProjectId id);
+
+/// CRC-32 (IEEE) of a block of memory.
+uint32_t journal_checksum(const void *data, size_t length);
+
+#endif
@@ -1,26 +1,72 @@
 #include "activity.h"
 #include "balance.h"
+#include "cli.h"
 #include "filesystem.h"
 #include "menu.h"
+#include "money.h"
+#include "parallel.h"
 #include "preferences.h"
 #include "project.h"
+#include "server.h"
 
 #include <cyaml/cyaml.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-int main(void) {
+int main(int argc, char **argv) {
+  // Optional thread count for loading and aggregating projects, defaults to
+  // one per core
+  const char *threads = getenv("FREEMAN_THREADS");
+  if (threads) {
+    fs_set_load_threads(strtoul(threads, NULL, 10));
+    parallel_set_threads(strtoul(threads, NULL, 10));
+  }
+  // Optional exact integer money arithmetic for balances
+  if (getenv("FREEMAN_FIXED_POINT")) {
+    money_set_fixed_point(true);
+  }
+
   // Check that the filesystem is intact
   FileError error = fs_ensure();
   if (error) {
     printf("Something went wrong, file error %d\n", error);
   }
 
+  // Commands given on the command line run without any menus
+  if (argc > 1) {
+    if (!strcmp(argv[1], "serve")) {
+      ServerError server_error = server_run();
+      if (server_error) {
+        printf("Failed to serve (error %d)\n", server_error);
+      }
+      return server_error;
+    }
+
+    // Hand the command to the resident process if there is one, so that it
+    // answers from its warm caches
+    int status;
+    ServerError server_error = SERVER_CONNECT_ERROR;
+    if (!getenv("FREEMAN_NO_SERVER")) {
+      server_error = server_forward(argc - 1, argv + 1, &status);
+    }
+    if (server_error == SERVER_CONNECT_ERROR) {
+      return cli_run(argc - 1, argv + 1, stdin, stdout, stderr);
+    }
+    if (server_error) {
+      fprintf(stderr, "Lost connection to `freeman serve` (error %d)\n",
+              server_error);
+      return EXIT_FAILURE;
+    }
+    return status;
+  }
+
   // Main Menu
   MenuItem preferences_menu_item = {
       .default_prompt = "Update Preferences",
       .function = preferences_menu,
       .status_check = preferences_status,
+      .depends_on = MENU_DEPENDS_PREFERENCES,
       .item_data = NULL,
   };
 
@@ -28,6 +74,7 @@ int main(void) {
       .default_prompt = "Manage Projects",
       .item_data = NULL,
       .status_check = projects_status,
+      .depends_on = MENU_DEPENDS_PROJECTS,
       .function = projects_menu,
   };
 
@@ -35,6 +82,7 @@ int main(void) {
       .default_prompt = "Log Activity",
       .item_data = NULL,
       .status_check = new_activity_menu_status,
+      .depends_on = MENU_DEPENDS_PROJECTS,
       .function = new_activity_menu,
   };
 
@@ -56,5 +104,21 @@ int main(void) {
       .items = &items_pointer,
       .item_c = &item_c,
   };
-  return open_menu(&menu);
+  MenuError menu_error = open_menu(&menu);
+
+  // Report project cache effectiveness if asked to
+  if (getenv("FREEMAN_CACHE_STATS")) {
+    ProjectCacheStats stats = project_cache_stats();
+    printf("Project cache (%s): %zu hits, %zu misses, index %zu hits, %zu "
+           "misses, %zu invalidations\n",
+           stats.inotify ? "inotify" : "mtime", stats.hits, stats.misses,
+           stats.index_hits, stats.index_misses, stats.invalidations);
+
+    MenuStats menu = menu_stats();
+    printf("Menu status checks: %zu run, %zu cached over %zu frames (%zu on "
+           "the last frame)\n",
+           menu.checks, menu.cached, menu.frames, menu.frame_checks);
+  }
+
+  return menu_error;
 }
@@ -1,11 +1,117 @@
 #include "menu.h"
 
+#include "filesystem.h"
 #include "input.h"
+#include "project_cache.h"
 
 #include <stdio.h>
 #include <string.h>
 
-MenuError open_menu(Menu *menu) {
+/// Process-wide invalidation state, shared by every menu.
+static struct {
+  /// Ticks on every invalidation, cached statuses are stamped with it.
+  unsigned long clock;
+  /// Clock when each dependency was last invalidated, by flag bit.
+  unsigned long changed_at[MENU_DEPENDENCY_C];
+  /// Storage change counters when last polled, see `poll_changes`.
+  unsigned long project_changes;
+  unsigned long preference_changes;
+  MenuStats stats;
+} menu_state = {.clock = 1};
+
+/// Marks cached statuses depending on any of the `MenuDependency` flags stale,
+/// in every menu.
+static void invalidate(unsigned int dependencies) {
+  menu_state.clock++;
+  for (int i = 0; i < MENU_DEPENDENCY_C; i++) {
+    if (dependencies & (1u << i)) {
+      menu_state.changed_at[i] = menu_state.clock;
+    }
+  }
+}
+
+/// Invalidates whatever the storage layer reports changed since the last poll,
+/// whether by this process or another.
+static void poll_changes(void) {
+  unsigned long project_changes = project_cache_changes();
+  if (project_changes != menu_state.project_changes) {
+    menu_state.project_changes = project_changes;
+    invalidate(MENU_DEPENDS_PROJECTS);
+  }
+
+  unsigned long preference_changes = fs_preferences_changes();
+  if (preference_changes != menu_state.preference_changes) {
+    menu_state.preference_changes = preference_changes;
+    invalidate(MENU_DEPENDS_PREFERENCES);
+  }
+}
+
+/// Has anything an entry depends on changed since it was checked?
+static bool entry_stale(const MenuStatusCache *cache,
+                        const MenuStatusEntry *entry, const MenuItem *item) {
+  if (!item->depends_on || !entry->checked_at ||
+      entry->status_check != item->status_check ||
+      entry->item_data != item->item_data) {
+    return true;
+  }
+
+  if ((item->depends_on & MENU_DEPENDS_MENU_DATA) &&
+      cache->data_changed_at > entry->checked_at) {
+    return true;
+  }
+
+  for (int i = 0; i < MENU_DEPENDENCY_C; i++) {
+    if ((item->depends_on & (1u << i)) &&
+        menu_state.changed_at[i] > entry->checked_at) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// Gets an item's status, only running its check if the cached one is stale.
+static ItemStatus item_status(Menu *menu, size_t position) {
+  MenuItem *item = *menu->items + position;
+  MenuStatusCache *cache = &menu->cache;
+
+  // Rebuilt items are matched to nothing cached before
+  unsigned long items_version = menu->items_version ? *menu->items_version : 0;
+  if (items_version != cache->items_version) {
+    if (cache->entries) {
+      memset(cache->entries, 0, sizeof(MenuStatusEntry) * cache->entry_c);
+    }
+    cache->items_version = items_version;
+  }
+
+  // Items can be added or removed between redraws, keep one entry per item
+  if (cache->entry_c < *menu->item_c) {
+    cache->entries = realloc(cache->entries,
+                             sizeof(MenuStatusEntry) * *menu->item_c);
+    memset(cache->entries + cache->entry_c, 0,
+           sizeof(MenuStatusEntry) * (*menu->item_c - cache->entry_c));
+    cache->entry_c = *menu->item_c;
+  }
+
+  MenuStatusEntry *entry = cache->entries + position;
+  if (!entry_stale(cache, entry, item)) {
+    menu_state.stats.cached++;
+    return entry->status;
+  }
+
+  menu_state.stats.checks++;
+  menu_state.stats.frame_checks++;
+  *entry = (MenuStatusEntry){
+      .status_check = item->status_check,
+      .item_data = item->item_data,
+      .checked_at = menu_state.clock,
+      .status = item->status_check(menu->menu_data, item->item_data),
+  };
+  return entry->status;
+}
+
+/// Runs a menu until it is exited.
+static MenuError run_menu(Menu *menu) {
   while (true) {
     // Print menu
     if (display_menu(menu)) {
@@ -28,15 +134,20 @@ MenuError open_menu(Menu *menu) {
     ItemStatus status;
     bool available = true;
 
-    // Check status, if applicable
+    // Check status, if applicable. Anything may have changed while waiting.
     if (item->status_check) {
-      status = item->status_check(menu->menu_data, item->item_data);
+      poll_changes();
+      status = item_status(menu, choice);
       available = status.available;
     }
 
     // Call if available, otherwise display an error
     if (available) {
       MenuError error = item->function(menu->menu_data, item->item_data);
+
+      // Items are free to change the menu's data
+      menu->cache.data_changed_at = ++menu_state.clock;
+
       if (error == MENU_EXIT) {
         // Quit menu automatically if `MENU_EXIT` signal received by item
         return MENU_OK;
@@ -54,7 +165,20 @@ MenuError open_menu(Menu *menu) {
   return MENU_OK;
 }
 
+MenuError open_menu(Menu *menu) {
+  MenuError error = run_menu(menu);
+
+  free(menu->cache.entries);
+  menu->cache = (MenuStatusCache){0};
+
+  return error;
+}
+
 MenuError display_menu(Menu *menu) {
+  menu_state.stats.frames++;
+  menu_state.stats.frame_checks = 0;
+  poll_changes();
+
   // Menu title
   printf("\n= %s =\n", menu->title);
 
@@ -70,8 +194,8 @@ MenuError display_menu(Menu *menu) {
     sprintf(marker, "%d", i + 1);
 
     if (item->status_check) {
-      // Call status check if applicable
-      ItemStatus status = item->status_check(menu->menu_data, item->item_data);
+      // Call status check if applicable (and stale)
+      ItemStatus status = item_status(menu, i);
 
       if (!status.available) {
         // Change marker if item is unavailable
@@ -111,3 +235,5 @@ MenuError get_menu_choice(size_t item_c, int *choice_out) {
 
   return MENU_OK;
 }
+
+MenuStats menu_stats(void) { return menu_state.stats; }
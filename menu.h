@@ -26,6 +26,21 @@ typedef struct ItemStatus {
   char prompt[PROMPT_SIZE];
 } ItemStatus;
 
+/// What a menu item's status check reads, so that its result can be cached
+/// until one of them changes. Combined as bit flags. Projects and preferences
+/// are polled for changes from the storage layer on every redraw.
+typedef enum MenuDependency {
+  /// Any project file or the project list.
+  MENU_DEPENDS_PROJECTS = 1 << 0,
+  /// The preferences file.
+  MENU_DEPENDS_PREFERENCES = 1 << 1,
+  /// The menu's own `menu_data`, invalidated every time one of its items runs.
+  MENU_DEPENDS_MENU_DATA = 1 << 2,
+} MenuDependency;
+
+/// Number of `MenuDependency` flags.
+#define MENU_DEPENDENCY_C (3)
+
 /// Function pointer to get the current status of a menu item.
 typedef ItemStatus (*StatusCheckFn)(void *menu_data, void *item_data);
 /// Function pointer to execute a menu item.
@@ -43,8 +58,32 @@ typedef struct MenuItem {
   /// (Optional) Data to pass to this menu item specifically. Useful when
   /// sharing functions for multiple menu items.
   void *item_data;
+  /// (Optional) `MenuDependency` flags of everything the status check reads.
+  /// Its result is reused until one of them is invalidated, if none are given
+  /// it is checked on every redraw.
+  unsigned int depends_on;
 } MenuItem;
 
+/// A status check result kept between redraws.
+typedef struct MenuStatusEntry {
+  /// Identifies the item the status belongs to, in case items change.
+  StatusCheckFn status_check;
+  void *item_data;
+  /// Invalidation clock when the check ran, 0 if it never has.
+  unsigned long checked_at;
+  ItemStatus status;
+} MenuStatusEntry;
+
+/// Cached item statuses of an open menu, by item index.
+typedef struct MenuStatusCache {
+  MenuStatusEntry *entries;
+  size_t entry_c;
+  /// Invalidation clock when the menu's data last changed.
+  unsigned long data_changed_at;
+  /// `items_version` the entries were checked against.
+  unsigned long items_version;
+} MenuStatusCache;
+
 /// A menu, contains any number of menu items and some arbitrary
 /// data that is passed to each item function.
 typedef struct Menu {
@@ -54,16 +93,37 @@ typedef struct Menu {
   MenuItem **items;
   /// Pointer to item count.
   size_t *item_c;
+  /// (Optional) Pointer to a counter bumped every time `items` is rebuilt,
+  /// which drops every cached status. Needed if items are reallocated, as new
+  /// items can reuse the addresses of freed `item_data`.
+  unsigned long *items_version;
 
   /// (Optional) Shared data to pass between menu items.
   void *menu_data;
+
+  /// Managed by `open_menu`, leave zeroed.
+  MenuStatusCache cache;
 } Menu;
 
+/// Status check counters, across every menu.
+typedef struct MenuStats {
+  /// Menus drawn.
+  size_t frames;
+  /// Status checks run, including before calling an item.
+  size_t checks;
+  /// Statuses reused from the cache instead.
+  size_t cached;
+  /// Status checks run while drawing the latest menu.
+  size_t frame_checks;
+} MenuStats;
+
 /// Opens a menu.
 MenuError open_menu(Menu *menu);
 /// Prints out a menu to stdout.
 MenuError display_menu(Menu *menu);
 /// Reads and validates a menu selection from stin.
 MenuError get_menu_choice(size_t item_c, int *choice_out);
+/// Counters for status checks run and reused so far.
+MenuStats menu_stats(void);
 
 #endif
@@ -0,0 +1,36 @@
+#include "money.h"
+
+/// Process-wide, set once at startup.
+static bool fixed_point = false;
+
+bool money_fixed_point(void) { return fixed_point; }
+
+void money_set_fixed_point(bool enabled) { fixed_point = enabled; }
+
+bool money_from_pounds(double pounds, Pence *pence_out) {
+  double scaled = pounds * 100;
+  Pence pence = (Pence)(scaled + (scaled >= 0 ? 0.5 : -0.5));
+
+  *pence_out = pence;
+
+  // Doubles read from YAML are the nearest to some decimal, which is exactly
+  // what dividing back gives if that decimal had at most two places
+  return money_to_pounds(pence) == pounds;
+}
+
+double money_to_pounds(Pence pence) { return (double)pence / 100; }
+
+bool money_earnings(Pence rate, uint64_t minutes, MoneyTicks *ticks_out) {
+  if (minutes > INT64_MAX) {
+    return false;
+  }
+  return !__builtin_mul_overflow(rate, (int64_t)minutes, ticks_out);
+}
+
+Pence money_ticks_to_pence(MoneyTicks ticks) {
+  MoneyTicks half = MONEY_TICKS_PER_PENNY / 2;
+  if (ticks >= 0) {
+    return (ticks + half) / MONEY_TICKS_PER_PENNY;
+  }
+  return -((-ticks + half) / MONEY_TICKS_PER_PENNY);
+}
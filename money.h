@@ -0,0 +1,34 @@
+#ifndef MONEY_H_
+#define MONEY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Earnings ticks in a penny, one tick being a penny-per-hour rate worked for
+/// a minute.
+#define MONEY_TICKS_PER_PENNY (60)
+
+/// An amount of money in pence.
+typedef int64_t Pence;
+/// Exact earnings, in sixtieths of a penny. A whole-pence hourly rate times a
+/// whole number of minutes is always a whole number of ticks, so sums of them
+/// never round.
+typedef int64_t MoneyTicks;
+
+/// Is fixed-point mode on? Balances are then calculated and reported from
+/// exact integer totals rather than doubles. Off by default.
+bool money_fixed_point(void);
+/// Turns fixed-point mode on or off.
+void money_set_fixed_point(bool enabled);
+
+/// Converts pounds to the nearest whole pence, returning false if that loses
+/// precision (the amount does not round-trip).
+bool money_from_pounds(double pounds, Pence *pence_out);
+/// Converts pence to pounds, exact for any realistic amount.
+double money_to_pounds(Pence pence);
+/// Earnings for working `minutes` at an hourly rate, false on overflow.
+bool money_earnings(Pence rate, uint64_t minutes, MoneyTicks *ticks_out);
+/// Rounds earnings to the nearest penny, halves away from zero.
+Pence money_ticks_to_pence(MoneyTicks ticks);
+
+#endif
@@ -0,0 +1,175 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/// Number of threads used, 0 meaning one per core.
+static unsigned int thread_c_setting = 0;
+
+void parallel_set_threads(unsigned int thread_c) {
+  thread_c_setting = thread_c;
+}
+
+ParallelChunk *parallel_activity_chunks(const size_t *activity_cs,
+                                        size_t project_c, size_t *chunk_c_out) {
+  size_t chunk_c = 0;
+  for (size_t i = 0; i < project_c; i++) {
+    chunk_c += (activity_cs[i] + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+  }
+
+  ParallelChunk *chunks =
+      malloc(sizeof(ParallelChunk) * (chunk_c ? chunk_c : 1));
+  size_t chunk = 0, offset = 0;
+  for (size_t i = 0; i < project_c; i++) {
+    for (size_t first = 0; first < activity_cs[i];
+         first += PARALLEL_CHUNK_SIZE) {
+      size_t last = first + PARALLEL_CHUNK_SIZE;
+      if (last > activity_cs[i]) {
+        last = activity_cs[i];
+      }
+
+      chunks[chunk++] = (ParallelChunk){
+          .project = i,
+          .first = first,
+          .last = last,
+          .offset = offset,
+      };
+      offset += last - first;
+    }
+  }
+
+  *chunk_c_out = chunk_c;
+  return chunks;
+}
+
+/// Chunks `[next, end)` still to be run by a thread, taken from the front by
+/// the owner and from the back by thieves.
+typedef struct WorkQueue {
+  pthread_mutex_t lock;
+  size_t next;
+  size_t end;
+} WorkQueue;
+
+/// Work shared between threads.
+typedef struct ParallelJob {
+  ParallelFn fn;
+  void *context;
+  WorkQueue *queues;
+  long queue_c;
+} ParallelJob;
+
+/// A single thread's view of the job.
+typedef struct ParallelWorker {
+  ParallelJob *job;
+  long index;
+} ParallelWorker;
+
+/// Takes the next chunk from a thread's own queue.
+static bool take_chunk(WorkQueue *queue, size_t *chunk_out) {
+  pthread_mutex_lock(&queue->lock);
+  bool taken = queue->next < queue->end;
+  if (taken) {
+    *chunk_out = queue->next++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return taken;
+}
+
+/// Moves the back half of another thread's remaining chunks into an (empty)
+/// queue, returning false once every queue is empty.
+static bool steal_chunks(ParallelJob *job, long thief) {
+  for (long i = 1; i < job->queue_c; i++) {
+    WorkQueue *victim = job->queues + (thief + i) % job->queue_c;
+
+    pthread_mutex_lock(&victim->lock);
+    size_t remaining = victim->end - victim->next;
+    size_t stolen_end = victim->end;
+    victim->end -= (remaining + 1) / 2;
+    size_t stolen_next = victim->end;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (stolen_next < stolen_end) {
+      WorkQueue *queue = job->queues + thief;
+      pthread_mutex_lock(&queue->lock);
+      queue->next = stolen_next;
+      queue->end = stolen_end;
+      pthread_mutex_unlock(&queue->lock);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// Worker loop, runs its own chunks and then steals until nothing is left.
+static void *parallel_worker(void *_worker) {
+  ParallelWorker *worker = _worker;
+  ParallelJob *job = worker->job;
+  WorkQueue *queue = job->queues + worker->index;
+
+  do {
+    size_t chunk;
+    while (take_chunk(queue, &chunk)) {
+      job->fn(job->context, chunk);
+    }
+  } while (steal_chunks(job, worker->index));
+
+  return NULL;
+}
+
+void parallel_run(size_t chunk_c, ParallelFn fn, void *context) {
+  // One thread per core by default, never more threads than chunks
+  long thread_c = thread_c_setting;
+  if (!thread_c) {
+    thread_c = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (thread_c > 0 && (size_t)thread_c > chunk_c) {
+    thread_c = chunk_c;
+  }
+
+  // Not worth any threads, run everything here in order
+  if (thread_c <= 1) {
+    for (size_t i = 0; i < chunk_c; i++) {
+      fn(context, i);
+    }
+    return;
+  }
+
+  // Start each thread on an equal, contiguous share
+  ParallelJob job = {
+      .fn = fn,
+      .context = context,
+      .queues = malloc(sizeof(WorkQueue) * thread_c),
+      .queue_c = thread_c,
+  };
+  ParallelWorker *workers = malloc(sizeof(ParallelWorker) * thread_c);
+  for (long i = 0; i < thread_c; i++) {
+    pthread_mutex_init(&job.queues[i].lock, NULL);
+    job.queues[i].next = chunk_c * i / thread_c;
+    job.queues[i].end = chunk_c * (i + 1) / thread_c;
+    workers[i] = (ParallelWorker){.job = &job, .index = i};
+  }
+
+  // This thread is a worker too, any share whose thread fails to start is
+  // stolen by the rest
+  pthread_t *threads = malloc(sizeof(pthread_t) * (thread_c - 1));
+  long started_c = 0;
+  while (started_c < thread_c - 1 &&
+         !pthread_create(threads + started_c, NULL, parallel_worker,
+                         workers + started_c + 1)) {
+    started_c++;
+  }
+  parallel_worker(workers);
+  for (long i = 0; i < started_c; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (long i = 0; i < thread_c; i++) {
+    pthread_mutex_destroy(&job.queues[i].lock);
+  }
+  free(threads);
+  free(workers);
+  free(job.queues);
+}
@@ -0,0 +1,40 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <stddef.h>
+
+/// Most activities in a chunk of parallel work. Chunk boundaries depend only on
+/// the projects, never on the thread count, so results merged in chunk order
+/// are the same on every run.
+#define PARALLEL_CHUNK_SIZE (8192)
+
+/// A run of activities from one project.
+typedef struct ParallelChunk {
+  /// Index into the project list the chunks were built from.
+  size_t project;
+  /// Activity range `[first, last)` within the project.
+  size_t first;
+  size_t last;
+  /// Activities in every chunk before this one, for writing results in order.
+  size_t offset;
+} ParallelChunk;
+
+/// Processes one chunk, given its index.
+typedef void (*ParallelFn)(void *context, size_t chunk);
+
+/// Sets how many threads `parallel_run` uses, 0 (the default) meaning one per
+/// core.
+void parallel_set_threads(unsigned int thread_c);
+/// Splits the activities of a list of projects, given how many each has, into
+/// chunks of at most `PARALLEL_CHUNK_SIZE`, in project order. Returns an owned
+/// array.
+ParallelChunk *parallel_activity_chunks(const size_t *activity_cs,
+                                        size_t project_c, size_t *chunk_c_out);
+/// Calls `fn` once for every chunk in `[0, chunk_c)`, spread over a pool of
+/// threads. Each thread starts on its own contiguous share of chunks and,
+/// once out, steals half of whatever another thread has left, so a few huge
+/// projects still balance. Chunks may run in any order and concurrently, so
+/// `fn` should only write to per-chunk results.
+void parallel_run(size_t chunk_c, ParallelFn fn, void *context);
+
+#endif
@@ -61,6 +61,7 @@ MenuError preferences_menu(void *_menu_data, void *_item_data) {
       .default_prompt = "Set " display,                                        \
       .function = (MenuItemFn)update_##symbol,                                 \
       .status_check = (StatusCheckFn)symbol##_status,                          \
+      .depends_on = MENU_DEPENDS_MENU_DATA,                                    \
   };
   PREFERENCES_TABLE
 #undef X
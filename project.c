@@ -18,28 +18,23 @@ ItemStatus projects_status(void *_menu_data, void *_item_data) {
       .prompt = {0},
   };
 
-  // Load project list
-  Project **projects;
-  size_t project_c;
-  FileError error = fs_get_project_list(&projects, &project_c);
+  // Load project index, no need to parse every project just to count them
+  ProjectIndex index;
+  FileError error = fs_get_project_index(&index);
   if (error) {
     sprintf(status.prompt, "Error reading project list (FileError %d)", error);
     return status;
   }
 
   // Show project count if greater than 0
-  if (project_c) {
-    sprintf(status.prompt, "Manage Projects (%zu)", project_c);
+  if (index.entry_c) {
+    sprintf(status.prompt, "Manage Projects (%zu)", index.entry_c);
   } else {
     sprintf(status.prompt, "Add a Project!");
   }
 
-  // Free project list
-  error = fs_free_project_list(projects, project_c);
-  if (error) {
-    sprintf(status.prompt, "Error freeing project list (FileError %d)", error);
-    return status;
-  }
+  // Free project index
+  project_index_free(&index);
 
   return status;
 }
@@ -62,6 +57,7 @@ MenuError projects_menu(void *_menu_data, void *_item_data) {
       .menu_data = &menu_data,
       .items = &menu_data.menu_items,
       .item_c = &menu_data.item_c,
+      .items_version = &menu_data.items_version,
       .title = "Manage Projects",
   };
   PROPAGATE(MenuError, open_menu, (&menu));
@@ -74,6 +70,17 @@ MenuError projects_menu(void *_menu_data, void *_item_data) {
 
 MenuError project_item_menu(ProjectMenuData *menu_data,
                             ProjectMenuItemData *item_data) {
+  // Projects are listed header-only, load this one's activities before
+  // editing so that saving keeps them
+  Activity *activities;
+  size_t activity_c;
+  FileError error =
+      fs_get_activities(item_data->project, &activities, &activity_c);
+  if (error) {
+    printf("Failed to load project activities (FileError %d)\n", error);
+    return MENU_ITEM_ERROR;
+  }
+
   // Make temporary copy so that changes must be saved manually
   Project project = *item_data->project;
 
@@ -82,6 +89,7 @@ MenuError project_item_menu(ProjectMenuData *menu_data,
       .function = (MenuItemFn)project_name,
       .default_prompt = "Update Name",
       .status_check = (StatusCheckFn)project_name_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem default_rate_item = {
@@ -89,6 +97,7 @@ MenuError project_item_menu(ProjectMenuData *menu_data,
       .function = (MenuItemFn)project_default_rate,
       .default_prompt = "Update Default Rate",
       .status_check = (StatusCheckFn)project_default_rate_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem list_activities_item = {
@@ -103,6 +112,7 @@ MenuError project_item_menu(ProjectMenuData *menu_data,
       .function = (MenuItemFn)project_commit,
       .default_prompt = "Save and Exit",
       .status_check = (StatusCheckFn)project_commit_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem delete_item = {
@@ -129,22 +139,27 @@ MenuError project_item_menu(ProjectMenuData *menu_data,
 }
 
 MenuError add_project(ProjectMenuData *menu_data, void *_item_data) {
-  // Find next unused ID for new project
-  ProjectId id = PROJECT_START_ID;
-  for (int i = 0; i < menu_data->project_c; i++) {
-    Project *project = menu_data->projects[i];
-    ProjectId project_id = project->id;
+  // Find next unused ID for new project, the index tracks the largest in use
+  ProjectIndex index;
+  FileError error = fs_get_project_index(&index);
+  if (error) {
+    printf("Failed to read project index (FileError %d)\n", error);
+    return MENU_ITEM_ERROR;
+  }
 
-    if (project_id >= id) {
-      id = project_id + 1;
-    }
+  ProjectId id = PROJECT_START_ID;
+  if (index.max_id >= id) {
+    id = index.max_id + 1;
   }
 
+  project_index_free(&index);
+
   Project project = {
       .id = id,
       .name = {0},
       .activities = NULL,
       .activity_c = 0,
+      .activities_loaded = true, // Nothing to load for a new project
       .default_rate = 0.0,
   };
 
@@ -153,6 +168,7 @@ MenuError add_project(ProjectMenuData *menu_data, void *_item_data) {
       .function = (MenuItemFn)project_name,
       .default_prompt = "Set Name",
       .status_check = (StatusCheckFn)project_name_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem default_rate_item = {
@@ -160,6 +176,7 @@ MenuError add_project(ProjectMenuData *menu_data, void *_item_data) {
       .function = (MenuItemFn)project_default_rate,
       .default_prompt = "Set Default Rate",
       .status_check = (StatusCheckFn)project_default_rate_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem commit_item = {
@@ -167,6 +184,7 @@ MenuError add_project(ProjectMenuData *menu_data, void *_item_data) {
       .function = (MenuItemFn)project_commit,
       .default_prompt = "Save Project",
       .status_check = (StatusCheckFn)project_commit_status,
+      .depends_on = MENU_DEPENDS_MENU_DATA,
   };
 
   MenuItem items[] = {name_item, default_rate_item, commit_item};
@@ -226,9 +244,51 @@ ItemStatus project_default_rate_status(Project *project, void *_item_data) {
   return status;
 }
 
+/// Saves a project after `fs_save_project` found it had changed on disk.
+/// Projects no longer in the index were deleted meanwhile (or never saved) and
+/// are saved again as new. New projects that lost their ID to another one take
+/// the next free ID. Edited projects are reloaded, keeping whatever else was
+/// saved or logged, and this menu's name and rate are applied on top.
+static FileError project_merge(Project *project) {
+  ProjectIndex index;
+  PROPAGATE(FileError, fs_get_project_index, (&index));
+  bool indexed = project_index_find(&index, project->id);
+  ProjectId next_id =
+      index.max_id >= project->id ? index.max_id + 1 : project->id + 1;
+  project_index_free(&index);
+
+  if (!indexed) {
+    project->version = 0;
+    return fs_save_project(*project);
+  }
+  if (!project->version) {
+    project->id = next_id;
+    return fs_save_project(*project);
+  }
+
+  Project *current;
+  PROPAGATE(FileError, fs_load_project, (project->id, &current));
+  memcpy(current->name, project->name, sizeof(current->name));
+  current->default_rate = project->default_rate;
+
+  FileError error = fs_save_project(*current);
+  FileError free_error = fs_free_project(current);
+  return error ? error : free_error;
+}
+
 MenuError project_commit(Project *project, ProjectMenuData *project_menu_data) {
   FileError error = fs_save_project(*project);
 
+  // Someone else wrote the project while this menu was open
+  for (int attempt = 1;
+       error == FILE_CONFLICT_ERROR && attempt < PROJECT_COMMIT_ATTEMPTS;
+       attempt++) {
+    error = project_merge(project);
+  }
+  if (error) {
+    printf("Failed to save project (FileError %d)\n", error);
+  }
+
   // Reload all projects and menu items after saving
   PROPAGATE(MenuError, reload_projects, (project_menu_data));
 
@@ -259,6 +319,9 @@ MenuError project_delete(Project *project, ProjectMenuData *project_menu_data) {
   }
 
   FileError error = fs_delete_project(*project);
+  if (error) {
+    printf("Failed to delete project (FileError %d)\n", error);
+  }
 
   // Reload projects and items after modifying filesystem
   PROPAGATE(MenuError, reload_projects, (project_menu_data));
@@ -306,15 +369,17 @@ MenuError reload_projects(ProjectMenuData *menu_data) {
     PROPAGATE(MenuError, free_project_menu, (menu_data));
   }
 
-  // Load new project list
+  // Load new project list, header-only as activities are only needed once a
+  // project is opened
   FileError error =
-      fs_get_project_list(&menu_data->projects, &menu_data->project_c);
+      fs_get_project_headers(&menu_data->projects, &menu_data->project_c);
   if (error) {
     printf("Failed to read project list (FileError %d)\n", error);
     return MENU_ITEM_ERROR;
   }
 
-  // Allocate menu item arrays
+  // Allocate menu item arrays, statuses cached for the old ones are dropped
+  menu_data->items_version++;
   menu_data->item_c = menu_data->project_c + 1;
   menu_data->menu_items = calloc(menu_data->item_c, sizeof(MenuItem));
   menu_data->menu_item_data = calloc(menu_data->project_c, sizeof(MenuItem));
@@ -344,11 +409,20 @@ MenuError reload_projects(ProjectMenuData *menu_data) {
 }
 
 MenuError project_list_activities(Project *project, void *_item_data) {
-  // Iterate over activities (if applicable) and display each one
-  if (project->activity_c) {
-    for (int i = 0; i < project->activity_c; i++) {
-      Activity *activity = project->activities + i;
-      ActivityError error = display_activity(*activity);
+  Activity *activities;
+  size_t activity_c;
+  FileError file_error = fs_get_activities(project, &activities, &activity_c);
+  if (file_error) {
+    printf("Failed to load activities (FileError %d)\n", file_error);
+    return MENU_ITEM_ERROR;
+  }
+
+  // Iterate over activities (if applicable) and display each one, all of
+  // which belong to this project
+  if (activity_c) {
+    for (size_t i = 0; i < activity_c; i++) {
+      Activity *activity = activities + i;
+      ActivityError error = display_project_activity(*activity, project);
       if (error) {
         printf("Failed to log activity %s (error %d)", activity->description,
                error);
@@ -362,3 +436,36 @@ MenuError project_list_activities(Project *project, void *_item_data) {
 
   return MENU_OK;
 }
+
+static int compare_project_ids(const void *a, const void *b) {
+  const Project *project_a = *(Project *const *)a;
+  const Project *project_b = *(Project *const *)b;
+  return (project_a->id > project_b->id) - (project_a->id < project_b->id);
+}
+
+void project_lookup_build(Project **projects, size_t project_c,
+                          ProjectLookup *lookup_out) {
+  // Sorted copy of the pointer array, the list itself is left untouched
+  lookup_out->projects = malloc(sizeof(Project *) * (project_c ? project_c : 1));
+  memcpy(lookup_out->projects, projects, sizeof(Project *) * project_c);
+  lookup_out->project_c = project_c;
+
+  qsort(lookup_out->projects, project_c, sizeof(Project *),
+        compare_project_ids);
+}
+
+Project *project_lookup_find(const ProjectLookup *lookup, ProjectId id) {
+  Project key = {.id = id};
+  Project *key_pointer = &key;
+  Project **found =
+      bsearch(&key_pointer, lookup->projects, lookup->project_c,
+              sizeof(Project *), compare_project_ids);
+
+  return found ? *found : NULL;
+}
+
+void project_lookup_free(ProjectLookup *lookup) {
+  free(lookup->projects);
+  lookup->projects = NULL;
+  lookup->project_c = 0;
+}
@@ -2,15 +2,32 @@
 #define PROJECT_H_
 
 #include "activity.h"
+#include "arena.h"
 #include "menu.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #define PROJECT_START_ID (1000);
+/// Times a save that lost a race with another writer is merged and retried.
+#define PROJECT_COMMIT_ATTEMPTS (8)
+
+// Defined in snapshot.h, which depends on this header
+typedef struct SnapshotPartition SnapshotPartition;
 
 /// Unique ID and filename stem for a project.
 typedef unsigned long ProjectId;
 
+/// Serialised fields of `Project` in file order, as `X(kind, symbol)`, see
+/// `ACTIVITY_TABLE`.
+#define PROJECT_TABLE                                                          \
+  X(UINT, id)                                                                  \
+  X(STRING, name)                                                              \
+  X(DOUBLE, default_rate)                                                      \
+  X(ACTIVITIES, activities)                                                    \
+  X(UINT, journal_seq)                                                         \
+  X(UINT, version)
+
 /// A project, collects a group of related activities.
 typedef struct Project {
   /// Unique ID of the project
@@ -21,11 +38,52 @@ typedef struct Project {
   /// Default hourly rate
   double default_rate;
 
-  /// List of logged activities for this project
+  /// List of logged activities for this project, sorted by time once loaded
+  ///
+  /// Not loaded for header-only projects (see `fs_get_project_headers`), use
+  /// `fs_get_activities` unless the project is known to be fully loaded.
   Activity *activities;
   size_t activity_c;
+  /// Have `activities` been loaded yet? Never serialised.
+  bool activities_loaded;
+
+  /// Sequence number of the last journal record folded into this project, see
+  /// `journal.h`.
+  unsigned long journal_seq;
+  /// Number of times the project file has been written, 0 if it never has.
+  /// Saving a copy older than the file fails rather than overwriting it.
+  unsigned long version;
+
+  /// Arena holding this project's memory, shared by every project in a
+  /// loaded list. Never serialised.
+  Arena *arena;
+  /// Private snapshot mapping that `activities` points into, if any.
+  void *mapping;
+  /// Size of `mapping` in bytes, including room to append activities.
+  size_t mapping_size;
+  /// Monthly partitions covering the start of `activities` (anything after
+  /// them came from the journal), see `snapshot.h`. Empty if the project was
+  /// loaded from YAML. Never serialised.
+  const SnapshotPartition *partitions;
+  size_t partition_c;
 } Project;
 
+/// ID to project lookup table over an already-loaded project list, built once
+/// per listing or balance run instead of loading projects per activity.
+typedef struct ProjectLookup {
+  /// Borrowed project pointers, sorted by ID.
+  Project **projects;
+  size_t project_c;
+} ProjectLookup;
+
+/// Builds a lookup table over a project list, which must outlive it.
+void project_lookup_build(Project **projects, size_t project_c,
+                          ProjectLookup *lookup_out);
+/// Finds a project by ID, returning NULL if it is not in the list.
+Project *project_lookup_find(const ProjectLookup *lookup, ProjectId id);
+/// Frees a lookup table (but not the projects it points to).
+void project_lookup_free(ProjectLookup *lookup);
+
 /// Project management menu.
 MenuError projects_menu(void *_menu_data, void *_item_data);
 /// Status check for project menu.
@@ -52,6 +110,8 @@ typedef struct ProjectMenuData {
   ProjectMenuItemData *menu_item_data;
   /// Item count.
   size_t item_c;
+  /// Bumped every time the items are rebuilt, see `Menu`.
+  unsigned long items_version;
 } ProjectMenuData;
 
 /// Frees the projects and menu items from the project menu data struct.
@@ -0,0 +1,326 @@
+#include "project_cache.h"
+
+#include "filesystem.h"
+#include "journal.h"
+#include "snapshot.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Size and modification time of one of a project's files, all zero if the file
+/// does not exist.
+typedef struct FileStamp {
+  off_t size;
+  struct timespec mtime;
+} FileStamp;
+
+/// A cached project.
+typedef struct CacheEntry {
+  Project *project;
+  /// Views currently handed out.
+  size_t refs;
+  /// Files have changed since loading, free once the last view is released.
+  bool stale;
+  /// YAML, snapshot and journal stamps when loaded, for the mtime fallback.
+  FileStamp stamps[3];
+} CacheEntry;
+
+/// All process-wide cache state.
+static struct {
+  /// Has the inotify watch been attempted yet?
+  bool initialised;
+  /// inotify descriptor watching the projects directory, -1 if unavailable.
+  int inotify_fd;
+
+  CacheEntry *entries;
+  size_t entry_c;
+  /// Stamps taken by the last miss, before the caller loaded the project, so
+  /// that a write during the load is still noticed.
+  ProjectId miss_id;
+  FileStamp miss_stamps[3];
+
+  /// Cached project index, only trusted while inotify is watching.
+  ProjectIndex index;
+  bool index_valid;
+
+  /// Changes seen so far, see `project_cache_changes`.
+  unsigned long change_c;
+  /// Projects directory and index stamps when last polled, for the mtime
+  /// fallback.
+  FileStamp poll_stamps[2];
+
+  ProjectCacheStats stats;
+} cache = {.inotify_fd = -1};
+
+static void stamp_path(const char *path, FileStamp *stamp_out) {
+  struct stat st;
+  *stamp_out = (FileStamp){0};
+  if (!stat(path, &st)) {
+    stamp_out->size = st.st_size;
+    stamp_out->mtime = st.st_mtim;
+  }
+}
+
+static void stamp_files(ProjectId id, FileStamp stamps_out[3]) {
+  static const char *EXTENSIONS[] = {"yaml", SNAPSHOT_EXTENSION,
+                                     JOURNAL_EXTENSION};
+
+  memset(stamps_out, 0, sizeof(FileStamp) * 3);
+  for (int i = 0; i < 3; i++) {
+    Filepath path;
+    if (!fs_get_project_file(id, EXTENSIONS[i], path)) {
+      stamp_path(path, stamps_out + i);
+    }
+  }
+}
+
+/// Removes an entry, freeing its project.
+static void remove_entry(size_t position) {
+  fs_free_project(cache.entries[position].project);
+  memmove(cache.entries + position, cache.entries + position + 1,
+          sizeof(CacheEntry) * (cache.entry_c - position - 1));
+  cache.entry_c--;
+}
+
+/// Marks an entry stale, removing it straight away if no views are out.
+static void invalidate_entry(size_t position) {
+  cache.stats.invalidations++;
+  if (cache.entries[position].refs) {
+    cache.entries[position].stale = true;
+  } else {
+    remove_entry(position);
+  }
+}
+
+static void invalidate_id(ProjectId id) {
+  size_t i = 0;
+  while (i < cache.entry_c) {
+    CacheEntry *entry = cache.entries + i;
+    if (entry->project->id == id && !entry->stale) {
+      size_t entry_c = cache.entry_c;
+      invalidate_entry(i);
+      if (cache.entry_c < entry_c) {
+        continue; // Removed, next entry has shifted into this position
+      }
+    }
+    i++;
+  }
+}
+
+static void invalidate_all(void) {
+  size_t i = 0;
+  while (i < cache.entry_c) {
+    size_t entry_c = cache.entry_c;
+    if (!cache.entries[i].stale) {
+      invalidate_entry(i);
+    }
+    if (cache.entry_c == entry_c) {
+      i++;
+    }
+  }
+  cache.index_valid = false;
+}
+
+/// Starts watching the projects directory, falling back to mtime checks if
+/// inotify is unavailable.
+static void initialise(void) {
+  if (cache.initialised) {
+    return;
+  }
+  cache.initialised = true;
+
+  Filepath projects_dir;
+  if (fs_expand_from_home(PROJECTS_DIRECTORY, projects_dir)) {
+    return;
+  }
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  if (inotify_add_watch(fd, projects_dir,
+                        IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                            IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+    close(fd);
+    return;
+  }
+
+  cache.inotify_fd = fd;
+  cache.stats.inotify = true;
+}
+
+/// Applies any pending inotify events, invalidating the affected projects.
+static void drain_events(void) {
+  if (cache.inotify_fd < 0) {
+    return;
+  }
+
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (true) {
+    ssize_t length = read(cache.inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break; // EAGAIN, nothing more to read
+    }
+
+    for (char *position = buffer; position < buffer + length;) {
+      struct inotify_event *event = (struct inotify_event *)position;
+      position += sizeof(struct inotify_event) + event->len;
+      cache.change_c++;
+
+      // Lost events, nothing can be trusted
+      if (event->mask & IN_Q_OVERFLOW) {
+        invalidate_all();
+        continue;
+      }
+
+      // Any change to the directory may change the index
+      cache.index_valid = false;
+
+      // Filename stem is the project ID, for every kind of project file
+      if (event->len) {
+        char *stem_end;
+        ProjectId id = strtoul(event->name, &stem_end, 10);
+        if (stem_end != event->name) {
+          invalidate_id(id);
+        }
+      }
+    }
+  }
+}
+
+bool project_cache_acquire(ProjectId id, const Project **project_out) {
+  initialise();
+  drain_events();
+
+  for (size_t i = 0; i < cache.entry_c; i++) {
+    CacheEntry *entry = cache.entries + i;
+    if (entry->stale || entry->project->id != id) {
+      continue;
+    }
+
+    // Without inotify, check the files by hand
+    if (cache.inotify_fd < 0) {
+      FileStamp stamps[3];
+      stamp_files(id, stamps);
+      if (memcmp(stamps, entry->stamps, sizeof(stamps))) {
+        invalidate_entry(i);
+        break;
+      }
+    }
+
+    entry->refs++;
+    cache.stats.hits++;
+    *project_out = entry->project;
+    return true;
+  }
+
+  cache.stats.misses++;
+  cache.miss_id = id;
+  stamp_files(id, cache.miss_stamps);
+  return false;
+}
+
+const Project *project_cache_insert(Project *project) {
+  initialise();
+
+  cache.entries =
+      realloc(cache.entries, sizeof(CacheEntry) * (cache.entry_c + 1));
+  CacheEntry *entry = cache.entries + cache.entry_c++;
+  entry->project = project;
+  entry->refs = 1;
+  entry->stale = false;
+  if (project->id == cache.miss_id) {
+    memcpy(entry->stamps, cache.miss_stamps, sizeof(entry->stamps));
+  } else {
+    stamp_files(project->id, entry->stamps);
+  }
+
+  return project;
+}
+
+void project_cache_release(const Project *project) {
+  for (size_t i = 0; i < cache.entry_c; i++) {
+    CacheEntry *entry = cache.entries + i;
+    if (entry->project != project) {
+      continue;
+    }
+
+    entry->refs--;
+    if (entry->stale && !entry->refs) {
+      remove_entry(i);
+    }
+    return;
+  }
+}
+
+bool project_cache_get_index(ProjectIndex *index_out) {
+  initialise();
+  drain_events();
+
+  // Without inotify the index has to be checked against the files anyway
+  if (cache.inotify_fd < 0 || !cache.index_valid) {
+    cache.stats.index_misses++;
+    return false;
+  }
+
+  size_t entries_size = sizeof(ProjectIndexEntry) * cache.index.entry_c;
+  index_out->entries = malloc(entries_size ? entries_size : 1);
+  memcpy(index_out->entries, cache.index.entries, entries_size);
+  index_out->entry_c = cache.index.entry_c;
+  index_out->max_id = cache.index.max_id;
+
+  cache.stats.index_hits++;
+  return true;
+}
+
+void project_cache_put_index(const ProjectIndex *index) {
+  // Events are not drained here: anything written since the lookup that
+  // missed is still queued, and drops this copy on the next lookup
+  initialise();
+
+  size_t entries_size = sizeof(ProjectIndexEntry) * index->entry_c;
+  free(cache.index.entries);
+  cache.index.entries = malloc(entries_size ? entries_size : 1);
+  memcpy(cache.index.entries, index->entries, entries_size);
+  cache.index.entry_c = index->entry_c;
+  cache.index.max_id = index->max_id;
+  cache.index_valid = true;
+}
+
+void project_cache_invalidate(ProjectId id) {
+  invalidate_id(id);
+  cache.index_valid = false;
+  cache.change_c++;
+}
+
+unsigned long project_cache_changes(void) {
+  initialise();
+  if (cache.inotify_fd >= 0) {
+    drain_events();
+    return cache.change_c;
+  }
+
+  // Without inotify, every write renames into the directory or updates the
+  // index
+  FileStamp stamps[2];
+  Filepath projects_dir, index_path;
+  if (!fs_expand_from_home(PROJECTS_DIRECTORY, projects_dir) &&
+      !fs_expand_from_home(PROJECT_INDEX_FILE, index_path)) {
+    stamp_path(projects_dir, stamps);
+    stamp_path(index_path, stamps + 1);
+    if (memcmp(stamps, cache.poll_stamps, sizeof(stamps))) {
+      memcpy(cache.poll_stamps, stamps, sizeof(stamps));
+      cache.change_c++;
+    }
+  }
+  return cache.change_c;
+}
+
+ProjectCacheStats project_cache_stats(void) { return cache.stats; }
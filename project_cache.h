@@ -0,0 +1,51 @@
+#ifndef PROJECT_CACHE_H_
+#define PROJECT_CACHE_H_
+
+#include "project.h"
+#include "project_index.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Counters for the in-process project cache.
+typedef struct ProjectCacheStats {
+  /// Project lookups served from memory.
+  size_t hits;
+  /// Project lookups that had to load from disk.
+  size_t misses;
+  /// Project index lookups served from memory.
+  size_t index_hits;
+  /// Project index lookups that had to check the disk.
+  size_t index_misses;
+  /// Entries dropped because their files changed.
+  size_t invalidations;
+  /// Whether changes are detected with inotify (rather than mtime checks).
+  bool inotify;
+} ProjectCacheStats;
+
+/// Returns a shared, read-only view of a project, loading it on a miss. Every
+/// view must be handed back with `project_cache_release`.
+bool project_cache_acquire(ProjectId id, const Project **project_out);
+/// Stores a freshly loaded project, taking ownership, and returns a view of it.
+/// Load it after the lookup that missed, changes made since that lookup then
+/// still drop it.
+const Project *project_cache_insert(Project *project);
+/// Hands back a view from `project_cache_acquire`.
+void project_cache_release(const Project *project);
+
+/// Copies the cached project index, if nothing has changed since it was
+/// stored. Only possible while inotify is watching the projects directory.
+bool project_cache_get_index(ProjectIndex *index_out);
+/// Stores a copy of a project index loaded after the lookup that missed.
+void project_cache_put_index(const ProjectIndex *index);
+
+/// Drops a project (and the cached index) after it has been written.
+void project_cache_invalidate(ProjectId id);
+/// Counts changes to the projects so far, made by this process or (seen
+/// through inotify, or mtimes without it) any other. Anything derived from
+/// projects is out of date once this has moved on.
+unsigned long project_cache_changes(void);
+/// Current cache counters.
+ProjectCacheStats project_cache_stats(void);
+
+#endif
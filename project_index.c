@@ -0,0 +1,339 @@
+#include "project_index.h"
+
+#include "filesystem.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int compare_entries(const void *a, const void *b) {
+  const ProjectIndexEntry *entry_a = a;
+  const ProjectIndexEntry *entry_b = b;
+  return (entry_a->id > entry_b->id) - (entry_a->id < entry_b->id);
+}
+
+/// Recomputes the largest project ID after the entries have changed.
+static void update_max_id(ProjectIndex *index) {
+  // Entries are sorted, so the largest ID is always last
+  index->max_id = index->entry_c ? index->entries[index->entry_c - 1].id : 0;
+}
+
+/// Records the current size and modification time of an entry's project file.
+static bool stat_entry(ProjectIndexEntry *entry) {
+  Filepath project_path;
+  if (fs_get_project_path(entry->id, project_path)) {
+    return false;
+  }
+
+  struct stat st;
+  if (stat(project_path, &st)) {
+    return false;
+  }
+
+  entry->file_size = st.st_size;
+  entry->mtime_sec = st.st_mtim.tv_sec;
+  entry->mtime_nsec = st.st_mtim.tv_nsec;
+
+  return true;
+}
+
+/// Checks that an index header is one this build can read.
+static bool header_is_valid(const ProjectIndexHeader *header) {
+  return header->magic == PROJECT_INDEX_MAGIC &&
+         header->version == PROJECT_INDEX_VERSION &&
+         header->entry_size == sizeof(ProjectIndexEntry);
+}
+
+/// Reads the index file as-is, without checking it against the project files.
+static IndexError read_index(ProjectIndex *index_out) {
+  Filepath index_path;
+  if (fs_expand_from_home(PROJECT_INDEX_FILE, index_path)) {
+    return INDEX_OPEN_ERROR;
+  }
+
+  FILE *file = fopen(index_path, "rb");
+  if (!file) {
+    return INDEX_FORMAT_ERROR;
+  }
+
+  ProjectIndexHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      !header_is_valid(&header)) {
+    fclose(file);
+    return INDEX_FORMAT_ERROR;
+  }
+
+  ProjectIndexEntry *entries =
+      malloc(sizeof(ProjectIndexEntry) * (header.entry_c ? header.entry_c : 1));
+  if (fread(entries, sizeof(ProjectIndexEntry), header.entry_c, file) !=
+      header.entry_c) {
+    free(entries);
+    fclose(file);
+    return INDEX_FORMAT_ERROR;
+  }
+  fclose(file);
+
+  index_out->entries = entries;
+  index_out->entry_c = header.entry_c;
+  index_out->max_id = header.max_id;
+
+  return INDEX_OK;
+}
+
+/// Atomically replaces the index file.
+static IndexError write_index(const ProjectIndex *index) {
+  Filepath index_path, temp_path;
+  // Per process, rebuilds happen without the index lock
+  if (fs_expand_from_home(PROJECT_INDEX_FILE, index_path) ||
+      fs_get_temp_path(index_path, temp_path)) {
+    return INDEX_OPEN_ERROR;
+  }
+
+  FILE *file = fopen(temp_path, "wb");
+  if (!file) {
+    return INDEX_WRITE_ERROR;
+  }
+
+  ProjectIndexHeader header = {
+      .magic = PROJECT_INDEX_MAGIC,
+      .version = PROJECT_INDEX_VERSION,
+      .entry_size = sizeof(ProjectIndexEntry),
+      .entry_c = index->entry_c,
+      .max_id = index->max_id,
+  };
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(index->entries, sizeof(ProjectIndexEntry), index->entry_c,
+                   file) == index->entry_c;
+  if (fclose(file) || !ok || rename(temp_path, index_path)) {
+    remove(temp_path);
+    return INDEX_WRITE_ERROR;
+  }
+
+  return INDEX_OK;
+}
+
+/// Checks every project file against the index using only `stat`, so the cost
+/// does not depend on how many activities have been logged.
+static bool index_is_current(const ProjectIndex *index) {
+  Filepath project_dir;
+  if (fs_expand_from_home(PROJECTS_DIRECTORY, project_dir)) {
+    return false;
+  }
+
+  DIR *directory = opendir(project_dir);
+  if (!directory) {
+    return false;
+  }
+
+  bool current = true;
+  size_t file_c = 0;
+  struct dirent *entry;
+  while (current && (entry = readdir(directory))) {
+    ProjectId id;
+    if (entry->d_type != DT_REG ||
+        !fs_parse_project_filename(entry->d_name, &id)) {
+      continue;
+    }
+    file_c++;
+
+    // New project file, or one that has been edited outside of freeman
+    ProjectIndexEntry *index_entry = project_index_find(index, id);
+    ProjectIndexEntry fresh = {.id = id};
+    if (!index_entry || !stat_entry(&fresh) ||
+        fresh.file_size != index_entry->file_size ||
+        fresh.mtime_sec != index_entry->mtime_sec ||
+        fresh.mtime_nsec != index_entry->mtime_nsec) {
+      current = false;
+    }
+  }
+  closedir(directory);
+
+  // Catches deleted project files
+  return current && file_c == index->entry_c;
+}
+
+/// Rebuilds the index by loading every project.
+static IndexError rebuild_index(ProjectIndex *index_out) {
+  Project **projects;
+  size_t project_c;
+  if (fs_get_project_list(&projects, &project_c)) {
+    return INDEX_REBUILD_ERROR;
+  }
+
+  ProjectIndex index = {
+      .entries = calloc(project_c ? project_c : 1, sizeof(ProjectIndexEntry)),
+      .entry_c = 0,
+  };
+  for (size_t i = 0; i < project_c; i++) {
+    Project *project = projects[i];
+    ProjectIndexEntry *entry = index.entries + index.entry_c;
+
+    entry->id = project->id;
+    snprintf(entry->name, sizeof(entry->name), "%s", project->name);
+    entry->default_rate = project->default_rate;
+    entry->activity_c = project->activity_c;
+    if (stat_entry(entry)) {
+      index.entry_c++;
+    }
+  }
+  fs_free_project_list(projects, project_c);
+
+  qsort(index.entries, index.entry_c, sizeof(ProjectIndexEntry),
+        compare_entries);
+  update_max_id(&index);
+
+  // Failing to persist only costs another rebuild next time
+  IndexError error = write_index(&index);
+  if (error) {
+    printf("Failed to write project index (error %d)\n", error);
+  }
+
+  *index_out = index;
+
+  return INDEX_OK;
+}
+
+IndexError project_index_load(ProjectIndex *index_out) {
+  ProjectIndex index;
+  if (!read_index(&index)) {
+    if (index_is_current(&index)) {
+      *index_out = index;
+      return INDEX_OK;
+    }
+    project_index_free(&index);
+  }
+
+  return rebuild_index(index_out);
+}
+
+void project_index_free(ProjectIndex *index) {
+  free(index->entries);
+  index->entries = NULL;
+  index->entry_c = 0;
+  index->max_id = 0;
+}
+
+ProjectIndexEntry *project_index_find(const ProjectIndex *index, ProjectId id) {
+  ProjectIndexEntry key = {.id = id};
+  return bsearch(&key, index->entries, index->entry_c,
+                 sizeof(ProjectIndexEntry), compare_entries);
+}
+
+IndexError project_index_update(const Project *project, size_t journal_c) {
+  // No usable index yet, the next load will rebuild it with this project
+  ProjectIndex index;
+  if (read_index(&index)) {
+    return INDEX_OK;
+  }
+
+  ProjectIndexEntry *entry = project_index_find(&index, project->id);
+  if (!entry) {
+    // Insert, keeping entries sorted
+    index.entries = realloc(index.entries,
+                            sizeof(ProjectIndexEntry) * (index.entry_c + 1));
+    size_t position = 0;
+    while (position < index.entry_c &&
+           index.entries[position].id < project->id) {
+      position++;
+    }
+    memmove(index.entries + position + 1, index.entries + position,
+            sizeof(ProjectIndexEntry) * (index.entry_c - position));
+    index.entry_c++;
+    entry = index.entries + position;
+  }
+
+  memset(entry, 0, sizeof(ProjectIndexEntry));
+  entry->id = project->id;
+  snprintf(entry->name, sizeof(entry->name), "%s", project->name);
+  entry->default_rate = project->default_rate;
+  entry->activity_c = project->activity_c + journal_c;
+  if (!stat_entry(entry)) {
+    project_index_free(&index);
+    return INDEX_OPEN_ERROR;
+  }
+  update_max_id(&index);
+
+  IndexError error = write_index(&index);
+  project_index_free(&index);
+
+  return error;
+}
+
+IndexError project_index_remove(ProjectId id) {
+  ProjectIndex index;
+  if (read_index(&index)) {
+    return INDEX_OK;
+  }
+
+  ProjectIndexEntry *entry = project_index_find(&index, id);
+  if (!entry) {
+    project_index_free(&index);
+    return INDEX_OK;
+  }
+
+  size_t position = entry - index.entries;
+  memmove(entry, entry + 1,
+          sizeof(ProjectIndexEntry) * (index.entry_c - position - 1));
+  index.entry_c--;
+  update_max_id(&index);
+
+  IndexError error = write_index(&index);
+  project_index_free(&index);
+
+  return error;
+}
+
+IndexError project_index_add_activity(ProjectId id) {
+  Filepath index_path;
+  if (fs_expand_from_home(PROJECT_INDEX_FILE, index_path)) {
+    return INDEX_OPEN_ERROR;
+  }
+
+  // No usable index yet, the next load will rebuild it with this activity
+  int fd = open(index_path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    return INDEX_OK;
+  }
+  ProjectIndexHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !header_is_valid(&header)) {
+    close(fd);
+    return INDEX_OK;
+  }
+
+  // Entries are fixed-size and sorted by ID, so search the file in place and
+  // rewrite just this entry's count
+  IndexError error = INDEX_OK;
+  size_t low = 0, high = header.entry_c;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    off_t offset = sizeof(header) + middle * sizeof(ProjectIndexEntry);
+    ProjectIndexEntry entry;
+    if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) {
+      break; // Truncated, the next load will rebuild it
+    }
+
+    if (entry.id < id) {
+      low = middle + 1;
+    } else if (entry.id > id) {
+      high = middle;
+    } else {
+      entry.activity_c++;
+      off_t count_offset = offset + offsetof(ProjectIndexEntry, activity_c);
+      if (pwrite(fd, &entry.activity_c, sizeof(entry.activity_c),
+                 count_offset) != sizeof(entry.activity_c)) {
+        error = INDEX_WRITE_ERROR;
+      }
+      break;
+    }
+  }
+  close(fd);
+
+  return error;
+}
@@ -0,0 +1,78 @@
+#ifndef PROJECT_INDEX_H_
+#define PROJECT_INDEX_H_
+
+#include "project.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifies a project index file ("FMIX").
+#define PROJECT_INDEX_MAGIC (0x58494d46)
+/// Current project index format version.
+#define PROJECT_INDEX_VERSION (1)
+
+typedef enum IndexError {
+  INDEX_OK = 0,
+  /// Something went wrong opening or reading the index file.
+  INDEX_OPEN_ERROR,
+  /// Something went wrong writing the index file.
+  INDEX_WRITE_ERROR,
+  /// The index file is missing, truncated or from another version.
+  INDEX_FORMAT_ERROR,
+  /// Something went wrong reloading the projects to rebuild the index.
+  INDEX_REBUILD_ERROR,
+} IndexError;
+
+/// Summary of a single project, enough for menus without loading it.
+typedef struct ProjectIndexEntry {
+  uint64_t id;
+  char name[64];
+  double default_rate;
+  /// Activities in the project file plus its journal.
+  uint64_t activity_c;
+
+  /// Size of the project YAML when this entry was written.
+  int64_t file_size;
+  /// Modification time of the project YAML when this entry was written.
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} ProjectIndexEntry;
+
+/// Header at the start of the index file, followed by `entry_c` entries sorted
+/// by ID.
+typedef struct ProjectIndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  /// `sizeof(ProjectIndexEntry)` when written, guards against layout changes.
+  uint64_t entry_size;
+  uint64_t entry_c;
+  /// Largest project ID in the index, 0 if empty.
+  uint64_t max_id;
+} ProjectIndexHeader;
+
+/// In-memory copy of the project index.
+typedef struct ProjectIndex {
+  /// Entries sorted by project ID.
+  ProjectIndexEntry *entries;
+  size_t entry_c;
+  /// Largest project ID in the index, 0 if empty.
+  ProjectId max_id;
+} ProjectIndex;
+
+/// Loads the project index, rebuilding it from the project files if it is
+/// missing or any project file has changed since it was written.
+IndexError project_index_load(ProjectIndex *index_out);
+/// Frees a loaded project index.
+void project_index_free(ProjectIndex *index);
+/// Finds a project's entry, returning NULL if it is not in the index.
+ProjectIndexEntry *project_index_find(const ProjectIndex *index, ProjectId id);
+
+/// Inserts or replaces a project's entry after its file has been written,
+/// `journal_c` being the number of records still waiting in its journal.
+IndexError project_index_update(const Project *project, size_t journal_c);
+/// Removes a project's entry after its file has been deleted.
+IndexError project_index_remove(ProjectId id);
+/// Counts an activity appended to a project's journal.
+IndexError project_index_add_activity(ProjectId id);
+
+#endif
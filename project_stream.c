@@ -0,0 +1,379 @@
+#include "project_stream.h"
+
+#include "error.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <yaml.h>
+
+/// Large enough for any key or number, longer ones are rejected.
+#define SCALAR_BUFFER_SIZE (64)
+/// Longest description the schema accepts, matching `Activity.description`.
+#define DESCRIPTION_MAX_LENGTH (sizeof(((Activity *)0)->description) - 1)
+/// Longest name the schema accepts, matching `Project.name`.
+#define NAME_MAX_LENGTH (sizeof(((Project *)0)->name) - 1)
+
+/// Bits for each field in `seen` masks, every field but `journal_seq` and
+/// `version` is required.
+enum {
+  FIELD_ID = 1 << 0,
+  FIELD_NAME = 1 << 1,
+  FIELD_DEFAULT_RATE = 1 << 2,
+  FIELD_ACTIVITIES = 1 << 3,
+  FIELD_JOURNAL_SEQ = 1 << 4,
+  FIELD_VERSION = 1 << 5,
+  PROJECT_REQUIRED = FIELD_ID | FIELD_NAME | FIELD_DEFAULT_RATE |
+                     FIELD_ACTIVITIES,
+
+  FIELD_DESCRIPTION = 1 << 0,
+  FIELD_HOURS = 1 << 1,
+  FIELD_MINUTES = 1 << 2,
+  FIELD_RATE = 1 << 3,
+  FIELD_TIME = 1 << 4,
+  FIELD_PROJECT_ID = 1 << 5,
+  ACTIVITY_REQUIRED = (1 << 6) - 1,
+
+  FIELD_PRESENT = 1 << 0,
+  FIELD_VALUE = 1 << 1,
+  RATE_REQUIRED = (1 << 2) - 1,
+};
+
+/// Parses the next event, aliases are never written so are rejected.
+static ProjectStreamError next_event(yaml_parser_t *parser,
+                                     yaml_event_t *event_out) {
+  if (!yaml_parser_parse(parser, event_out)) {
+    return PROJECT_STREAM_PARSE_ERROR;
+  }
+  if (event_out->type == YAML_ALIAS_EVENT) {
+    yaml_event_delete(event_out);
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+  return PROJECT_STREAM_OK;
+}
+
+/// Consumes an event of a given type.
+static ProjectStreamError expect_event(yaml_parser_t *parser,
+                                       yaml_event_type_t type) {
+  yaml_event_t event;
+  PROPAGATE(ProjectStreamError, next_event, (parser, &event));
+  bool matches = event.type == type;
+  yaml_event_delete(&event);
+  return matches ? PROJECT_STREAM_OK : PROJECT_STREAM_FORMAT_ERROR;
+}
+
+/// Copies a scalar event's value into a buffer (if any), rejecting anything
+/// longer than `max_length`.
+static ProjectStreamError take_scalar(yaml_event_t *event, char *buffer,
+                                      size_t max_length) {
+  bool valid = event->type == YAML_SCALAR_EVENT &&
+               event->data.scalar.length <= max_length;
+  if (valid && buffer) {
+    memcpy(buffer, event->data.scalar.value, event->data.scalar.length);
+    buffer[event->data.scalar.length] = '\0';
+  }
+  yaml_event_delete(event);
+  return valid ? PROJECT_STREAM_OK : PROJECT_STREAM_FORMAT_ERROR;
+}
+
+/// Reads the next event as a scalar.
+static ProjectStreamError read_scalar(yaml_parser_t *parser, char *buffer,
+                                      size_t max_length) {
+  yaml_event_t event;
+  PROPAGATE(ProjectStreamError, next_event, (parser, &event));
+  return take_scalar(&event, buffer, max_length);
+}
+
+static ProjectStreamError read_uint(yaml_parser_t *parser,
+                                    unsigned long *value_out) {
+  char buffer[SCALAR_BUFFER_SIZE];
+  PROPAGATE(ProjectStreamError, read_scalar,
+            (parser, buffer, SCALAR_BUFFER_SIZE - 1));
+
+  // Digits only, so that signs and junk are not silently accepted
+  char *end;
+  errno = 0;
+  unsigned long value = strtoul(buffer, &end, 10);
+  if (!isdigit((unsigned char)*buffer) || *end || errno) {
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+
+  *value_out = value;
+  return PROJECT_STREAM_OK;
+}
+
+static ProjectStreamError read_double(yaml_parser_t *parser,
+                                      double *value_out) {
+  char buffer[SCALAR_BUFFER_SIZE];
+  PROPAGATE(ProjectStreamError, read_scalar,
+            (parser, buffer, SCALAR_BUFFER_SIZE - 1));
+
+  char *end;
+  double value = strtod(buffer, &end);
+  if (end == buffer || *end) {
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+
+  *value_out = value;
+  return PROJECT_STREAM_OK;
+}
+
+static ProjectStreamError read_bool(yaml_parser_t *parser, bool *value_out) {
+  static const char *TRUE_WORDS[] = {"true", "yes", "on", "1"};
+  static const char *FALSE_WORDS[] = {"false", "no", "off", "0"};
+
+  char buffer[SCALAR_BUFFER_SIZE];
+  PROPAGATE(ProjectStreamError, read_scalar,
+            (parser, buffer, SCALAR_BUFFER_SIZE - 1));
+
+  for (size_t i = 0; i < sizeof(TRUE_WORDS) / sizeof(char *); i++) {
+    if (!strcasecmp(buffer, TRUE_WORDS[i])) {
+      *value_out = true;
+      return PROJECT_STREAM_OK;
+    }
+    if (!strcasecmp(buffer, FALSE_WORDS[i])) {
+      *value_out = false;
+      return PROJECT_STREAM_OK;
+    }
+  }
+  return PROJECT_STREAM_FORMAT_ERROR;
+}
+
+/// Reads the key of the next mapping entry, returning false in `more_out` at
+/// the end of the mapping.
+static ProjectStreamError read_key(yaml_parser_t *parser, char *buffer,
+                                   bool *more_out) {
+  yaml_event_t event;
+  PROPAGATE(ProjectStreamError, next_event, (parser, &event));
+  if (event.type == YAML_MAPPING_END_EVENT) {
+    yaml_event_delete(&event);
+    *more_out = false;
+    return PROJECT_STREAM_OK;
+  }
+
+  *more_out = true;
+  return take_scalar(&event, buffer, SCALAR_BUFFER_SIZE - 1);
+}
+
+/// Marks a field as seen, rejecting duplicates.
+static ProjectStreamError see_field(unsigned int *seen, unsigned int field) {
+  if (*seen & field) {
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+  *seen |= field;
+  return PROJECT_STREAM_OK;
+}
+
+/// Reads an activity's rate mapping, after its start event.
+static ProjectStreamError read_rate(yaml_parser_t *parser,
+                                    OptionalDouble *rate_out) {
+  PROPAGATE(ProjectStreamError, expect_event,
+            (parser, YAML_MAPPING_START_EVENT));
+
+  unsigned int seen = 0;
+  while (true) {
+    char key[SCALAR_BUFFER_SIZE];
+    bool more;
+    PROPAGATE(ProjectStreamError, read_key, (parser, key, &more));
+    if (!more) {
+      break;
+    }
+
+    if (!strcmp(key, "present")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_PRESENT));
+      PROPAGATE(ProjectStreamError, read_bool, (parser, &rate_out->present));
+    } else if (!strcmp(key, "value")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_VALUE));
+      PROPAGATE(ProjectStreamError, read_double, (parser, &rate_out->value));
+    } else {
+      return PROJECT_STREAM_FORMAT_ERROR;
+    }
+  }
+
+  return seen == RATE_REQUIRED ? PROJECT_STREAM_OK
+                               : PROJECT_STREAM_FORMAT_ERROR;
+}
+
+/// Reads a single activity mapping, after its start event.
+static ProjectStreamError read_activity(yaml_parser_t *parser,
+                                        ActivitySummary *activity_out) {
+  unsigned int seen = 0;
+  while (true) {
+    char key[SCALAR_BUFFER_SIZE];
+    bool more;
+    PROPAGATE(ProjectStreamError, read_key, (parser, key, &more));
+    if (!more) {
+      break;
+    }
+
+    if (!strcmp(key, "description")) {
+      // Checked, but never copied
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_DESCRIPTION));
+      PROPAGATE(ProjectStreamError, read_scalar,
+                (parser, NULL, DESCRIPTION_MAX_LENGTH));
+    } else if (!strcmp(key, "hours")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_HOURS));
+      PROPAGATE(ProjectStreamError, read_uint, (parser, &activity_out->hours));
+    } else if (!strcmp(key, "minutes")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_MINUTES));
+      PROPAGATE(ProjectStreamError, read_uint,
+                (parser, &activity_out->minutes));
+    } else if (!strcmp(key, "rate")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_RATE));
+      PROPAGATE(ProjectStreamError, read_rate, (parser, &activity_out->rate));
+    } else if (!strcmp(key, "time")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_TIME));
+      PROPAGATE(ProjectStreamError, read_uint, (parser, &activity_out->time));
+    } else if (!strcmp(key, "project_id")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_PROJECT_ID));
+      PROPAGATE(ProjectStreamError, read_uint,
+                (parser, &activity_out->project_id));
+    } else {
+      return PROJECT_STREAM_FORMAT_ERROR;
+    }
+  }
+
+  return seen == ACTIVITY_REQUIRED ? PROJECT_STREAM_OK
+                                   : PROJECT_STREAM_FORMAT_ERROR;
+}
+
+/// Reads the activity sequence, visiting each activity as it completes. A null
+/// scalar is an empty project.
+static ProjectStreamError read_activities(yaml_parser_t *parser,
+                                          const ProjectStreamHeader *header,
+                                          ProjectStreamFn fn, void *context) {
+  yaml_event_t event;
+  PROPAGATE(ProjectStreamError, next_event, (parser, &event));
+  if (event.type == YAML_SCALAR_EVENT) {
+    char value[SCALAR_BUFFER_SIZE];
+    PROPAGATE(ProjectStreamError, take_scalar,
+              (&event, value, SCALAR_BUFFER_SIZE - 1));
+    return !*value || !strcmp(value, "~") || !strcasecmp(value, "null")
+               ? PROJECT_STREAM_OK
+               : PROJECT_STREAM_FORMAT_ERROR;
+  }
+  bool sequence = event.type == YAML_SEQUENCE_START_EVENT;
+  yaml_event_delete(&event);
+  if (!sequence) {
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+
+  while (true) {
+    PROPAGATE(ProjectStreamError, next_event, (parser, &event));
+    yaml_event_type_t type = event.type;
+    yaml_event_delete(&event);
+    if (type == YAML_SEQUENCE_END_EVENT) {
+      return PROJECT_STREAM_OK;
+    }
+    if (type != YAML_MAPPING_START_EVENT) {
+      return PROJECT_STREAM_FORMAT_ERROR;
+    }
+
+    ActivitySummary activity = {0};
+    PROPAGATE(ProjectStreamError, read_activity, (parser, &activity));
+    if (!fn(context, header, &activity)) {
+      return PROJECT_STREAM_STOPPED;
+    }
+  }
+}
+
+/// Reads a whole project document.
+static ProjectStreamError read_project(yaml_parser_t *parser,
+                                       ProjectStreamHeader *header,
+                                       ProjectStreamFn fn, void *context) {
+  PROPAGATE(ProjectStreamError, expect_event,
+            (parser, YAML_STREAM_START_EVENT));
+  PROPAGATE(ProjectStreamError, expect_event,
+            (parser, YAML_DOCUMENT_START_EVENT));
+  PROPAGATE(ProjectStreamError, expect_event,
+            (parser, YAML_MAPPING_START_EVENT));
+
+  unsigned int seen = 0;
+  while (true) {
+    char key[SCALAR_BUFFER_SIZE];
+    bool more;
+    PROPAGATE(ProjectStreamError, read_key, (parser, key, &more));
+    if (!more) {
+      break;
+    }
+
+    if (!strcmp(key, "id")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_ID));
+      PROPAGATE(ProjectStreamError, read_uint, (parser, &header->id));
+    } else if (!strcmp(key, "name")) {
+      // Checked (the schema wants at least one character), then dropped
+      char name[NAME_MAX_LENGTH + 1];
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_NAME));
+      PROPAGATE(ProjectStreamError, read_scalar,
+                (parser, name, NAME_MAX_LENGTH));
+      if (!*name) {
+        return PROJECT_STREAM_FORMAT_ERROR;
+      }
+    } else if (!strcmp(key, "default_rate")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_DEFAULT_RATE));
+      PROPAGATE(ProjectStreamError, read_double,
+                (parser, &header->default_rate));
+    } else if (!strcmp(key, "activities")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_ACTIVITIES));
+      PROPAGATE(ProjectStreamError, read_activities,
+                (parser, header, fn, context));
+    } else if (!strcmp(key, "journal_seq")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_JOURNAL_SEQ));
+      PROPAGATE(ProjectStreamError, read_uint, (parser, &header->journal_seq));
+    } else if (!strcmp(key, "version")) {
+      PROPAGATE(ProjectStreamError, see_field, (&seen, FIELD_VERSION));
+      PROPAGATE(ProjectStreamError, read_uint, (parser, &header->version));
+    } else {
+      return PROJECT_STREAM_FORMAT_ERROR;
+    }
+  }
+
+  if ((seen & PROJECT_REQUIRED) != PROJECT_REQUIRED) {
+    return PROJECT_STREAM_FORMAT_ERROR;
+  }
+
+  PROPAGATE(ProjectStreamError, expect_event,
+            (parser, YAML_DOCUMENT_END_EVENT));
+  return expect_event(parser, YAML_STREAM_END_EVENT);
+}
+
+ProjectStreamError project_stream_file(const char *path, ProjectStreamFn fn,
+                                       void *context,
+                                       ProjectStreamHeader *header_out) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return PROJECT_STREAM_OPEN_ERROR;
+  }
+
+  // libyaml reads the file in small blocks as events are pulled
+  yaml_parser_t parser;
+  if (!yaml_parser_initialize(&parser)) {
+    fclose(file);
+    return PROJECT_STREAM_OPEN_ERROR;
+  }
+  yaml_parser_set_input_file(&parser, file);
+
+  ProjectStreamHeader header = {0};
+  ProjectStreamError error = read_project(&parser, &header, fn, context);
+
+  yaml_parser_delete(&parser);
+  fclose(file);
+
+  *header_out = header;
+
+  return error;
+}
+
+ActivitySummary activity_summarise(const Activity *activity) {
+  return (ActivitySummary){
+      .hours = activity->hours,
+      .minutes = activity->minutes,
+      .rate = activity->rate,
+      .time = activity->time,
+      .project_id = activity->project_id,
+  };
+}
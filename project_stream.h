@@ -0,0 +1,58 @@
+#ifndef PROJECT_STREAM_H_
+#define PROJECT_STREAM_H_
+
+#include "activity.h"
+#include "project.h"
+
+#include <stdbool.h>
+
+typedef enum ProjectStreamError {
+  PROJECT_STREAM_OK = 0,
+  /// Something went wrong opening the project file.
+  PROJECT_STREAM_OPEN_ERROR,
+  /// The project file is not valid YAML.
+  PROJECT_STREAM_PARSE_ERROR,
+  /// The project file is valid YAML, but not a project as saved by
+  /// `fs_save_project`.
+  PROJECT_STREAM_FORMAT_ERROR,
+  /// The callback asked to stop early.
+  PROJECT_STREAM_STOPPED,
+} ProjectStreamError;
+
+/// The fields of an activity needed for sums, everything but its description.
+typedef struct ActivitySummary {
+  unsigned long hours;
+  unsigned long minutes;
+  OptionalDouble rate;
+  unsigned long time;
+  unsigned long project_id;
+} ActivitySummary;
+
+/// Project fields seen so far in the stream. `fs_save_project` writes them all
+/// before the activities, except `version`, which is only known once the
+/// whole file has been streamed.
+typedef struct ProjectStreamHeader {
+  ProjectId id;
+  double default_rate;
+  unsigned long journal_seq;
+  unsigned long version;
+} ProjectStreamHeader;
+
+/// Called once per activity, in file order. Returning false stops the stream.
+typedef bool (*ProjectStreamFn)(void *context,
+                                const ProjectStreamHeader *header,
+                                const ActivitySummary *activity);
+
+/// Streams a project YAML file through libyaml events, handing each activity
+/// to `fn` as soon as it has been parsed. Nothing is kept between activities
+/// and descriptions are never copied, so memory use does not grow with the
+/// project. Accepts exactly what the project schema does, so anything else is
+/// a format error (possibly after some activities were already visited).
+ProjectStreamError project_stream_file(const char *path, ProjectStreamFn fn,
+                                       void *context,
+                                       ProjectStreamHeader *header_out);
+
+/// Summarises a loaded activity.
+ActivitySummary activity_summarise(const Activity *activity);
+
+#endif
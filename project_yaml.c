@@ -0,0 +1,631 @@
+#include "project_yaml.h"
+
+#include "activity.h"
+#include "error.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Buffer for writing, large enough that most projects are one write.
+#define WRITE_BUFFER_SIZE (64 * 1024)
+/// Large enough for any number, longer ones are rejected.
+#define NUMBER_BUFFER_SIZE (64)
+/// Activities allocated at once before the array has to grow.
+#define INITIAL_ACTIVITY_CAPACITY (64)
+
+/// Plain words that YAML readers may resolve to something other than a string,
+/// these are always quoted.
+static const char *RESERVED_WORDS[] = {"true", "false", "yes", "no",  "on",
+                                       "off",  "null",  "y",   "n",   "~"};
+
+static bool is_reserved(const char *string, size_t length) {
+  for (size_t i = 0; i < sizeof(RESERVED_WORDS) / sizeof(*RESERVED_WORDS);
+       i++) {
+    if (length == strlen(RESERVED_WORDS[i]) &&
+        !strncasecmp(string, RESERVED_WORDS[i], length)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Can a string be written unquoted, reading back exactly the same? Only a
+/// conservative set of characters is allowed, anything else is quoted.
+static bool is_plain_safe(const char *string, size_t length) {
+  if (!length || !isalpha((unsigned char)string[0]) ||
+      string[length - 1] == ' ') {
+    return false;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = string[i];
+    if (!isalnum(c) && !strchr(" _-.,()/&+", c)) {
+      return false;
+    }
+  }
+
+  return !is_reserved(string, length);
+}
+
+static void write_key(FILE *file, const char *prefix, const char *key) {
+  fputs(prefix, file);
+  fputs(key, file);
+  fputc(':', file);
+}
+
+/// Writes a string plain if it is safe to, otherwise double-quoted.
+static void write_string(FILE *file, const char *string, size_t size) {
+  size_t length = strnlen(string, size);
+  if (is_plain_safe(string, length)) {
+    fwrite(string, 1, length, file);
+    return;
+  }
+
+  fputc('"', file);
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = string[i];
+    switch (c) {
+    case '"':
+      fputs("\\\"", file);
+      break;
+    case '\\':
+      fputs("\\\\", file);
+      break;
+    case '\n':
+      fputs("\\n", file);
+      break;
+    case '\t':
+      fputs("\\t", file);
+      break;
+    case '\r':
+      fputs("\\r", file);
+      break;
+    default:
+      // Bytes from 0x80 are left as they are, YAML is UTF-8
+      if (c < 0x20 || c == 0x7f) {
+        fprintf(file, "\\x%02x", c);
+      } else {
+        fputc(c, file);
+      }
+    }
+  }
+  fputc('"', file);
+}
+
+/// Writes the shortest representation that reads back as the same double.
+static void write_double(FILE *file, double value) {
+  char buffer[NUMBER_BUFFER_SIZE];
+  for (int precision = 15; precision <= 17; precision++) {
+    snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (strtod(buffer, NULL) == value) {
+      break;
+    }
+  }
+  fputs(buffer, file);
+}
+
+static void emit_uint(FILE *file, const char *prefix, const char *key,
+                      unsigned long value) {
+  write_key(file, prefix, key);
+  fprintf(file, " %lu\n", value);
+}
+
+static void emit_double(FILE *file, const char *prefix, const char *key,
+                        double value) {
+  write_key(file, prefix, key);
+  fputc(' ', file);
+  write_double(file, value);
+  fputc('\n', file);
+}
+
+static void emit_string(FILE *file, const char *prefix, const char *key,
+                        const char *string, size_t size) {
+  write_key(file, prefix, key);
+  fputc(' ', file);
+  write_string(file, string, size);
+  fputc('\n', file);
+}
+
+/// Writes an `OptionalDouble` as a mapping nested one level below `prefix`.
+static void emit_optional_double(FILE *file, const char *prefix,
+                                 const char *key, OptionalDouble value) {
+  write_key(file, prefix, key);
+  fputc('\n', file);
+
+  char indent[NUMBER_BUFFER_SIZE];
+  size_t indent_length = strlen(prefix) + 2;
+  memset(indent, ' ', indent_length);
+  indent[indent_length] = '\0';
+
+  fprintf(file, "%spresent: %s\n", indent, value.present ? "true" : "false");
+  emit_double(file, indent, "value", value.value);
+}
+
+// Writers for each kind of field in the tables, `record` being the struct
+#define EMIT_UINT(symbol) emit_uint(file, prefix, #symbol, record->symbol);
+#define EMIT_DOUBLE(symbol) emit_double(file, prefix, #symbol, record->symbol);
+#define EMIT_STRING(symbol)                                                    \
+  emit_string(file, prefix, #symbol, record->symbol, sizeof(record->symbol));
+#define EMIT_OPTIONAL_DOUBLE(symbol)                                           \
+  emit_optional_double(file, prefix, #symbol, record->symbol);
+#define EMIT_ACTIVITIES(symbol)                                                \
+  emit_activities(file, prefix, #symbol, record->symbol, record->activity_c);
+
+static void emit_activity(FILE *file, const Activity *record) {
+  // Each activity is a sequence item, the first key starts it
+  const char *prefix = "- ";
+
+#define X(kind, symbol) EMIT_##kind(symbol) prefix = "  ";
+  ACTIVITY_TABLE
+#undef X
+}
+
+/// Writes a project's activities, as an indentless block sequence.
+static void emit_activities(FILE *file, const char *prefix, const char *key,
+                            const Activity *activities, size_t activity_c) {
+  write_key(file, prefix, key);
+  if (!activity_c) {
+    fputs(" []\n", file);
+    return;
+  }
+
+  fputc('\n', file);
+  for (size_t i = 0; i < activity_c; i++) {
+    emit_activity(file, activities + i);
+  }
+}
+
+static void emit_project(FILE *file, const Project *record) {
+  const char *prefix = "";
+
+#define X(kind, symbol) EMIT_##kind(symbol)
+  PROJECT_TABLE
+#undef X
+}
+
+#undef EMIT_UINT
+#undef EMIT_DOUBLE
+#undef EMIT_STRING
+#undef EMIT_OPTIONAL_DOUBLE
+#undef EMIT_ACTIVITIES
+
+ProjectYamlError project_yaml_save(const Project *project, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return PROJECT_YAML_OPEN_ERROR;
+  }
+
+  char buffer[WRITE_BUFFER_SIZE];
+  setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+  fputs("---\n", file);
+  emit_project(file, project);
+  fputs("...\n", file);
+
+  bool failed = ferror(file);
+  if (fclose(file) || failed) {
+    return PROJECT_YAML_WRITE_ERROR;
+  }
+
+  return PROJECT_YAML_OK;
+}
+
+/// Position in a mapped project file.
+typedef struct Cursor {
+  const char *position;
+  const char *end;
+} Cursor;
+
+/// Length of the current line, without its newline.
+static size_t line_length(const Cursor *cursor) {
+  const char *line_end =
+      memchr(cursor->position, '\n', cursor->end - cursor->position);
+  return (line_end ? line_end : cursor->end) - cursor->position;
+}
+
+/// Does the current line start with a prefix?
+static bool line_starts(const Cursor *cursor, const char *prefix) {
+  size_t prefix_length = strlen(prefix);
+  return line_length(cursor) >= prefix_length &&
+         !memcmp(cursor->position, prefix, prefix_length);
+}
+
+/// Consumes the current line if it is exactly `line`.
+static bool take_line(Cursor *cursor, const char *line) {
+  size_t length = line_length(cursor);
+  if (length != strlen(line) || memcmp(cursor->position, line, length)) {
+    return false;
+  }
+
+  cursor->position += length;
+  if (cursor->position < cursor->end) {
+    cursor->position++;
+  }
+  return true;
+}
+
+/// Consumes a `{prefix}{key}:` line, returning the value after the colon (empty
+/// for a nested mapping or sequence). Keys must be in table order, any other
+/// key is a format error.
+static ProjectYamlError read_key(Cursor *cursor, const char *prefix,
+                                 const char *key, const char **value_out,
+                                 size_t *value_length_out) {
+  const char *line = cursor->position;
+  size_t length = line_length(cursor);
+  size_t prefix_length = strlen(prefix);
+  size_t key_length = strlen(key);
+  size_t value_start = prefix_length + key_length + 1;
+  if (length < value_start || memcmp(line, prefix, prefix_length) ||
+      memcmp(line + prefix_length, key, key_length) ||
+      line[value_start - 1] != ':' ||
+      (length > value_start && line[value_start] != ' ')) {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  // Plain scalars never keep surrounding spaces
+  const char *value = line + value_start;
+  const char *value_end = line + length;
+  while (value < value_end && *value == ' ') {
+    value++;
+  }
+  while (value_end > value && value_end[-1] == ' ') {
+    value_end--;
+  }
+
+  cursor->position += length;
+  if (cursor->position < cursor->end) {
+    cursor->position++;
+  }
+
+  *value_out = value;
+  *value_length_out = value_end - value;
+  return PROJECT_YAML_OK;
+}
+
+/// Decodes a double-quoted scalar's contents, only the escapes the writer uses
+/// are understood.
+static ProjectYamlError decode_double_quoted(const char *value, size_t length,
+                                             char *buffer, size_t size) {
+  size_t out = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = value[i];
+    if (c == '"') {
+      return PROJECT_YAML_FORMAT_ERROR; // Closing quote before the end
+    }
+    if (c == '\\') {
+      if (++i == length) {
+        return PROJECT_YAML_FORMAT_ERROR;
+      }
+      switch (value[i]) {
+      case '"':
+      case '\\':
+      case '/':
+        c = value[i];
+        break;
+      case 'n':
+        c = '\n';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 'x': {
+        // Only ASCII control characters are written this way, anything else
+        // would be a multi-byte code point
+        char digits[3] = {0};
+        if (i + 2 >= length || !isxdigit((unsigned char)value[i + 1]) ||
+            !isxdigit((unsigned char)value[i + 2])) {
+          return PROJECT_YAML_FORMAT_ERROR;
+        }
+        memcpy(digits, value + i + 1, 2);
+        unsigned long code = strtoul(digits, NULL, 16);
+        if (code >= 0x80 || !code) {
+          return PROJECT_YAML_FORMAT_ERROR;
+        }
+        c = (char)code;
+        i += 2;
+        break;
+      }
+      default:
+        return PROJECT_YAML_FORMAT_ERROR;
+      }
+    }
+    if (out + 1 >= size) {
+      return PROJECT_YAML_FORMAT_ERROR;
+    }
+    buffer[out++] = c;
+  }
+
+  buffer[out] = '\0';
+  return PROJECT_YAML_OK;
+}
+
+/// Decodes a single-quoted scalar's contents, where `''` is a quote.
+static ProjectYamlError decode_single_quoted(const char *value, size_t length,
+                                             char *buffer, size_t size) {
+  size_t out = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (value[i] == '\'') {
+      if (i + 1 == length || value[i + 1] != '\'') {
+        return PROJECT_YAML_FORMAT_ERROR;
+      }
+      i++;
+    }
+    if (out + 1 >= size) {
+      return PROJECT_YAML_FORMAT_ERROR;
+    }
+    buffer[out++] = value[i];
+  }
+
+  buffer[out] = '\0';
+  return PROJECT_YAML_OK;
+}
+
+/// Reads a single-line scalar into a buffer of `size` bytes, rejecting
+/// anything that does not fit or that plain YAML would read differently.
+static ProjectYamlError parse_scalar(const char *value, size_t length,
+                                     char *buffer, size_t size) {
+  if (!length) {
+    return PROJECT_YAML_FORMAT_ERROR; // Null
+  }
+
+  if (value[0] == '"' || value[0] == '\'') {
+    if (length < 2 || value[length - 1] != value[0]) {
+      return PROJECT_YAML_FORMAT_ERROR;
+    }
+    return value[0] == '"'
+               ? decode_double_quoted(value + 1, length - 2, buffer, size)
+               : decode_single_quoted(value + 1, length - 2, buffer, size);
+  }
+
+  // Plain scalars must not start with an indicator (`-`, `?` and `:` only
+  // count before a space, as in `-5`), resolve to null, or contain a comment,
+  // another mapping or control characters
+  bool indicator = strchr(",[]{}#&*!|>%@`", value[0]) ||
+                   (strchr("-?:", value[0]) && (length == 1 || value[1] == ' '));
+  if (indicator || length >= size ||
+      (length == 4 && !strncasecmp(value, "null", 4)) ||
+      (length == 1 && value[0] == '~') || value[length - 1] == ':') {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if ((unsigned char)value[i] < 0x20 ||
+        (i + 1 < length && ((value[i] == ':' && value[i + 1] == ' ') ||
+                            (value[i] == ' ' && value[i + 1] == '#')))) {
+      return PROJECT_YAML_FORMAT_ERROR;
+    }
+  }
+
+  memcpy(buffer, value, length);
+  buffer[length] = '\0';
+  return PROJECT_YAML_OK;
+}
+
+static ProjectYamlError parse_uint(Cursor *cursor, const char *prefix,
+                                   const char *key, unsigned long *value_out) {
+  const char *value;
+  size_t length;
+  PROPAGATE(ProjectYamlError, read_key, (cursor, prefix, key, &value, &length));
+
+  char buffer[NUMBER_BUFFER_SIZE];
+  PROPAGATE(ProjectYamlError, parse_scalar,
+            (value, length, buffer, sizeof(buffer)));
+
+  // Digits only, no signs or spaces that strtoul would let through
+  for (char *digit = buffer; *digit; digit++) {
+    if (!isdigit((unsigned char)*digit)) {
+      return PROJECT_YAML_FORMAT_ERROR;
+    }
+  }
+
+  char *end;
+  errno = 0;
+  *value_out = strtoul(buffer, &end, 10);
+  if (end == buffer || errno) {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  return PROJECT_YAML_OK;
+}
+
+static ProjectYamlError parse_double(Cursor *cursor, const char *prefix,
+                                     const char *key, double *value_out) {
+  const char *value;
+  size_t length;
+  PROPAGATE(ProjectYamlError, read_key, (cursor, prefix, key, &value, &length));
+
+  char buffer[NUMBER_BUFFER_SIZE];
+  PROPAGATE(ProjectYamlError, parse_scalar,
+            (value, length, buffer, sizeof(buffer)));
+
+  char *end;
+  *value_out = strtod(buffer, &end);
+  if (end == buffer || *end) {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  return PROJECT_YAML_OK;
+}
+
+static ProjectYamlError parse_string(Cursor *cursor, const char *prefix,
+                                     const char *key, char *buffer,
+                                     size_t size) {
+  const char *value;
+  size_t length;
+  PROPAGATE(ProjectYamlError, read_key, (cursor, prefix, key, &value, &length));
+  PROPAGATE(ProjectYamlError, parse_scalar, (value, length, buffer, size));
+
+  // The schema requires every string to be non-empty
+  return buffer[0] ? PROJECT_YAML_OK : PROJECT_YAML_FORMAT_ERROR;
+}
+
+static ProjectYamlError parse_optional_double(Cursor *cursor,
+                                              const char *prefix,
+                                              const char *key,
+                                              OptionalDouble *value_out) {
+  const char *value;
+  size_t length;
+  PROPAGATE(ProjectYamlError, read_key, (cursor, prefix, key, &value, &length));
+  if (length) {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  char indent[NUMBER_BUFFER_SIZE];
+  size_t indent_length = strlen(prefix) + 2;
+  memset(indent, ' ', indent_length);
+  indent[indent_length] = '\0';
+
+  PROPAGATE(ProjectYamlError, read_key,
+            (cursor, indent, "present", &value, &length));
+  if (length == 4 && !memcmp(value, "true", 4)) {
+    value_out->present = true;
+  } else if (length == 5 && !memcmp(value, "false", 5)) {
+    value_out->present = false;
+  } else {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  return parse_double(cursor, indent, "value", &value_out->value);
+}
+
+// Readers for each kind of field in the tables, `record` being the struct
+#define PARSE_UINT(symbol)                                                     \
+  PROPAGATE(ProjectYamlError, parse_uint,                                      \
+            (cursor, prefix, #symbol, &record->symbol));
+#define PARSE_DOUBLE(symbol)                                                   \
+  PROPAGATE(ProjectYamlError, parse_double,                                    \
+            (cursor, prefix, #symbol, &record->symbol));
+#define PARSE_STRING(symbol)                                                   \
+  PROPAGATE(ProjectYamlError, parse_string,                                    \
+            (cursor, prefix, #symbol, record->symbol, sizeof(record->symbol)));
+#define PARSE_OPTIONAL_DOUBLE(symbol)                                          \
+  PROPAGATE(ProjectYamlError, parse_optional_double,                           \
+            (cursor, prefix, #symbol, &record->symbol));
+#define PARSE_ACTIVITIES(symbol)                                               \
+  PROPAGATE(ProjectYamlError, parse_activities,                                \
+            (cursor, prefix, #symbol, arena, &record->symbol,                  \
+             &record->activity_c));
+
+static ProjectYamlError parse_activity(Cursor *cursor, Activity *record) {
+  const char *prefix = "- ";
+
+#define X(kind, symbol) PARSE_##kind(symbol) prefix = "  ";
+  ACTIVITY_TABLE
+#undef X
+
+  return PROJECT_YAML_OK;
+}
+
+/// Reads an indentless sequence of activities (or `[]`) into the arena.
+static ProjectYamlError parse_activities(Cursor *cursor, const char *prefix,
+                                         const char *key, Arena *arena,
+                                         Activity **activities_out,
+                                         size_t *activity_c_out) {
+  const char *value;
+  size_t length;
+  PROPAGATE(ProjectYamlError, read_key, (cursor, prefix, key, &value, &length));
+  if (length == 2 && !memcmp(value, "[]", 2)) {
+    return PROJECT_YAML_OK;
+  }
+  if (length) {
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  Activity *activities = NULL;
+  size_t activity_c = 0;
+  size_t capacity = 0;
+  while (cursor->position < cursor->end && line_starts(cursor, "- ")) {
+    if (activity_c == capacity) {
+      capacity = capacity ? capacity * 2 : INITIAL_ACTIVITY_CAPACITY;
+      activities =
+          arena_realloc(arena, activities, sizeof(Activity) * capacity);
+      if (!activities) {
+        return PROJECT_YAML_FORMAT_ERROR;
+      }
+    }
+    PROPAGATE(ProjectYamlError, parse_activity,
+              (cursor, activities + activity_c));
+    activity_c++;
+  }
+
+  // Give back the unused capacity
+  if (activities) {
+    activities = arena_realloc(arena, activities, sizeof(Activity) * activity_c);
+  }
+
+  *activities_out = activities;
+  *activity_c_out = activity_c;
+  return PROJECT_YAML_OK;
+}
+
+static ProjectYamlError parse_project(Cursor *cursor, Arena *arena,
+                                      Project *record) {
+  const char *prefix = "";
+
+#define X(kind, symbol) PARSE_##kind(symbol)
+  PROJECT_TABLE
+#undef X
+
+  return PROJECT_YAML_OK;
+}
+
+#undef PARSE_UINT
+#undef PARSE_DOUBLE
+#undef PARSE_STRING
+#undef PARSE_OPTIONAL_DOUBLE
+#undef PARSE_ACTIVITIES
+
+ProjectYamlError project_yaml_load(const char *path, Arena *arena,
+                                   Project **project_out) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return PROJECT_YAML_OPEN_ERROR;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || !st.st_size) {
+    close(fd);
+    return PROJECT_YAML_FORMAT_ERROR;
+  }
+
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // Mapping stays valid after closing
+  if (mapping == MAP_FAILED) {
+    return PROJECT_YAML_OPEN_ERROR;
+  }
+  madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+  Cursor cursor = {.position = mapping,
+                   .end = (const char *)mapping + st.st_size};
+  Project *project = arena_alloc(arena, sizeof(Project));
+
+  take_line(&cursor, "---");
+  ProjectYamlError error = parse_project(&cursor, arena, project);
+
+  // Nothing may follow but the document end marker and blank lines
+  take_line(&cursor, "...");
+  while (!error && cursor.position < cursor.end) {
+    if (!take_line(&cursor, "")) {
+      error = PROJECT_YAML_FORMAT_ERROR;
+    }
+  }
+
+  munmap(mapping, st.st_size);
+  if (error) {
+    return error;
+  }
+
+  *project_out = project;
+  return PROJECT_YAML_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef PROJECT_YAML_H_
+#define PROJECT_YAML_H_
+
+#include "arena.h"
+#include "project.h"
+
+typedef enum ProjectYamlError {
+  PROJECT_YAML_OK = 0,
+  /// Something went wrong opening or mapping the project file.
+  PROJECT_YAML_OPEN_ERROR,
+  /// Something went wrong writing the project file.
+  PROJECT_YAML_WRITE_ERROR,
+  /// The file is not laid out exactly as `project_yaml_save` writes it, it may
+  /// still be valid YAML and should be loaded with libcyaml instead.
+  PROJECT_YAML_FORMAT_ERROR,
+} ProjectYamlError;
+
+/// Writes a project as YAML, with the same fields and layout as libcyaml's
+/// block style, generated from `PROJECT_TABLE` and `ACTIVITY_TABLE`.
+ProjectYamlError project_yaml_save(const Project *project, const char *path);
+/// Reads a project file written by `project_yaml_save` (or libcyaml) into a
+/// project allocated from the arena. Only the subset of YAML the writer emits
+/// is accepted, anything else (comments, flow style, reordered keys) is a
+/// format error.
+///
+/// Only the fields in the tables are set, the rest are left zeroed.
+ProjectYamlError project_yaml_load(const char *path, Arena *arena,
+                                   Project **project_out);
+
+#endif
@@ -0,0 +1,89 @@
+#include "query.h"
+
+#include "filesystem.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Index of the first activity logged at or after `time`, in a time-sorted
+/// array.
+static size_t lower_bound(const Activity *activities, size_t activity_c,
+                          unsigned long time) {
+  size_t low = 0, high = activity_c;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (activities[middle].time < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/// Does the query include activities from this project?
+static bool matches_project(const ActivityQuery *query, ProjectId id) {
+  if (!query->project_id_c) {
+    return true;
+  }
+
+  for (size_t i = 0; i < query->project_id_c; i++) {
+    if (query->project_ids[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+QueryError query_activities(Project **projects, size_t project_c,
+                            const ActivityQuery *query,
+                            Activity ***activities_out,
+                            size_t *activity_c_out) {
+  Activity **results = NULL;
+  size_t result_c = 0, result_capacity = 0;
+
+  // Activity times are unsigned, clamp so that the bounds compare correctly
+  unsigned long start = query->start > 0 ? (unsigned long)query->start : 0;
+  unsigned long end = query->end > 0 ? (unsigned long)query->end : 0;
+
+  for (size_t i = 0; i < project_c && start < end; i++) {
+    Project *project = projects[i];
+    if (!matches_project(query, project->id)) {
+      continue;
+    }
+
+    // Only reads the partitions that overlap the range
+    Activity *activities;
+    size_t activity_c;
+    FileError error = fs_get_activities_between(project, query->start,
+                                                query->end, &activities,
+                                                &activity_c);
+    if (error) {
+      printf("Failed to load activities for project %zu (error %d)\n",
+             project->id, error);
+      free(results);
+      return QUERY_LOAD_ERROR;
+    }
+
+    size_t first = lower_bound(activities, activity_c, start);
+    size_t last = lower_bound(activities, activity_c, end);
+
+    // Grow geometrically, results can span years of history
+    if (result_c + (last - first) > result_capacity) {
+      result_capacity = result_capacity ? result_capacity * 2 : 16;
+      if (result_capacity < result_c + (last - first)) {
+        result_capacity = result_c + (last - first);
+      }
+      results = realloc(results, sizeof(Activity *) * result_capacity);
+    }
+    for (size_t j = first; j < last; j++) {
+      results[result_c++] = activities + j;
+    }
+  }
+
+  *activities_out = results;
+  *activity_c_out = result_c;
+
+  return QUERY_OK;
+}
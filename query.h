@@ -0,0 +1,37 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include "activity.h"
+#include "project.h"
+
+#include <stddef.h>
+#include <time.h>
+
+typedef enum QueryError {
+  QUERY_OK = 0,
+  /// Something went wrong loading a project's activities.
+  QUERY_LOAD_ERROR,
+} QueryError;
+
+/// Which activities `query_activities` returns.
+typedef struct ActivityQuery {
+  /// Only activities logged in `[start, end)`.
+  time_t start;
+  time_t end;
+  /// Only activities logged to these projects, every project if empty.
+  const ProjectId *project_ids;
+  size_t project_id_c;
+} ActivityQuery;
+
+/// Finds every activity matching a query across a project list (which may be
+/// header-only), returning an (owned) array of pointers into the projects,
+/// grouped by project and in time order within each.
+///
+/// Each project's activities are kept sorted by time, so only the partitions
+/// overlapping the range are read and the range itself is binary searched.
+QueryError query_activities(Project **projects, size_t project_c,
+                            const ActivityQuery *query,
+                            Activity ***activities_out,
+                            size_t *activity_c_out);
+
+#endif
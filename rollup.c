@@ -0,0 +1,1071 @@
+#include "rollup.h"
+
+#include "calendar.h"
+#include "error.h"
+#include "filesystem.h"
+#include "parallel.h"
+#include "project_stream.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Largest earnings difference treated as equal when verifying.
+#define EARNINGS_TOLERANCE (0.005)
+
+static int compare_rows(const void *a, const void *b) {
+  const RollupRow *row_a = a;
+  const RollupRow *row_b = b;
+  if (row_a->day != row_b->day) {
+    return (row_a->day > row_b->day) - (row_a->day < row_b->day);
+  }
+  return (row_a->project_id > row_b->project_id) -
+         (row_a->project_id < row_b->project_id);
+}
+
+/// Builds the row a single activity contributes, bucketed by day through the
+/// calendar.
+static RollupRow activity_row(const ActivitySummary *activity, double rate,
+                              const Calendar *calendar) {
+  double duration = ((double)activity->minutes / 60.0) + activity->hours;
+  uint64_t minutes = activity->hours * 60 + activity->minutes;
+
+  Pence rate_pence;
+  bool exact = money_from_pounds(rate, &rate_pence);
+  MoneyTicks ticks;
+  if (!money_earnings(rate_pence, minutes, &ticks)) {
+    ticks = 0;
+    exact = false;
+  }
+
+  return (RollupRow){
+      .day = calendar_lookup(calendar, (time_t)activity->time),
+      .project_id = activity->project_id,
+      .earnings = rate * duration,
+      .earnings_ticks = ticks,
+      .minutes = minutes,
+      .activity_c = 1,
+      .inexact_c = !exact,
+  };
+}
+
+/// Adds one row's totals to another for the same day and project.
+static void add_row(RollupRow *row, const RollupRow *other) {
+  row->earnings += other->earnings;
+  row->earnings_ticks += other->earnings_ticks;
+  row->minutes += other->minutes;
+  row->activity_c += other->activity_c;
+  row->inexact_c += other->inexact_c;
+}
+
+/// Sorts rows and combines any for the same day and project.
+static void merge_rows(RollupTable *table) {
+  qsort(table->rows, table->row_c, sizeof(RollupRow), compare_rows);
+
+  size_t merged_c = 0;
+  for (size_t i = 0; i < table->row_c; i++) {
+    RollupRow *row = table->rows + i;
+    RollupRow *last = merged_c ? table->rows + merged_c - 1 : NULL;
+    if (last && !compare_rows(last, row)) {
+      add_row(last, row);
+    } else {
+      table->rows[merged_c++] = *row;
+    }
+  }
+  table->row_c = merged_c;
+}
+
+/// Drops every row for a project.
+static void remove_project_rows(RollupTable *table, ProjectId id) {
+  size_t kept_c = 0;
+  for (size_t i = 0; i < table->row_c; i++) {
+    if (table->rows[i].project_id != id) {
+      table->rows[kept_c++] = table->rows[i];
+    }
+  }
+  table->row_c = kept_c;
+}
+
+/// Largest index read from a file, anything bigger is treated as corrupt.
+#define ROLLUP_INDEX_MAX_DAYS (1 << 24)
+
+/// Adds (or with a `sign` of -1, subtracts) one index node onto another.
+static void add_node(RollupIndexNode *node, const RollupIndexNode *other,
+                     int sign) {
+  node->earnings += sign * other->earnings;
+  node->earnings_ticks += sign * other->earnings_ticks;
+  node->minutes += sign * other->minutes;
+  node->activity_c += sign * other->activity_c;
+  node->inexact_c += sign * other->inexact_c;
+}
+
+/// Totals of a single row, as an index node.
+static RollupIndexNode row_node(const RollupRow *row) {
+  return (RollupIndexNode){
+      .earnings = row->earnings,
+      .earnings_ticks = row->earnings_ticks,
+      .minutes = row->minutes,
+      .activity_c = row->activity_c,
+      .inexact_c = row->inexact_c,
+  };
+}
+
+/// Rebuilds the index over every row, in O(rows + days). It covers from the
+/// first row's day to at least `ROLLUP_INDEX_HEADROOM` days after the last.
+static void build_index(RollupTable *table) {
+  RollupIndex *index = &table->index;
+  free(index->nodes);
+
+  int64_t span = 0;
+  index->first_day = 0;
+  if (table->row_c) {
+    index->first_day = table->rows[0].day;
+    span = table->rows[table->row_c - 1].day - index->first_day + 1;
+  }
+  index->day_c = 1;
+  while (index->day_c < (size_t)span + ROLLUP_INDEX_HEADROOM) {
+    index->day_c *= 2;
+  }
+  index->nodes = calloc(index->day_c + 1, sizeof(RollupIndexNode));
+
+  // Fill in the leaves, then push each node's totals up to its parent
+  for (size_t i = 0; i < table->row_c; i++) {
+    RollupIndexNode node = row_node(table->rows + i);
+    add_node(index->nodes + (table->rows[i].day - index->first_day + 1), &node,
+             1);
+  }
+  for (size_t i = 1; i <= index->day_c; i++) {
+    size_t parent = i + (i & -i);
+    if (parent <= index->day_c) {
+      add_node(index->nodes + parent, index->nodes + i, 1);
+    }
+  }
+}
+
+/// Adds a row's totals to the index, returning false if its day is outside
+/// the days covered.
+static bool index_add(RollupIndex *index, const RollupRow *row) {
+  if (!index->nodes || row->day < index->first_day ||
+      row->day - index->first_day >= (int64_t)index->day_c) {
+    return false;
+  }
+
+  RollupIndexNode node = row_node(row);
+  for (size_t i = row->day - index->first_day + 1; i <= index->day_c;
+       i += i & -i) {
+    add_node(index->nodes + i, &node, 1);
+  }
+  return true;
+}
+
+/// Sums the totals for every day before `end_day`.
+static RollupIndexNode index_prefix(const RollupIndex *index, int64_t end_day) {
+  RollupIndexNode sum = {0};
+  if (!index->nodes || end_day <= index->first_day) {
+    return sum;
+  }
+
+  size_t position = end_day - index->first_day;
+  if (position > index->day_c) {
+    position = index->day_c;
+  }
+  for (size_t i = position; i; i -= i & -i) {
+    add_node(&sum, index->nodes + i, 1);
+  }
+  return sum;
+}
+
+/// Checks that a rollup header is one this build can read, and that it was not
+/// left part way through an update.
+static bool header_is_valid(const RollupHeader *header) {
+  return header->magic == ROLLUP_MAGIC && header->version == ROLLUP_VERSION &&
+         header->row_size == sizeof(RollupRow) && header->index_day_c &&
+         header->index_day_c <= ROLLUP_INDEX_MAX_DAYS &&
+         header->sorted_c <= header->row_c &&
+         header->row_c - header->sorted_c <= ROLLUP_TAIL_MAX &&
+         !header->updating;
+}
+
+/// Offset of an index node in the rollup file.
+static off_t node_offset(size_t node) {
+  return sizeof(RollupHeader) + node * sizeof(RollupIndexNode);
+}
+
+/// Offset of a row in the rollup file, after every index node.
+static off_t row_offset(const RollupHeader *header, size_t row) {
+  return node_offset(header->index_day_c + 1) + row * sizeof(RollupRow);
+}
+
+/// Reads exactly `length` bytes at an offset.
+static bool read_at(int fd, void *data, size_t length, off_t offset) {
+  return pread(fd, data, length, offset) == (ssize_t)length;
+}
+
+/// Writes exactly `length` bytes at an offset.
+static bool write_at(int fd, const void *data, size_t length, off_t offset) {
+  return pwrite(fd, data, length, offset) == (ssize_t)length;
+}
+
+/// Reads the rollup file as-is.
+static RollupError read_rollups(RollupTable *table_out) {
+  Filepath rollup_path;
+  if (fs_expand_from_home(ROLLUP_FILE, rollup_path)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+
+  int fd = open(rollup_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ROLLUP_FORMAT_ERROR;
+  }
+
+  struct stat st;
+  RollupHeader header;
+  if (fstat(fd, &st) || !read_at(fd, &header, sizeof(header), 0) ||
+      !header_is_valid(&header) ||
+      header.row_c > (uint64_t)st.st_size / sizeof(RollupRow) ||
+      row_offset(&header, header.row_c) > st.st_size) {
+    close(fd);
+    return ROLLUP_FORMAT_ERROR;
+  }
+
+  RollupRow *rows =
+      malloc(sizeof(RollupRow) * (header.row_c ? header.row_c : 1));
+  RollupIndexNode *nodes =
+      malloc(sizeof(RollupIndexNode) * (header.index_day_c + 1));
+  bool ok = read_at(fd, nodes,
+                    sizeof(RollupIndexNode) * (header.index_day_c + 1),
+                    node_offset(0)) &&
+            read_at(fd, rows, sizeof(RollupRow) * header.row_c,
+                    row_offset(&header, 0));
+  close(fd);
+  if (!ok) {
+    free(rows);
+    free(nodes);
+    return ROLLUP_FORMAT_ERROR;
+  }
+
+  // Rows emptied in place are dropped, and those appended put back in order
+  size_t row_c = 0;
+  for (size_t i = 0; i < header.row_c; i++) {
+    if (rows[i].activity_c) {
+      rows[row_c++] = rows[i];
+    }
+  }
+  if (header.sorted_c < header.row_c) {
+    qsort(rows, row_c, sizeof(RollupRow), compare_rows);
+  }
+
+  *table_out = (RollupTable){
+      .rows = rows,
+      .row_c = row_c,
+      .index =
+          {
+              .first_day = header.index_first_day,
+              .day_c = header.index_day_c,
+              .nodes = nodes,
+          },
+      .device = st.st_dev,
+      .inode = st.st_ino,
+      .generation = header.generation,
+  };
+
+  return ROLLUP_OK;
+}
+
+/// Atomically replaces the rollup file, sorted and with no rows appended.
+static RollupError write_rollups(RollupTable *table) {
+  Filepath rollup_path, temp_path;
+  if (fs_expand_from_home(ROLLUP_FILE, rollup_path) ||
+      fs_get_temp_path(rollup_path, temp_path)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+
+  FILE *file = fopen(temp_path, "wb");
+  if (!file) {
+    return ROLLUP_WRITE_ERROR;
+  }
+
+  RollupHeader header = {
+      .magic = ROLLUP_MAGIC,
+      .version = ROLLUP_VERSION,
+      .row_size = sizeof(RollupRow),
+      .row_c = table->row_c,
+      .index_first_day = table->index.first_day,
+      .index_day_c = table->index.day_c,
+      .sorted_c = table->row_c,
+      .generation = table->generation + 1,
+  };
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(table->index.nodes, sizeof(RollupIndexNode),
+                   table->index.day_c + 1, file) == table->index.day_c + 1 &&
+            fwrite(table->rows, sizeof(RollupRow), table->row_c, file) ==
+                table->row_c;
+  if (fclose(file) || !ok || rename(temp_path, rollup_path)) {
+    remove(temp_path);
+    return ROLLUP_WRITE_ERROR;
+  }
+
+  // The table now matches the new file
+  struct stat st;
+  if (!stat(rollup_path, &st)) {
+    table->device = st.st_dev;
+    table->inode = st.st_ino;
+    table->generation = header.generation;
+  }
+
+  return ROLLUP_OK;
+}
+
+/// The rollup file, open to be updated in place with the index lock held.
+typedef struct RollupFile {
+  int fd;
+  RollupHeader header;
+} RollupFile;
+
+/// Opens the rollup file to update in place, `ROLLUP_FORMAT_ERROR` meaning
+/// there is none that can be.
+static RollupError open_rollups(RollupFile *file_out) {
+  Filepath rollup_path;
+  if (fs_expand_from_home(ROLLUP_FILE, rollup_path)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+
+  int fd = open(rollup_path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    return ROLLUP_FORMAT_ERROR;
+  }
+  if (!read_at(fd, &file_out->header, sizeof(RollupHeader), 0) ||
+      !header_is_valid(&file_out->header)) {
+    close(fd);
+    return ROLLUP_FORMAT_ERROR;
+  }
+
+  file_out->fd = fd;
+  return ROLLUP_OK;
+}
+
+/// Marks the file as being updated, so that if the update does not finish the
+/// file is rebuilt rather than read half-written.
+static RollupError begin_update(RollupFile *file) {
+  file->header.updating = 1;
+  if (!write_at(file->fd, &file->header, sizeof(RollupHeader), 0)) {
+    close(file->fd);
+    return ROLLUP_WRITE_ERROR;
+  }
+  return ROLLUP_OK;
+}
+
+/// Writes back the header and closes the file, unless the update failed part
+/// way, which leaves it marked to be rebuilt.
+static RollupError finish_update(RollupFile *file, RollupError error) {
+  if (!error) {
+    file->header.updating = 0;
+    file->header.generation++;
+    if (!write_at(file->fd, &file->header, sizeof(RollupHeader), 0)) {
+      error = ROLLUP_WRITE_ERROR;
+    }
+  }
+  close(file->fd);
+  return error;
+}
+
+/// Checks if the file's index covers a day.
+static bool file_covers(const RollupFile *file, int64_t day) {
+  return day >= file->header.index_first_day &&
+         day - file->header.index_first_day <
+             (int64_t)file->header.index_day_c;
+}
+
+/// Adds a change in a day's totals to the index nodes over it, reading and
+/// writing only those O(log days) nodes. The day must be covered.
+static RollupError file_index_add(RollupFile *file, int64_t day,
+                                  const RollupIndexNode *delta) {
+  for (size_t i = day - file->header.index_first_day + 1;
+       i <= file->header.index_day_c; i += i & -i) {
+    RollupIndexNode node;
+    if (!read_at(file->fd, &node, sizeof(node), node_offset(i))) {
+      return ROLLUP_FORMAT_ERROR;
+    }
+    add_node(&node, delta, 1);
+    if (!write_at(file->fd, &node, sizeof(node), node_offset(i))) {
+      return ROLLUP_WRITE_ERROR;
+    }
+  }
+  return ROLLUP_OK;
+}
+
+/// Writes a row in place, appending it if `position` is `row_c`, and adds the
+/// change from the row it replaces to the index.
+static RollupError file_write_row(RollupFile *file, size_t position,
+                                  const RollupRow *old, const RollupRow *row) {
+  if (!write_at(file->fd, row, sizeof(RollupRow),
+                row_offset(&file->header, position))) {
+    return ROLLUP_WRITE_ERROR;
+  }
+  if (position == file->header.row_c) {
+    file->header.row_c++;
+  }
+
+  RollupIndexNode delta = row_node(row);
+  RollupIndexNode old_node = row_node(old);
+  add_node(&delta, &old_node, -1);
+  return file_index_add(file, row->day, &delta);
+}
+
+/// Finds the row for a day and project in the file, by a binary search over
+/// the sorted rows then a scan of those appended. `found_out` is false if
+/// there is none.
+static RollupError file_find_row(const RollupFile *file, const RollupRow *key,
+                                 size_t *position_out, RollupRow *row_out,
+                                 bool *found_out) {
+  const RollupHeader *header = &file->header;
+  *found_out = false;
+
+  size_t low = 0, high = header->sorted_c;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (!read_at(file->fd, row_out, sizeof(RollupRow),
+                 row_offset(header, middle))) {
+      return ROLLUP_FORMAT_ERROR;
+    }
+
+    int order = compare_rows(row_out, key);
+    if (!order) {
+      *position_out = middle;
+      *found_out = true;
+      return ROLLUP_OK;
+    }
+    if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  // At most `ROLLUP_TAIL_MAX`, read in one go
+  size_t tail_c = header->row_c - header->sorted_c;
+  if (!tail_c) {
+    return ROLLUP_OK;
+  }
+  RollupRow *tail = malloc(sizeof(RollupRow) * tail_c);
+  if (!read_at(file->fd, tail, sizeof(RollupRow) * tail_c,
+               row_offset(header, header->sorted_c))) {
+    free(tail);
+    return ROLLUP_FORMAT_ERROR;
+  }
+  for (size_t i = 0; i < tail_c && !*found_out; i++) {
+    if (!compare_rows(tail + i, key)) {
+      *position_out = header->sorted_c + i;
+      *row_out = tail[i];
+      *found_out = true;
+    }
+  }
+  free(tail);
+
+  return ROLLUP_OK;
+}
+
+/// Activities streamed from one project, without their descriptions.
+typedef struct ProjectSummaries {
+  ProjectId id;
+  double default_rate;
+  ActivitySummary *activities;
+  size_t activity_c;
+  size_t capacity;
+  FileError error;
+} ProjectSummaries;
+
+/// Stream callback collecting a project's summaries.
+static bool collect_summary(void *_summaries,
+                            const ProjectStreamHeader *header,
+                            const ActivitySummary *activity) {
+  ProjectSummaries *summaries = _summaries;
+  if (summaries->activity_c == summaries->capacity) {
+    summaries->capacity = summaries->capacity ? summaries->capacity * 2 : 64;
+    summaries->activities =
+        realloc(summaries->activities,
+                sizeof(ActivitySummary) * summaries->capacity);
+  }
+  summaries->activities[summaries->activity_c++] = *activity;
+  summaries->default_rate = header->default_rate;
+  return true;
+}
+
+/// Streams the summaries of one project, run in parallel over projects.
+static void stream_project(void *_summaries, size_t project) {
+  ProjectSummaries *summaries = (ProjectSummaries *)_summaries + project;
+  summaries->error =
+      fs_stream_activities(summaries->id, collect_summary, summaries);
+}
+
+/// Shared state for building rollup rows in parallel.
+typedef struct RollupBuildJob {
+  const ProjectSummaries *projects;
+  const ParallelChunk *chunks;
+  /// Read-only, shared by every chunk
+  const Calendar *calendar;
+  /// One row per activity, each chunk writing and merging its own range
+  RollupRow *rows;
+  /// Rows left in each chunk's range after merging
+  size_t *row_cs;
+} RollupBuildJob;
+
+/// Builds and merges the rows for one chunk of activities.
+static void build_chunk_rows(void *_job, size_t chunk_index) {
+  RollupBuildJob *job = _job;
+  const ParallelChunk *chunk = job->chunks + chunk_index;
+  const ProjectSummaries *project = job->projects + chunk->project;
+
+  RollupTable table = {.rows = job->rows + chunk->offset, .row_c = 0};
+  for (size_t i = chunk->first; i < chunk->last; i++) {
+    const ActivitySummary *activity = project->activities + i;
+    double rate =
+        activity->rate.present ? activity->rate.value : project->default_rate;
+    table.rows[table.row_c++] = activity_row(activity, rate, job->calendar);
+  }
+  merge_rows(&table);
+
+  job->row_cs[chunk_index] = table.row_c;
+}
+
+/// Builds the rollups from scratch by streaming every project.
+static RollupError build_rollups(RollupTable *table_out) {
+  Project **headers;
+  size_t project_c;
+  if (fs_get_project_headers(&headers, &project_c)) {
+    return ROLLUP_REBUILD_ERROR;
+  }
+
+  // Only the fields sums need are kept, never whole projects
+  ProjectSummaries *projects =
+      calloc(project_c ? project_c : 1, sizeof(ProjectSummaries));
+  for (size_t i = 0; i < project_c; i++) {
+    projects[i].id = headers[i]->id;
+  }
+  fs_free_project_list(headers, project_c);
+  parallel_run(project_c, stream_project, projects);
+
+  // Day boundaries are worked out once, rather than per activity
+  size_t *activity_cs = malloc(sizeof(size_t) * (project_c ? project_c : 1));
+  unsigned long start = 0, end = 0;
+  bool any = false;
+  for (size_t i = 0; i < project_c; i++) {
+    if (projects[i].error) {
+      printf("Failed to stream project %zu (error %d)\n", projects[i].id,
+             projects[i].error);
+      projects[i].activity_c = 0;
+    }
+    activity_cs[i] = projects[i].activity_c;
+
+    for (size_t j = 0; j < projects[i].activity_c; j++) {
+      unsigned long time = projects[i].activities[j].time;
+      start = !any || time < start ? time : start;
+      end = !any || time > end ? time : end;
+      any = true;
+    }
+  }
+  Calendar calendar = {0};
+  if (any) {
+    calendar_build((time_t)start, (time_t)end, &calendar);
+  }
+
+  // Fixed chunks, each merged on its own (in parallel) into one row per day
+  // and project
+  size_t chunk_c;
+  ParallelChunk *chunks =
+      parallel_activity_chunks(activity_cs, project_c, &chunk_c);
+  size_t activity_c =
+      chunk_c ? chunks[chunk_c - 1].offset + chunks[chunk_c - 1].last -
+                    chunks[chunk_c - 1].first
+              : 0;
+  RollupBuildJob job = {
+      .projects = projects,
+      .chunks = chunks,
+      .calendar = &calendar,
+      .rows = malloc(sizeof(RollupRow) * (activity_c ? activity_c : 1)),
+      .row_cs = malloc(sizeof(size_t) * (chunk_c ? chunk_c : 1)),
+  };
+  parallel_run(chunk_c, build_chunk_rows, &job);
+  calendar_free(&calendar);
+  for (size_t i = 0; i < project_c; i++) {
+    free(projects[i].activities);
+  }
+  free(projects);
+  free(activity_cs);
+
+  // Then combined in chunk order, so sums are added in the same order no
+  // matter which thread ran which chunk
+  RollupTable table = {.rows = job.rows, .row_c = 0};
+  for (size_t i = 0; i < chunk_c; i++) {
+    memmove(table.rows + table.row_c, job.rows + chunks[i].offset,
+            sizeof(RollupRow) * job.row_cs[i]);
+    table.row_c += job.row_cs[i];
+  }
+  free(job.row_cs);
+  free(chunks);
+
+  merge_rows(&table);
+  build_index(&table);
+  *table_out = table;
+
+  return ROLLUP_OK;
+}
+
+RollupError rollup_load(RollupTable *table_out) {
+  // Shared, nothing is updated in place while it is read
+  int lock_fd;
+  if (fs_lock_index(false, &lock_fd)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+  RollupError error = read_rollups(table_out);
+  fs_unlock(lock_fd);
+  if (!error) {
+    return ROLLUP_OK;
+  }
+
+  // Rebuilt under the lock, so no activity logged meanwhile is missed or
+  // counted twice. Another process may have rebuilt it while waiting.
+  if (fs_lock_index(true, &lock_fd)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+  if (!read_rollups(table_out)) {
+    fs_unlock(lock_fd);
+    return ROLLUP_OK;
+  }
+  error = build_rollups(table_out);
+  if (!error) {
+    // Failing to persist only costs another rebuild next time
+    RollupError write_error = write_rollups(table_out);
+    if (write_error) {
+      printf("Failed to write rollups (error %d)\n", write_error);
+    }
+  }
+  fs_unlock(lock_fd);
+
+  return error;
+}
+
+bool rollup_is_current(const RollupTable *table) {
+  Filepath rollup_path;
+  if (fs_expand_from_home(ROLLUP_FILE, rollup_path)) {
+    return false;
+  }
+
+  int fd = open(rollup_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  // Updates in place can leave the size and modification time unchanged, but
+  // not the generation
+  struct stat st;
+  RollupHeader header;
+  bool ok = !fstat(fd, &st) && read_at(fd, &header, sizeof(header), 0);
+  close(fd);
+
+  return ok && st.st_dev == table->device && st.st_ino == table->inode &&
+         header.generation == table->generation && !header.updating;
+}
+
+void rollup_free(RollupTable *table) {
+  free(table->rows);
+  free(table->index.nodes);
+  memset(table, 0, sizeof(RollupTable));
+}
+
+size_t rollup_lower_bound(const RollupTable *table, int64_t day) {
+  size_t low = 0, high = table->row_c;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (table->rows[middle].day < day) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void rollup_sum(const RollupTable *table, int64_t first_day, int64_t end_day,
+                RollupTotals *totals_out) {
+  // Difference of two prefix sums, rather than a walk over the rows
+  RollupIndexNode sum = {0};
+  if (first_day < end_day) {
+    sum = index_prefix(&table->index, end_day);
+    RollupIndexNode before = index_prefix(&table->index, first_day);
+    add_node(&sum, &before, -1);
+  }
+
+  *totals_out = (RollupTotals){
+      .earnings = sum.earnings,
+      .earnings_ticks = sum.earnings_ticks,
+      .minutes = sum.minutes,
+      .activity_c = sum.activity_c,
+      .inexact_c = sum.inexact_c,
+  };
+}
+
+/// Adds a row to the table held in the file and rewrites it whole, used when
+/// the row cannot be added in place.
+static RollupError add_row_whole(const RollupRow *row) {
+  RollupTable table;
+  if (read_rollups(&table)) {
+    return ROLLUP_OK;
+  }
+
+  RollupRow *existing = bsearch(row, table.rows, table.row_c,
+                                sizeof(RollupRow), compare_rows);
+  if (existing) {
+    add_row(existing, row);
+  } else {
+    // Insert, keeping rows sorted
+    table.rows = realloc(table.rows, sizeof(RollupRow) * (table.row_c + 1));
+    size_t position = table.row_c;
+    while (position && compare_rows(table.rows + position - 1, row) > 0) {
+      position--;
+    }
+    memmove(table.rows + position + 1, table.rows + position,
+            sizeof(RollupRow) * (table.row_c - position));
+    table.rows[position] = *row;
+    table.row_c++;
+  }
+
+  // Only rebuilt when the activity is outside the days the index covers
+  if (!index_add(&table.index, row)) {
+    build_index(&table);
+  }
+
+  RollupError error = write_rollups(&table);
+  rollup_free(&table);
+
+  return error;
+}
+
+RollupError rollup_add_activity(const Activity *activity, double rate) {
+  // No usable rollups yet, the next load will rebuild them with this activity
+  RollupFile file;
+  if (open_rollups(&file)) {
+    return ROLLUP_OK;
+  }
+
+  Calendar calendar = {0}; // Empty, a single activity is looked up directly
+  ActivitySummary summary = activity_summarise(activity);
+  RollupRow row = activity_row(&summary, rate, &calendar);
+
+  size_t position;
+  RollupRow existing;
+  bool found;
+  RollupError error = file_find_row(&file, &row, &position, &existing, &found);
+  if (error) {
+    close(file.fd);
+    return error;
+  }
+
+  // Outside the days the index covers, or too many rows appended already
+  if (!file_covers(&file, row.day) ||
+      (!found && file.header.row_c - file.header.sorted_c >= ROLLUP_TAIL_MAX)) {
+    close(file.fd);
+    return add_row_whole(&row);
+  }
+
+  PROPAGATE(RollupError, begin_update, (&file));
+  if (found) {
+    RollupRow updated = existing;
+    add_row(&updated, &row);
+    error = file_write_row(&file, position, &existing, &updated);
+  } else {
+    error = file_write_row(&file, file.header.row_c, &(RollupRow){0}, &row);
+  }
+
+  return finish_update(&file, error);
+}
+
+/// Replaces a project's rows in the table held in the file and rewrites it
+/// whole.
+static RollupError replace_rows_whole(ProjectId id, const RollupRow *rows,
+                                      size_t row_c) {
+  RollupTable table;
+  if (read_rollups(&table)) {
+    return ROLLUP_OK;
+  }
+
+  remove_project_rows(&table, id);
+  table.rows =
+      realloc(table.rows, sizeof(RollupRow) * (table.row_c + row_c + 1));
+  memcpy(table.rows + table.row_c, rows, sizeof(RollupRow) * row_c);
+  table.row_c += row_c;
+  merge_rows(&table);
+  build_index(&table);
+
+  RollupError error = write_rollups(&table);
+  rollup_free(&table);
+
+  return error;
+}
+
+/// A project's row as stored in the file, and where.
+typedef struct StoredRow {
+  size_t position;
+  RollupRow row;
+} StoredRow;
+
+static int compare_stored_rows(const void *a, const void *b) {
+  return compare_rows(&((const StoredRow *)a)->row,
+                      &((const StoredRow *)b)->row);
+}
+
+/// A row to write in place, over `old` at `position`, or appended.
+typedef struct RowChange {
+  size_t position;
+  bool append;
+  RollupRow old;
+  RollupRow row;
+} RowChange;
+
+/// Replaces a project's rows with `rows`, sorted with one per day. Only the
+/// rows that change and the index nodes over them are written in place, rows
+/// that go are left empty. Falls back to rewriting the file when that writes
+/// less, or the new rows do not fit.
+static RollupError replace_rows(ProjectId id, const RollupRow *rows,
+                                size_t row_c) {
+  RollupFile file;
+  if (open_rollups(&file)) {
+    return ROLLUP_OK;
+  }
+
+  // Every row is read to find the project's, only changes are written
+  const RollupHeader *header = &file.header;
+  RollupRow *all = malloc(sizeof(RollupRow) * (header->row_c + 1));
+  if (!read_at(file.fd, all, sizeof(RollupRow) * header->row_c,
+               row_offset(header, 0))) {
+    free(all);
+    close(file.fd);
+    return ROLLUP_FORMAT_ERROR;
+  }
+  StoredRow *stored = malloc(sizeof(StoredRow) * (header->row_c + 1));
+  size_t stored_c = 0;
+  for (size_t i = 0; i < header->row_c; i++) {
+    if (all[i].project_id == id) {
+      stored[stored_c++] = (StoredRow){.position = i, .row = all[i]};
+    }
+  }
+  free(all);
+  qsort(stored, stored_c, sizeof(StoredRow), compare_stored_rows);
+
+  // Pair stored and new rows by day
+  RowChange *changes = malloc(sizeof(RowChange) * (stored_c + row_c + 1));
+  size_t change_c = 0, append_c = 0;
+  bool covered = true;
+  size_t i = 0, j = 0;
+  while (i < stored_c || j < row_c) {
+    int order = i == stored_c ? 1
+                : j == row_c  ? -1
+                              : compare_rows(&stored[i].row, rows + j);
+    if (order < 0) {
+      // Gone, left empty
+      if (stored[i].row.activity_c) {
+        changes[change_c++] = (RowChange){
+            .position = stored[i].position,
+            .old = stored[i].row,
+            .row = {.day = stored[i].row.day, .project_id = id},
+        };
+      }
+      i++;
+    } else if (order > 0) {
+      covered = covered && file_covers(&file, rows[j].day);
+      changes[change_c++] = (RowChange){.append = true, .row = rows[j++]};
+      append_c++;
+    } else {
+      if (memcmp(&stored[i].row, rows + j, sizeof(RollupRow))) {
+        changes[change_c++] = (RowChange){
+            .position = stored[i].position,
+            .old = stored[i].row,
+            .row = rows[j],
+        };
+      }
+      i++;
+      j++;
+    }
+  }
+  free(stored);
+
+  // Each change writes its row and O(log days) nodes, a rewrite every row and
+  // node
+  size_t log_days = 0;
+  while (((size_t)1 << log_days) < header->index_day_c) {
+    log_days++;
+  }
+  bool fits = covered && header->row_c - header->sorted_c + append_c <=
+                             ROLLUP_TAIL_MAX;
+  if (!fits ||
+      change_c * (log_days + 2) > header->row_c + header->index_day_c) {
+    free(changes);
+    close(file.fd);
+    return replace_rows_whole(id, rows, row_c);
+  }
+  if (!change_c) {
+    free(changes);
+    close(file.fd);
+    return ROLLUP_OK;
+  }
+
+  RollupError error = begin_update(&file);
+  if (error) {
+    free(changes);
+    return error;
+  }
+  for (size_t k = 0; k < change_c && !error; k++) {
+    RowChange *change = changes + k;
+    error = file_write_row(&file,
+                           change->append ? file.header.row_c
+                                          : change->position,
+                           &change->old, &change->row);
+  }
+  free(changes);
+
+  return finish_update(&file, error);
+}
+
+RollupError rollup_replace_project(ProjectId id) {
+  // Read back as stored, the snapshot and then any journal records newer than
+  // it, which the index counts as well
+  ProjectSummaries summaries = {.id = id};
+  if (fs_stream_activities(id, collect_summary, &summaries)) {
+    free(summaries.activities);
+    return ROLLUP_REBUILD_ERROR;
+  }
+
+  unsigned long start = 0, end = 0;
+  for (size_t i = 0; i < summaries.activity_c; i++) {
+    unsigned long time = summaries.activities[i].time;
+    start = !i || time < start ? time : start;
+    end = !i || time > end ? time : end;
+  }
+  Calendar calendar = {0};
+  if (summaries.activity_c) {
+    calendar_build((time_t)start, (time_t)end, &calendar);
+  }
+
+  RollupTable table = {
+      .rows = malloc(sizeof(RollupRow) * (summaries.activity_c + 1)),
+  };
+  for (size_t i = 0; i < summaries.activity_c; i++) {
+    const ActivitySummary *activity = summaries.activities + i;
+    double rate = activity->rate.present ? activity->rate.value
+                                         : summaries.default_rate;
+    table.rows[table.row_c++] = activity_row(activity, rate, &calendar);
+  }
+  calendar_free(&calendar);
+  free(summaries.activities);
+  merge_rows(&table);
+
+  RollupError error = replace_rows(id, table.rows, table.row_c);
+  free(table.rows);
+
+  return error;
+}
+
+RollupError rollup_remove_project(ProjectId id) {
+  return replace_rows(id, NULL, 0);
+}
+
+/// Prints a row that differs between the stored and rebuilt tables, either of
+/// which may be missing.
+static void report_difference(const RollupRow *stored,
+                              const RollupRow *rebuilt) {
+  const RollupRow *row = stored ? stored : rebuilt;
+  int year, month, day;
+  calendar_civil_from_days(row->day, &year, &month, &day);
+
+  printf("%.4d/%.2d/%.2d, project %zu: ", year, month, day,
+         (size_t)row->project_id);
+  if (stored) {
+    printf("stored £%.2f over %zu activities, ", stored->earnings,
+           (size_t)stored->activity_c);
+  } else {
+    printf("not stored, ");
+  }
+  if (rebuilt) {
+    printf("rebuilt £%.2f over %zu activities\n", rebuilt->earnings,
+           (size_t)rebuilt->activity_c);
+  } else {
+    printf("no activities\n");
+  }
+}
+
+RollupError rollup_verify(size_t *difference_c_out) {
+  // Held throughout, so nothing is logged between reading and rebuilding
+  int lock_fd;
+  if (fs_lock_index(true, &lock_fd)) {
+    return ROLLUP_OPEN_ERROR;
+  }
+
+  RollupTable stored = {0}, rebuilt;
+  if (read_rollups(&stored)) {
+    printf("No stored rollups, rebuilding\n");
+  }
+  RollupError error = build_rollups(&rebuilt);
+  if (error) {
+    rollup_free(&stored);
+    fs_unlock(lock_fd);
+    return error;
+  }
+
+  // Walk both sorted tables together
+  size_t difference_c = 0;
+  size_t i = 0, j = 0;
+  while (i < stored.row_c || j < rebuilt.row_c) {
+    const RollupRow *stored_row = i < stored.row_c ? stored.rows + i : NULL;
+    const RollupRow *rebuilt_row = j < rebuilt.row_c ? rebuilt.rows + j : NULL;
+
+    int order = !stored_row    ? 1
+                : !rebuilt_row ? -1
+                               : compare_rows(stored_row, rebuilt_row);
+    if (order < 0) {
+      report_difference(stored_row, NULL);
+      difference_c++;
+      i++;
+    } else if (order > 0) {
+      report_difference(NULL, rebuilt_row);
+      difference_c++;
+      j++;
+    } else {
+      double earnings_difference =
+          stored_row->earnings - rebuilt_row->earnings;
+      if (earnings_difference > EARNINGS_TOLERANCE ||
+          earnings_difference < -EARNINGS_TOLERANCE ||
+          stored_row->earnings_ticks != rebuilt_row->earnings_ticks ||
+          stored_row->minutes != rebuilt_row->minutes ||
+          stored_row->activity_c != rebuilt_row->activity_c) {
+        report_difference(stored_row, rebuilt_row);
+        difference_c++;
+      }
+      i++;
+      j++;
+    }
+  }
+
+  // Rates with fractions of a penny cannot be represented exactly, and are
+  // rounded in fixed-point totals
+  size_t inexact_c = 0;
+  for (size_t k = 0; k < rebuilt.row_c; k++) {
+    inexact_c += rebuilt.rows[k].inexact_c;
+  }
+  if (inexact_c) {
+    printf("%zu activities have rates in fractions of a penny\n", inexact_c);
+  }
+
+  // Rebuilt table is authoritative from here on
+  rebuilt.generation = stored.generation;
+  error = write_rollups(&rebuilt);
+  fs_unlock(lock_fd);
+  rollup_free(&stored);
+  rollup_free(&rebuilt);
+
+  *difference_c_out = difference_c;
+
+  return error;
+}
@@ -0,0 +1,146 @@
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+#include "activity.h"
+#include "money.h"
+#include "project.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// Identifies a rollup file ("FMRU").
+#define ROLLUP_MAGIC (0x55524d46)
+/// Current rollup format version, older files (without exact earnings, the
+/// day index or in-place updates) are rebuilt from the project files on load.
+#define ROLLUP_VERSION (4)
+/// Least number of days the index covers after the last row, so that logging
+/// new activities rarely has to rebuild it.
+#define ROLLUP_INDEX_HEADROOM (366)
+/// Most rows appended to the file in place, out of order, before it is written
+/// whole again.
+#define ROLLUP_TAIL_MAX (256)
+
+typedef enum RollupError {
+  ROLLUP_OK = 0,
+  /// Something went wrong opening or reading the rollup file.
+  ROLLUP_OPEN_ERROR,
+  /// Something went wrong writing the rollup file.
+  ROLLUP_WRITE_ERROR,
+  /// The rollup file is missing, truncated or from another version.
+  ROLLUP_FORMAT_ERROR,
+  /// Something went wrong reloading the projects to rebuild the rollups.
+  ROLLUP_REBUILD_ERROR,
+} RollupError;
+
+/// Totals for the activities logged to one project on one (local) day.
+typedef struct RollupRow {
+  /// Days since 1970/01/01, see `calendar_day`.
+  int64_t day;
+  uint64_t project_id;
+  double earnings;
+  /// Exact earnings, rates rounded to whole pence.
+  int64_t earnings_ticks;
+  uint64_t minutes;
+  uint64_t activity_c;
+  /// Activities whose rate is not a whole number of pence, so whose
+  /// `earnings_ticks` are rounded.
+  uint64_t inexact_c;
+} RollupRow;
+
+/// Totals held by a node of the day index, covering a power-of-two run of days.
+typedef struct RollupIndexNode {
+  double earnings;
+  int64_t earnings_ticks;
+  uint64_t minutes;
+  uint64_t activity_c;
+  uint64_t inexact_c;
+} RollupIndexNode;
+
+/// Fenwick tree over the daily totals of every project, so that the totals
+/// for any range of days take O(log days) to sum or update.
+typedef struct RollupIndex {
+  /// Day covered by the first leaf.
+  int64_t first_day;
+  /// Days covered, a power of two.
+  size_t day_c;
+  /// One-based, `day_c + 1` entries with the first unused.
+  RollupIndexNode *nodes;
+} RollupIndex;
+
+/// Header at the start of the rollup file, followed by the `index_day_c + 1`
+/// index nodes and then `row_c` rows. The first `sorted_c` rows are sorted by
+/// day and then project ID, the rest were appended in place since. Rows left
+/// with no activities by an update in place are dropped on load.
+typedef struct RollupHeader {
+  uint32_t magic;
+  uint32_t version;
+  /// `sizeof(RollupRow)` when written, guards against layout changes.
+  uint64_t row_size;
+  uint64_t row_c;
+  int64_t index_first_day;
+  uint64_t index_day_c;
+  uint64_t sorted_c;
+  /// Bumped by every write, so readers can tell their copy is out of date.
+  uint64_t generation;
+  /// Set while rows and nodes are written in place, a file left with it set
+  /// is rebuilt.
+  uint64_t updating;
+} RollupHeader;
+
+/// In-memory copy of the rollup table.
+typedef struct RollupTable {
+  /// Rows sorted by day and then project ID.
+  RollupRow *rows;
+  size_t row_c;
+  /// Index over the rows, kept in step with them.
+  RollupIndex index;
+  /// File the table was read from or written to, see `rollup_is_current`.
+  uint64_t device;
+  uint64_t inode;
+  uint64_t generation;
+} RollupTable;
+
+/// Sum of a range of rollup rows.
+typedef struct RollupTotals {
+  double earnings;
+  MoneyTicks earnings_ticks;
+  unsigned long minutes;
+  size_t activity_c;
+  size_t inexact_c;
+} RollupTotals;
+
+/// Loads the rollup table, rebuilding it from the project files if it is
+/// missing. Takes the index lock.
+RollupError rollup_load(RollupTable *table_out);
+/// Checks that nothing has written the rollup file since the table was loaded.
+bool rollup_is_current(const RollupTable *table);
+/// Frees a loaded rollup table.
+void rollup_free(RollupTable *table);
+/// Index of the first row for `day` or later.
+size_t rollup_lower_bound(const RollupTable *table, int64_t day);
+/// Sums every row for the days `[first_day, end_day)`, in O(log days) through
+/// the index.
+void rollup_sum(const RollupTable *table, int64_t first_day, int64_t end_day,
+                RollupTotals *totals_out);
+
+/// Adds an activity appended to a project's journal, at the given hourly rate.
+/// Only its row and the index nodes over its day are written. The index lock
+/// must be held.
+RollupError rollup_add_activity(const Activity *activity, double rate);
+/// Replaces a project's rows after its file has been written, e.g. after its
+/// default rate has changed. Rows are built from the project as stored, its
+/// snapshot and then any journal records newer than it. Only changed rows are
+/// written, unless rewriting the file is cheaper. The index lock must be held.
+RollupError rollup_replace_project(ProjectId id);
+/// Removes a project's rows after its file has been deleted. The index lock
+/// must be held.
+RollupError rollup_remove_project(ProjectId id);
+
+/// Rebuilds the rollups from the project files, printing every row that
+/// differs from the stored table, then stores the rebuilt table. Takes the
+/// index lock.
+RollupError rollup_verify(size_t *difference_c_out);
+
+#endif
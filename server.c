@@ -0,0 +1,366 @@
+#include "server.h"
+
+#include "cli.h"
+#include "error.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Set once interrupted or terminated, the current request is still finished.
+static volatile sig_atomic_t stopping;
+
+static void stop(int _signal) { stopping = 1; }
+
+static ServerError socket_address(struct sockaddr_un *address_out) {
+  Filepath path;
+  if (fs_expand_from_home(SERVER_SOCKET_FILE, path) ||
+      strlen(path) >= sizeof(address_out->sun_path)) {
+    return SERVER_SOCKET_ERROR;
+  }
+
+  memset(address_out, 0, sizeof(struct sockaddr_un));
+  address_out->sun_family = AF_UNIX;
+  strcpy(address_out->sun_path, path);
+
+  return SERVER_OK;
+}
+
+static ServerError write_all(int fd, const void *data, size_t length) {
+  const char *position = data;
+  while (length) {
+    // Never raise SIGPIPE if the other end has gone away
+    ssize_t written = send(fd, position, length, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return SERVER_PROTOCOL_ERROR;
+    }
+    position += written;
+    length -= written;
+  }
+
+  return SERVER_OK;
+}
+
+static ServerError read_all(int fd, void *data, size_t length) {
+  char *position = data;
+  while (length) {
+    ssize_t length_read = read(fd, position, length);
+    if (length_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length_read <= 0) {
+      return SERVER_PROTOCOL_ERROR;
+    }
+    position += length_read;
+    length -= length_read;
+  }
+
+  return SERVER_OK;
+}
+
+static ServerError write_message(int fd, const void *data, size_t length) {
+  if (length > SERVER_MESSAGE_MAX) {
+    return SERVER_PROTOCOL_ERROR;
+  }
+
+  uint32_t prefix = length;
+  PROPAGATE(ServerError, write_all, (fd, &prefix, sizeof(prefix)));
+  return write_all(fd, data, length);
+}
+
+/// Reads a message into a caller-owned buffer, NUL-terminated for convenience.
+static ServerError read_message(int fd, char **data_out, size_t *length_out) {
+  uint32_t length;
+  PROPAGATE(ServerError, read_all, (fd, &length, sizeof(length)));
+  if (length > SERVER_MESSAGE_MAX) {
+    return SERVER_PROTOCOL_ERROR;
+  }
+
+  char *data = malloc(length + 1);
+  ServerError error = read_all(fd, data, length);
+  if (error) {
+    free(data);
+    return error;
+  }
+  data[length] = '\0';
+
+  *data_out = data;
+  *length_out = length;
+  return SERVER_OK;
+}
+
+/// Splits NUL-terminated arguments back into an array (caller-owned, pointing
+/// into `arguments`).
+static ServerError split_arguments(char *arguments, size_t length,
+                                   char ***argv_out, int *argc_out) {
+  if (length && arguments[length - 1]) {
+    return SERVER_PROTOCOL_ERROR;
+  }
+
+  int argc = 0;
+  for (size_t i = 0; i < length; i++) {
+    argc += !arguments[i];
+  }
+
+  char **argv = malloc(sizeof(char *) * (argc + 1));
+  char *argument = arguments;
+  for (int i = 0; i < argc; i++) {
+    argv[i] = argument;
+    argument += strlen(argument) + 1;
+  }
+  argv[argc] = NULL;
+
+  *argv_out = argv;
+  *argc_out = argc;
+  return SERVER_OK;
+}
+
+/// Runs one client's command, capturing its output to send back.
+static ServerError serve_client(int fd) {
+  // A stuck client must not hold up every other one
+  struct timeval timeout = {.tv_sec = SERVER_TIMEOUT};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  char *arguments;
+  size_t arguments_length;
+  PROPAGATE(ServerError, read_message, (fd, &arguments, &arguments_length));
+
+  char *input;
+  size_t input_length;
+  ServerError error = read_message(fd, &input, &input_length);
+  if (error) {
+    free(arguments);
+    return error;
+  }
+
+  char **argv;
+  int argc;
+  error = split_arguments(arguments, arguments_length, &argv, &argc);
+  if (error) {
+    free(input);
+    free(arguments);
+    return error;
+  }
+
+  char *output = NULL, *errors = NULL;
+  size_t output_length = 0, errors_length = 0;
+  FILE *in = input_length ? fmemopen(input, input_length, "r")
+                          : fopen("/dev/null", "r");
+  FILE *out = open_memstream(&output, &output_length);
+  FILE *err = open_memstream(&errors, &errors_length);
+
+  uint32_t status = CLI_FILE_ERROR;
+  if (in && out && err) {
+    status = cli_run(argc, argv, in, out, err);
+  }
+
+  if (in) {
+    fclose(in);
+  }
+  if (out) {
+    fclose(out);
+  }
+  if (err) {
+    fclose(err);
+  }
+
+  error = write_all(fd, &status, sizeof(status));
+  if (!error) {
+    error = write_message(fd, output, output_length);
+  }
+  if (!error) {
+    error = write_message(fd, errors, errors_length);
+  }
+
+  free(output);
+  free(errors);
+  free(argv);
+  free(input);
+  free(arguments);
+
+  return error;
+}
+
+ServerError server_run(void) {
+  struct sockaddr_un address;
+  PROPAGATE(ServerError, socket_address, (&address));
+
+  // A socket left behind by a process that died is replaced, a live one is
+  // left alone
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe < 0) {
+    return SERVER_SOCKET_ERROR;
+  }
+  bool live = !connect(probe, (struct sockaddr *)&address, sizeof(address));
+  close(probe);
+  if (live) {
+    printf("freeman is already serving on %s\n", address.sun_path);
+    return SERVER_SOCKET_ERROR;
+  }
+  unlink(address.sun_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return SERVER_SOCKET_ERROR;
+  }
+
+  // Only the user may connect
+  mode_t mask = umask(0077);
+  int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+  umask(mask);
+  if (bound || listen(fd, SOMAXCONN)) {
+    close(fd);
+    return SERVER_SOCKET_ERROR;
+  }
+
+  // Interrupt `accept` rather than restarting it, so that the loop can exit
+  struct sigaction action = {.sa_handler = stop};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  // Warm every cache up front, so that the first query is as fast as the rest
+  char *warm_argv[] = {"list", CLI_SEPARATOR, "balance"};
+  FILE *null = fopen("/dev/null", "w");
+  if (null) {
+    cli_run(3, warm_argv, NULL, null, null);
+    fclose(null);
+  }
+
+  printf("Serving on %s\n", address.sun_path);
+  fflush(stdout);
+
+  // Requests are handled one at a time, so forwarded commands never interleave
+  while (!stopping) {
+    int client = accept(fd, NULL, NULL);
+    if (client < 0) {
+      continue; // Interrupted, or the client already gave up
+    }
+
+    ServerError error = serve_client(client);
+    if (error) {
+      printf("Dropped a request (error %d)\n", error);
+    }
+    close(client);
+  }
+
+  close(fd);
+  unlink(address.sun_path);
+
+  return SERVER_OK;
+}
+
+/// Appends a string, including its NUL, to a growing buffer.
+static void append_argument(char **buffer, size_t *length,
+                            const char *argument) {
+  size_t argument_length = strlen(argument) + 1;
+  *buffer = realloc(*buffer, *length + argument_length);
+  memcpy(*buffer + *length, argument, argument_length);
+  *length += argument_length;
+}
+
+/// Reads all of stdin into a caller-owned buffer.
+static ServerError read_input(char **input_out, size_t *length_out) {
+  char *input = NULL;
+  size_t length = 0, capacity = 0;
+  while (!feof(stdin)) {
+    if (length == capacity) {
+      capacity = capacity ? capacity * 2 : 64 * 1024;
+      input = realloc(input, capacity);
+    }
+    length += fread(input + length, 1, capacity - length, stdin);
+    if (ferror(stdin) || length > SERVER_MESSAGE_MAX) {
+      free(input);
+      return SERVER_PROTOCOL_ERROR;
+    }
+  }
+
+  *input_out = input;
+  *length_out = length;
+  return SERVER_OK;
+}
+
+ServerError server_forward(int argc, char **argv, int *status_out) {
+  struct sockaddr_un address;
+  if (socket_address(&address)) {
+    return SERVER_CONNECT_ERROR;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return SERVER_CONNECT_ERROR;
+  }
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+    close(fd);
+    return SERVER_CONNECT_ERROR;
+  }
+
+  // Import paths are made absolute, the resident process has its own working
+  // directory. `import -` reads this process's stdin, which is sent along.
+  char *arguments = NULL, *input = NULL;
+  size_t arguments_length = 0, input_length = 0;
+  bool reads_input = false;
+  for (int i = 0; i < argc; i++) {
+    // Only the argument straight after an `import` command
+    bool import_path = i && !strcmp(argv[i - 1], "import") &&
+                       (i == 1 || !strcmp(argv[i - 2], CLI_SEPARATOR));
+
+    char resolved[PATH_MAX];
+    if (import_path && !strcmp(argv[i], "-")) {
+      reads_input = true;
+    } else if (import_path && realpath(argv[i], resolved)) {
+      append_argument(&arguments, &arguments_length, resolved);
+      continue;
+    }
+    append_argument(&arguments, &arguments_length, argv[i]);
+  }
+
+  ServerError error = SERVER_OK;
+  if (reads_input) {
+    error = read_input(&input, &input_length);
+  }
+  if (!error) {
+    error = write_message(fd, arguments, arguments_length);
+  }
+  if (!error) {
+    error = write_message(fd, input, input_length);
+  }
+  free(arguments);
+  free(input);
+
+  // Relay the response as if the command had run here
+  uint32_t status;
+  if (!error) {
+    error = read_all(fd, &status, sizeof(status));
+  }
+  for (int i = 0; i < 2 && !error; i++) {
+    char *message;
+    size_t message_length;
+    error = read_message(fd, &message, &message_length);
+    if (!error) {
+      fwrite(message, 1, message_length, i ? stderr : stdout);
+      free(message);
+    }
+  }
+  close(fd);
+
+  if (error) {
+    return error;
+  }
+
+  *status_out = status;
+  return SERVER_OK;
+}
@@ -0,0 +1,43 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "filesystem.h"
+
+#include <stdint.h>
+
+/// Unix domain socket the resident process listens on.
+#define SERVER_SOCKET_FILE CONFIG_DIRECTORY "/freeman.sock"
+/// Largest message accepted either way.
+#define SERVER_MESSAGE_MAX (16 * 1024 * 1024)
+/// Seconds a connected client has to send its request.
+#define SERVER_TIMEOUT (5)
+
+typedef enum ServerError {
+  SERVER_OK = 0,
+  /// Something went wrong creating or listening on the socket.
+  SERVER_SOCKET_ERROR,
+  /// No resident process is listening.
+  SERVER_CONNECT_ERROR,
+  /// A message was truncated, too long, or the connection dropped.
+  SERVER_PROTOCOL_ERROR,
+} ServerError;
+
+// Protocol, one request per connection. Every message is a `uint32_t` length
+// (native byte order, the socket is local) followed by that many bytes.
+//
+// Request: the command's arguments, each NUL-terminated, back to back, then
+// the input for `import -` (empty if there is none).
+// Response: the `CliError` status as a `uint32_t`, then the command's output,
+// then its error output.
+
+/// Runs the resident process: keeps projects, preferences, the project index
+/// and rollups loaded, and runs the commands clients send one at a time. Other
+/// processes may still write, the caches notice their changes. Returns once
+/// interrupted or terminated.
+ServerError server_run(void);
+/// Sends a command to the resident process and relays its output, returning
+/// its status. `SERVER_CONNECT_ERROR` means none is running, and the command
+/// should be run in this process instead.
+ServerError server_forward(int argc, char **argv, int *status_out);
+
+#endif
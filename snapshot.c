@@ -0,0 +1,332 @@
+#include "snapshot.h"
+
+#include "calendar.h"
+#include "filesystem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Orders activities by time.
+static int compare_time(const void *a, const void *b) {
+  unsigned long time_a = ((const Activity *)a)->time;
+  unsigned long time_b = ((const Activity *)b)->time;
+  return (time_a > time_b) - (time_a < time_b);
+}
+
+/// Splits time-sorted activities into calendar months, returning a
+/// (caller-owned) partition list.
+static SnapshotPartition *partition_activities(const Activity *activities,
+                                               size_t activity_c,
+                                               size_t *partition_c_out) {
+  SnapshotPartition *partitions = NULL;
+  size_t partition_c = 0;
+  time_t month_end = 0;
+  for (size_t i = 0; i < activity_c; i++) {
+    time_t time = (time_t)activities[i].time;
+
+    // Only convert times once per month, everything before the start of the
+    // next month belongs to the current partition
+    if (!partition_c || time >= month_end) {
+      int64_t day = calendar_day(time);
+      int year, month, day_of_month;
+      calendar_civil_from_days(day, &year, &month, &day_of_month);
+      month_end = calendar_day_start(day - day_of_month + 1 +
+                                     calendar_days_in_month(year, month));
+
+      partitions = realloc(partitions,
+                           sizeof(SnapshotPartition) * (partition_c + 1));
+      partitions[partition_c++] = (SnapshotPartition){
+          .month = (int64_t)(year - 1900) * 12 + month - 1,
+          .first = i,
+          .min_time = activities[i].time,
+      };
+    }
+
+    SnapshotPartition *partition = partitions + partition_c - 1;
+    partition->activity_c++;
+    partition->max_time = activities[i].time;
+  }
+
+  *partition_c_out = partition_c;
+  return partitions;
+}
+
+SnapshotError snapshot_save(const Project *project) {
+  Filepath snapshot_path, temp_path;
+  if (fs_get_project_file(project->id, SNAPSHOT_EXTENSION, snapshot_path) ||
+      fs_get_temp_path(snapshot_path, temp_path)) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  // Partitions need activities in time order, sort a copy if they are not
+  const Activity *activities = project->activities;
+  Activity *sorted = NULL;
+  size_t activities_size = sizeof(Activity) * project->activity_c;
+  for (size_t i = 1; i < project->activity_c; i++) {
+    if (activities[i].time < activities[i - 1].time) {
+      sorted = malloc(activities_size);
+      memcpy(sorted, activities, activities_size);
+      qsort(sorted, project->activity_c, sizeof(Activity), compare_time);
+      activities = sorted;
+      break;
+    }
+  }
+
+  size_t partition_c;
+  SnapshotPartition *partitions =
+      partition_activities(activities, project->activity_c, &partition_c);
+
+  SnapshotHeader header = {
+      .magic = SNAPSHOT_MAGIC,
+      .version = SNAPSHOT_VERSION,
+      .activity_size = sizeof(Activity),
+      .id = project->id,
+      .default_rate = project->default_rate,
+      .journal_seq = project->journal_seq,
+      .activity_c = project->activity_c,
+      .partition_c = partition_c,
+      .project_version = project->version,
+  };
+  snprintf(header.name, sizeof(header.name), "%s", project->name);
+
+  // Write to a temporary file first so a crash never leaves a torn snapshot
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, DEFAULT_PERMISSIONS);
+  if (fd < 0) {
+    free(partitions);
+    free(sorted);
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  size_t partitions_size = sizeof(SnapshotPartition) * partition_c;
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+            (!partitions_size || write(fd, partitions, partitions_size) ==
+                                     (ssize_t)partitions_size) &&
+            (!activities_size || write(fd, activities, activities_size) ==
+                                     (ssize_t)activities_size) &&
+            !fsync(fd);
+  free(partitions);
+  free(sorted);
+  if (close(fd) || !ok) {
+    remove(temp_path);
+    return SNAPSHOT_WRITE_ERROR;
+  }
+
+  if (rename(temp_path, snapshot_path)) {
+    remove(temp_path);
+    return SNAPSHOT_WRITE_ERROR;
+  }
+
+  return SNAPSHOT_OK;
+}
+
+SnapshotError snapshot_load(ProjectId id, Arena *arena,
+                            Project **project_out) {
+  Filepath snapshot_path;
+  if (fs_get_project_file(id, SNAPSHOT_EXTENSION, snapshot_path)) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  int fd = open(snapshot_path, O_RDONLY);
+  if (fd < 0) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < (off_t)SNAPSHOT_V1_HEADER_SIZE) {
+    close(fd);
+    return SNAPSHOT_FORMAT_ERROR;
+  }
+  size_t file_size = st.st_size;
+
+  // Reserve room for appending after the file, then map the file over the
+  // start of it. Activities are used in place, pages are only read once a
+  // partition that needs them is.
+  size_t mapping_size = file_size + sizeof(Activity) * SNAPSHOT_HEADROOM;
+  void *mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping != MAP_FAILED &&
+      mmap(mapping, file_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(mapping, mapping_size);
+    mapping = MAP_FAILED;
+  }
+  close(fd); // Mapping stays valid after closing
+  if (mapping == MAP_FAILED) {
+    return SNAPSHOT_MAP_ERROR;
+  }
+
+  // Validate header before trusting anything in it, older snapshots are still
+  // read (without partitions or a project version) until they are next written
+  const SnapshotHeader *header = mapping;
+  size_t header_size = header->version == 1   ? SNAPSHOT_V1_HEADER_SIZE
+                       : header->version == 2 ? SNAPSHOT_V2_HEADER_SIZE
+                                              : sizeof(SnapshotHeader);
+  bool valid = header->magic == SNAPSHOT_MAGIC && header->version >= 1 &&
+               header->version <= SNAPSHOT_VERSION &&
+               header->activity_size == sizeof(Activity) && header->id == id &&
+               file_size >= header_size;
+  size_t partition_c = valid && header->version > 1 ? header->partition_c : 0;
+  valid = valid && partition_c <= file_size / sizeof(SnapshotPartition) &&
+          header->activity_c <= file_size / sizeof(Activity) &&
+          file_size == header_size +
+                            partition_c * sizeof(SnapshotPartition) +
+                            header->activity_c * sizeof(Activity);
+
+  const SnapshotPartition *partitions =
+      (const SnapshotPartition *)((unsigned char *)mapping + header_size);
+  if (valid && partition_c) {
+    const SnapshotPartition *last = partitions + partition_c - 1;
+    valid = last->first + last->activity_c == header->activity_c;
+  }
+  if (!valid) {
+    munmap(mapping, mapping_size);
+    return SNAPSHOT_FORMAT_ERROR;
+  }
+
+  Project *project = arena_alloc(arena, sizeof(Project));
+  project->id = header->id;
+  memcpy(project->name, header->name, sizeof(project->name));
+  project->name[sizeof(project->name) - 1] = '\0';
+  project->default_rate = header->default_rate;
+  project->journal_seq = header->journal_seq;
+  project->version = header->version > 2 ? header->project_version : 0;
+  project->activities = (Activity *)(partitions + partition_c);
+  project->activity_c = header->activity_c;
+  project->activities_loaded = true;
+  project->arena = arena;
+  project->mapping = mapping;
+  project->mapping_size = mapping_size;
+  project->partitions = partition_c ? partitions : NULL;
+  project->partition_c = partition_c;
+
+  *project_out = project;
+
+  return SNAPSHOT_OK;
+}
+
+SnapshotError snapshot_version(ProjectId id, uint32_t *version_out) {
+  Filepath snapshot_path;
+  if (fs_get_project_file(id, SNAPSHOT_EXTENSION, snapshot_path)) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  int fd = open(snapshot_path, O_RDONLY);
+  if (fd < 0) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  uint32_t prefix[2];
+  ssize_t length = pread(fd, prefix, sizeof(prefix), 0);
+  close(fd);
+  if (length != sizeof(prefix) || prefix[0] != SNAPSHOT_MAGIC) {
+    return SNAPSHOT_FORMAT_ERROR;
+  }
+
+  *version_out = prefix[1];
+
+  return SNAPSHOT_OK;
+}
+
+SnapshotError snapshot_project_version(ProjectId id,
+                                       unsigned long *version_out) {
+  Filepath snapshot_path;
+  if (fs_get_project_file(id, SNAPSHOT_EXTENSION, snapshot_path)) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  int fd = open(snapshot_path, O_RDONLY);
+  if (fd < 0) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  // Older headers are shorter, only the fields they share are checked
+  SnapshotHeader header = {0};
+  ssize_t length = pread(fd, &header, sizeof(header), 0);
+  close(fd);
+  if (length < (ssize_t)SNAPSHOT_V1_HEADER_SIZE ||
+      header.magic != SNAPSHOT_MAGIC || header.version < 1 ||
+      header.version > SNAPSHOT_VERSION ||
+      header.activity_size != sizeof(Activity) || header.id != id ||
+      (header.version > 2 && length < (ssize_t)sizeof(header))) {
+    return SNAPSHOT_FORMAT_ERROR;
+  }
+
+  *version_out = header.version > 2 ? header.project_version : 0;
+
+  return SNAPSHOT_OK;
+}
+
+void snapshot_detach(Project *project) {
+  if (!project->mapping) {
+    return;
+  }
+
+  size_t activities_size = sizeof(Activity) * project->activity_c;
+  Activity *activities = arena_alloc(project->arena, activities_size);
+  memcpy(activities, project->activities, activities_size);
+
+  size_t partitions_size = sizeof(SnapshotPartition) * project->partition_c;
+  SnapshotPartition *partitions = NULL;
+  if (partitions_size) {
+    partitions = arena_alloc(project->arena, partitions_size);
+    memcpy(partitions, project->partitions, partitions_size);
+  }
+
+  munmap(project->mapping, project->mapping_size);
+  project->mapping = NULL;
+  project->mapping_size = 0;
+  project->activities = activities;
+  project->partitions = partitions;
+}
+
+void snapshot_partition_range(const Project *project, unsigned long start,
+                              unsigned long end, size_t *first_out,
+                              size_t *last_out) {
+  const SnapshotPartition *partitions = project->partitions;
+  size_t partition_c = project->partition_c;
+
+  // Partitions are in time order, skip those entirely before the range...
+  size_t first = 0;
+  while (first < partition_c && partitions[first].max_time < start) {
+    first++;
+  }
+  // ...and stop at the first one entirely after it
+  size_t last = first;
+  while (last < partition_c && partitions[last].min_time < end) {
+    last++;
+  }
+
+  // Journal activities come after every partition, so they can only be in the
+  // range if the last partition could be
+  size_t partitioned_c =
+      partition_c ? partitions[partition_c - 1].first +
+                        partitions[partition_c - 1].activity_c
+                  : 0;
+  *first_out = first < partition_c ? partitions[first].first : partitioned_c;
+  *last_out =
+      last < partition_c ? partitions[last].first : project->activity_c;
+  if (*last_out < *first_out) {
+    *last_out = *first_out;
+  }
+}
+
+SnapshotError snapshot_delete(ProjectId id) {
+  Filepath snapshot_path;
+  if (fs_get_project_file(id, SNAPSHOT_EXTENSION, snapshot_path)) {
+    return SNAPSHOT_OPEN_ERROR;
+  }
+
+  if (remove(snapshot_path) && errno != ENOENT) {
+    return SNAPSHOT_WRITE_ERROR;
+  }
+
+  return SNAPSHOT_OK;
+}
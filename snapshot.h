@@ -0,0 +1,103 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "activity.h"
+#include "journal.h"
+#include "project.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// File extension of a project's binary snapshot, stored next to its YAML.
+#define SNAPSHOT_EXTENSION "bin"
+/// Identifies a snapshot file ("FMSN").
+#define SNAPSHOT_MAGIC (0x4e534d46)
+/// Current snapshot format version.
+#define SNAPSHOT_VERSION (3)
+/// Activities that can be appended to a mapped snapshot in place, before it
+/// has to be copied into the arena. Matches the journal compaction threshold,
+/// so that replaying a journal never copies.
+#define SNAPSHOT_HEADROOM JOURNAL_COMPACT_THRESHOLD
+
+typedef enum SnapshotError {
+  SNAPSHOT_OK = 0,
+  /// Something went wrong opening the snapshot file.
+  SNAPSHOT_OPEN_ERROR,
+  /// Something went wrong mapping the snapshot file.
+  SNAPSHOT_MAP_ERROR,
+  /// Something went wrong writing the snapshot file.
+  SNAPSHOT_WRITE_ERROR,
+  /// The snapshot is from another version or build, or is truncated.
+  SNAPSHOT_FORMAT_ERROR,
+} SnapshotError;
+
+/// Header at the start of every snapshot, followed by `partition_c` partitions
+/// and then a packed array of `activity_c` activities, sorted by time. Every
+/// field is 8-byte aligned so that both arrays can be used in place.
+typedef struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  /// `sizeof(Activity)` when written, guards against layout changes.
+  uint64_t activity_size;
+
+  uint64_t id;
+  char name[64];
+  double default_rate;
+  uint64_t journal_seq;
+
+  uint64_t activity_c;
+
+  /// Added in version 2, version 1 snapshots have no partitions and their
+  /// activities start here.
+  uint64_t partition_c;
+
+  /// Added in version 3, `Project.version`.
+  uint64_t project_version;
+} SnapshotHeader;
+
+/// Size of a version 1 header, which ends before `partition_c`.
+#define SNAPSHOT_V1_HEADER_SIZE (offsetof(SnapshotHeader, partition_c))
+/// Size of a version 2 header, which ends before `project_version`.
+#define SNAPSHOT_V2_HEADER_SIZE (offsetof(SnapshotHeader, project_version))
+
+/// A run of activities logged in the same (local) calendar month. Queries
+/// prune partitions by their time range without touching their activities.
+typedef struct SnapshotPartition {
+  /// `year * 12 + month`, both zero-based as in `struct tm`.
+  int64_t month;
+  /// Index of the partition's first activity.
+  uint64_t first;
+  uint64_t activity_c;
+  /// Earliest and latest activity time in the partition.
+  uint64_t min_time;
+  uint64_t max_time;
+} SnapshotPartition;
+
+/// Writes a project's binary snapshot, partitioned by month.
+SnapshotError snapshot_save(const Project *project);
+/// Maps a project's binary snapshot, returning a project (allocated from the
+/// arena) whose activities and partitions point directly into the mapping. The
+/// mapping must be released with `munmap` before the arena.
+///
+/// The mapping is private and writable, with room for `SNAPSHOT_HEADROOM` more
+/// activities after the last one.
+SnapshotError snapshot_load(ProjectId id, Arena *arena, Project **project_out);
+/// Reads the format version of a project's snapshot.
+SnapshotError snapshot_version(ProjectId id, uint32_t *version_out);
+/// Reads `Project.version` from a project's snapshot header, without mapping
+/// the rest of it. Snapshots older than format version 3 give 0.
+SnapshotError snapshot_project_version(ProjectId id,
+                                       unsigned long *version_out);
+/// Copies a mapped project's activities and partitions into its arena and
+/// releases the mapping, so that the activity array can be resized.
+void snapshot_detach(Project *project);
+/// Narrows a loaded project's activities down to the index range
+/// `[first, last)` that can hold activities logged in `[start, end)`, using its
+/// partitions. The range still has to be filtered by time.
+void snapshot_partition_range(const Project *project, unsigned long start,
+                              unsigned long end, size_t *first_out,
+                              size_t *last_out);
+/// Removes a project's binary snapshot.
+SnapshotError snapshot_delete(ProjectId id);
+
+#endif
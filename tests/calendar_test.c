@@ -0,0 +1,158 @@
+#include "calendar.h"
+#include "test.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// Zones checked, as POSIX TZ strings so no tzdata is needed. Clocks change
+/// at 1am, at 2am, at midnight (so that day has none) and by half an hour, or
+/// never.
+static const char *ZONES[] = {
+    "UTC0",
+    "GMT0BST,M3.5.0/1,M10.5.0",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "<-03>3<-02>,M10.3.0/0,M2.3.0/0",
+    "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",
+};
+
+/// Years covered by the calendar, and searched for DST changes.
+#define FIRST_YEAR (1990)
+#define LAST_YEAR (2040)
+/// Random timestamps checked per zone.
+#define RANDOM_TIME_C (100000)
+
+/// Checks a timestamp's day from the calendar against `localtime_r`.
+static void check_time(const Calendar *calendar, time_t time) {
+  struct tm tm;
+  localtime_r(&time, &tm);
+
+  int64_t day = calendar_lookup(calendar, time);
+  int year, month, day_of_month;
+  calendar_civil_from_days(day, &year, &month, &day_of_month);
+  CHECK(year == tm.tm_year + 1900 && month == tm.tm_mon + 1 &&
+            day_of_month == tm.tm_mday,
+        "%s: %lld looked up as %.4d/%.2d/%.2d, localtime_r has %.4d/%.2d/%.2d",
+        getenv("TZ"), (long long)time, year, month, day_of_month,
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+  CHECK(calendar_day(time) == day, "%s: %lld is day %lld, looked up as %lld",
+        getenv("TZ"), (long long)time, (long long)calendar_day(time),
+        (long long)day);
+  CHECK(calendar_weekday(day) == (tm.tm_wday + 6) % 7,
+        "%s: %lld weekday %d, localtime_r has %d", getenv("TZ"),
+        (long long)time, calendar_weekday(day), (tm.tm_wday + 6) % 7);
+}
+
+/// Checks that every day in the calendar starts on its first local second.
+static void check_day_starts(const Calendar *calendar) {
+  for (size_t i = 0; i < calendar->day_c; i++) {
+    time_t start = calendar->day_starts[i];
+    int64_t day = calendar->first_day + i;
+    CHECK(calendar_day(start) == day && calendar_day(start - 1) == day - 1,
+          "%s: day %lld starts at %lld, not its first second", getenv("TZ"),
+          (long long)day, (long long)start);
+    CHECK(calendar_day_start(day) == start,
+          "%s: day %lld starts at %lld, calendar has %lld", getenv("TZ"),
+          (long long)day, (long long)calendar_day_start(day),
+          (long long)start);
+  }
+}
+
+/// Offset from UTC at a time.
+static long utc_offset(time_t time) {
+  struct tm tm;
+  localtime_r(&time, &tm);
+  return tm.tm_gmtoff;
+}
+
+/// Checks around every DST change in the calendar's range, found hour by hour
+/// and then narrowed down to the second.
+static void check_dst_changes(const Calendar *calendar, size_t *change_c_out) {
+  time_t end = calendar->day_starts[calendar->day_c];
+  for (time_t hour = calendar->day_starts[0]; hour + 3600 < end;
+       hour += 3600) {
+    if (utc_offset(hour) == utc_offset(hour + 3600)) {
+      continue;
+    }
+
+    time_t low = hour, high = hour + 3600;
+    while (high - low > 1) {
+      time_t middle = low + (high - low) / 2;
+      if (utc_offset(middle) == utc_offset(low)) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+
+    // Either side of the change, and of any midnight it moved or repeated
+    for (time_t time = high - 2 * 3600; time <= high + 2 * 3600; time += 60) {
+      check_time(calendar, time);
+    }
+    check_time(calendar, high - 1);
+    check_time(calendar, high);
+    (*change_c_out)++;
+  }
+}
+
+/// Checks civil conversions against each other over a wide range of days.
+static void check_civil(void) {
+  for (int64_t day = -800000; day <= 800000; day++) {
+    int year, month, day_of_month;
+    calendar_civil_from_days(day, &year, &month, &day_of_month);
+    CHECK(calendar_days_from_civil(year, month, day_of_month) == day,
+          "day %lld round trips through %d/%d/%d", (long long)day, year, month,
+          day_of_month);
+
+    // The day after the last of a month is the first of the next
+    if (day_of_month == calendar_days_in_month(year, month)) {
+      int next_year, next_month, next_day;
+      calendar_civil_from_days(day + 1, &next_year, &next_month, &next_day);
+      CHECK(next_day == 1 && next_month == month % 12 + 1 &&
+                next_year == year + (month == 12),
+            "day after %d/%d/%d is %d/%d/%d", year, month, day_of_month,
+            next_year, next_month, next_day);
+    }
+  }
+}
+
+int main(void) {
+  check_civil();
+
+  srand(1);
+  for (size_t i = 0; i < sizeof(ZONES) / sizeof(*ZONES); i++) {
+    setenv("TZ", ZONES[i], 1);
+    tzset();
+
+    struct tm first = {.tm_year = FIRST_YEAR - 1900, .tm_mday = 1,
+                       .tm_isdst = -1};
+    struct tm last = {.tm_year = LAST_YEAR - 1900 + 1, .tm_mday = 1,
+                      .tm_isdst = -1};
+    time_t start = mktime(&first), end = mktime(&last) - 1;
+
+    Calendar calendar;
+    calendar_build(start, end, &calendar);
+    check_day_starts(&calendar);
+
+    size_t change_c = 0;
+    check_dst_changes(&calendar, &change_c);
+    bool has_dst = i > 0;
+    CHECK(!has_dst || change_c >= 2 * (LAST_YEAR - FIRST_YEAR),
+          "%s: only %zu DST changes found", ZONES[i], change_c);
+
+    for (size_t j = 0; j < RANDOM_TIME_C; j++) {
+      time_t time = start + (time_t)(((uint64_t)rand() << 31 | rand()) %
+                                     (uint64_t)(end - start + 1));
+      check_time(&calendar, time);
+    }
+
+    // Outside the table, looked up directly
+    check_time(&calendar, start - 1);
+    check_time(&calendar, end + 1);
+    check_time(&calendar, 0);
+
+    calendar_free(&calendar);
+  }
+
+  return test_result("calendar");
+}
@@ -0,0 +1,232 @@
+#include "filesystem.h"
+#include "snapshot.h"
+#include "test.h"
+#include "test_home.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// Processes logging to the same project at once.
+#define LOGGER_C (8)
+/// Appends made by each logger, alternating single activities and batches.
+#define APPEND_C (20)
+/// Activities in each batch append.
+#define BATCH_C (3)
+/// ID of the project everything is logged to.
+#define PROJECT_ID (1000)
+
+/// Activities one logger writes.
+#define LOGGER_ACTIVITY_C (APPEND_C / 2 + APPEND_C / 2 * BATCH_C)
+
+static Activity make_activity(size_t logger, size_t index) {
+  Activity activity = {
+      .minutes = 30,
+      .rate = {.present = true, .value = 10},
+      .time = 1700000000 + index * 60 + logger,
+      .project_id = PROJECT_ID,
+  };
+  snprintf(activity.description, sizeof(activity.description), "%zu/%zu",
+           logger, index);
+  return activity;
+}
+
+/// Logs every activity of one logger, returning the exit status.
+static int run_logger(size_t logger) {
+  size_t index = 0;
+  for (size_t append = 0; append < APPEND_C; append++) {
+    FileError error;
+    if (append % 2) {
+      Activity batch[BATCH_C];
+      for (size_t i = 0; i < BATCH_C; i++) {
+        batch[i] = make_activity(logger, index++);
+      }
+      error = fs_append_activities(PROJECT_ID, batch, BATCH_C);
+    } else {
+      Activity activity = make_activity(logger, index++);
+      error = fs_append_activity(&activity);
+    }
+    if (error) {
+      fprintf(stderr, "logger %zu: append %zu failed (%d)\n", logger, append,
+              error);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Checks that every activity logged concurrently was kept, exactly once.
+static void check_loggers(void) {
+  pid_t pids[LOGGER_C];
+  for (size_t i = 0; i < LOGGER_C; i++) {
+    pids[i] = fork();
+    if (!pids[i]) {
+      _exit(run_logger(i));
+    }
+  }
+  for (size_t i = 0; i < LOGGER_C; i++) {
+    int status;
+    waitpid(pids[i], &status, 0);
+    CHECK(WIFEXITED(status) && !WEXITSTATUS(status), "logger %zu failed", i);
+  }
+
+  Project *project;
+  FileError error = fs_load_project(PROJECT_ID, &project);
+  CHECK(!error, "project could not be loaded (%d)", error);
+  if (error) {
+    return;
+  }
+
+  CHECK(project->activity_c == LOGGER_C * LOGGER_ACTIVITY_C,
+        "%zu activities saved, %d logged", project->activity_c,
+        LOGGER_C * LOGGER_ACTIVITY_C);
+  bool seen[LOGGER_C][LOGGER_ACTIVITY_C] = {0};
+  for (size_t i = 0; i < project->activity_c; i++) {
+    size_t logger, index;
+    if (sscanf(project->activities[i].description, "%zu/%zu", &logger,
+               &index) != 2 ||
+        logger >= LOGGER_C || index >= LOGGER_ACTIVITY_C) {
+      CHECK(false, "unexpected activity `%s`",
+            project->activities[i].description);
+      continue;
+    }
+    CHECK(!seen[logger][index], "activity %zu/%zu saved twice", logger, index);
+    seen[logger][index] = true;
+  }
+  fs_free_project(project);
+
+  ProjectIndex index;
+  if (!fs_get_project_index(&index)) {
+    ProjectIndexEntry *entry = project_index_find(&index, PROJECT_ID);
+    CHECK(entry && entry->activity_c == LOGGER_C * LOGGER_ACTIVITY_C,
+          "index counts %zu activities", entry ? entry->activity_c : 0);
+    project_index_free(&index);
+  }
+}
+
+/// Checks that a stale copy of a project is never saved over a newer one, with
+/// the stored version read from the snapshot or, without one, the YAML.
+static void check_conflict(bool without_snapshot) {
+  Project *first, *second;
+  if (fs_load_project(PROJECT_ID, &first) ||
+      fs_load_project(PROJECT_ID, &second)) {
+    CHECK(false, "project could not be loaded");
+    return;
+  }
+
+  strcpy(first->name, "First");
+  CHECK(!fs_save_project(*first), "first save failed (without snapshot: %d)",
+        without_snapshot);
+
+  // The next save then has to stream the version out of the YAML
+  if (without_snapshot) {
+    Filepath snapshot_path;
+    fs_get_project_file(PROJECT_ID, SNAPSHOT_EXTENSION, snapshot_path);
+    remove(snapshot_path);
+  }
+
+  strcpy(second->name, "Second");
+  FileError error = fs_save_project(*second);
+  CHECK(error == FILE_CONFLICT_ERROR,
+        "stale save gave %d, not a conflict (without snapshot: %d)", error,
+        without_snapshot);
+
+  fs_free_project(first);
+  fs_free_project(second);
+}
+
+/// Checks that a project listed header-only, as the projects menu does, saves
+/// in place once its activities are loaded.
+static void check_header_save(void) {
+  Project **projects;
+  size_t project_c;
+  if (fs_get_project_headers(&projects, &project_c) || project_c != 1) {
+    CHECK(false, "project headers could not be listed");
+    return;
+  }
+
+  Activity *activities;
+  size_t activity_c;
+  CHECK(!fs_get_activities(projects[0], &activities, &activity_c),
+        "activities could not be loaded");
+  strcpy(projects[0]->name, "Renamed");
+  FileError error = fs_save_project(*projects[0]);
+  CHECK(!error, "header-loaded project saved with %d", error);
+  fs_free_project_list(projects, project_c);
+
+  ProjectIndex index;
+  if (!fs_get_project_index(&index)) {
+    ProjectIndexEntry *entry = project_index_find(&index, PROJECT_ID);
+    CHECK(index.entry_c == 1 && entry && !strcmp(entry->name, "Renamed"),
+          "project not renamed in place (%zu projects)", index.entry_c);
+    project_index_free(&index);
+  }
+}
+
+/// Checks that a rename saved after a project was listed header-only is kept
+/// when the listed copy is then edited and saved.
+static void check_header_rename(void) {
+  Project **projects;
+  size_t project_c;
+  if (fs_get_project_headers(&projects, &project_c) || project_c != 1) {
+    CHECK(false, "project headers could not be listed");
+    return;
+  }
+
+  Project *elsewhere;
+  if (fs_load_project(PROJECT_ID, &elsewhere)) {
+    CHECK(false, "project could not be loaded");
+    fs_free_project_list(projects, project_c);
+    return;
+  }
+  strcpy(elsewhere->name, "Elsewhere");
+  CHECK(!fs_save_project(*elsewhere), "rename failed");
+  fs_free_project(elsewhere);
+
+  Activity *activities;
+  size_t activity_c;
+  CHECK(!fs_get_activities(projects[0], &activities, &activity_c),
+        "activities could not be loaded");
+  projects[0]->default_rate = 20;
+  FileError error = fs_save_project(*projects[0]);
+  fs_free_project_list(projects, project_c);
+
+  // Either the listed copy picked up the rename, or its save conflicted
+  Project *saved;
+  if (fs_load_project(PROJECT_ID, &saved)) {
+    CHECK(false, "project could not be loaded");
+    return;
+  }
+  CHECK(!strcmp(saved->name, "Elsewhere"), "rename reverted to `%s`",
+        saved->name);
+  CHECK(error || saved->default_rate == 20, "rate change lost (%d)", error);
+  fs_free_project(saved);
+}
+
+int main(void) {
+  char home[] = "/tmp/freeman_concurrency_XXXXXX";
+  if (!test_home_create(home)) {
+    return 1;
+  }
+
+  Project project = {
+      .id = PROJECT_ID,
+      .name = "Stress",
+      .default_rate = 10,
+      .activities_loaded = true,
+  };
+  FileError error = fs_save_project(project);
+  CHECK(!error, "project could not be created (%d)", error);
+
+  if (!error) {
+    check_loggers();
+    check_conflict(false);
+    check_conflict(true);
+    check_header_save();
+    check_header_rename();
+  }
+
+  test_home_remove(home);
+  return test_result("concurrency");
+}
@@ -0,0 +1,300 @@
+#include "arena.h"
+#include "filesystem.h"
+#include "project_yaml.h"
+#include "test.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Random projects round tripped.
+#define PROJECT_C (2000)
+/// Most activities in a random project.
+#define MAX_ACTIVITY_C (40)
+/// Activities in the project timed by `bench`, unless given.
+#define BENCH_ACTIVITY_C (100000)
+/// Times each step is run by `bench`, the fastest is reported.
+#define BENCH_RUN_C (5)
+
+static uint64_t random_state = 1;
+
+/// xorshift64*, so that a seed always gives the same projects.
+static uint64_t random_next(void) {
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return random_state * 0x2545f4914f6cdd1dULL;
+}
+
+static uint64_t random_below(uint64_t bound) { return random_next() % bound; }
+
+/// Pieces random strings are made from. YAML indicators, escapes, words that
+/// resolve to other types and multi-byte UTF-8, as well as plain text.
+static const char *STRING_PIECES[] = {
+    "a",  "Z",  "word", " ",  "  ",   ":",  ": ", "#",    " #",   "-",
+    "- ", "?",  "'",    "\"", "\\",   "\n", "\t", "\r",   "\x01", "\x7f",
+    "{",  "}",  "[",    "]",  ",",    "&",  "*",  "!",    "|",    ">",
+    "%",  "@",  "`",    "0",  "12",   "1.5", "0x1f", "true", "No", "null",
+    "~",  "é",  "日本", "🙂", "\xc2\xa0",
+};
+
+/// Never empty, the schema requires at least one character.
+static void random_string(char *string, size_t size) {
+  size_t length = 0;
+  size_t piece_c = 1 + random_below(8);
+  for (size_t i = 0; i < piece_c; i++) {
+    const char *piece =
+        STRING_PIECES[random_below(sizeof(STRING_PIECES) / sizeof(char *))];
+    size_t piece_length = strlen(piece);
+    if (length + piece_length >= size) {
+      break;
+    }
+    memcpy(string + length, piece, piece_length);
+    length += piece_length;
+  }
+  string[length] = '\0';
+}
+
+/// Whole numbers, pence, and arbitrary (but normal, finite) bit patterns.
+static double random_double(void) {
+  switch (random_below(4)) {
+  case 0:
+    return (double)random_below(1000);
+  case 1:
+    return random_below(1000000) / 100.0;
+  case 2: {
+    uint64_t bits = random_next();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return isnormal(value) ? value : 0;
+  }
+  default:
+    return (double)random_next() / (double)UINT64_MAX * 1e6;
+  }
+}
+
+static unsigned long random_uint(void) {
+  return random_below(2) ? random_below(100000) : random_next();
+}
+
+static void random_project(Project *project_out, Activity *activities) {
+  *project_out = (Project){
+      .id = random_uint(),
+      .default_rate = random_double(),
+      .activities = activities,
+      .activity_c = random_below(MAX_ACTIVITY_C + 1),
+      .activities_loaded = true,
+      .journal_seq = random_uint(),
+      .version = random_uint(),
+  };
+  random_string(project_out->name, sizeof(project_out->name));
+
+  for (size_t i = 0; i < project_out->activity_c; i++) {
+    Activity *activity = activities + i;
+    *activity = (Activity){
+        .hours = random_uint(),
+        .minutes = random_uint(),
+        .rate = {.present = random_below(2)},
+        .time = random_uint(),
+        .project_id = random_uint(),
+    };
+    activity->rate.value = activity->rate.present ? random_double() : 0;
+    random_string(activity->description, sizeof(activity->description));
+  }
+}
+
+// Field comparisons for each kind in the tables
+#define SAME_UINT(a, b, symbol) ((a)->symbol == (b)->symbol)
+#define SAME_DOUBLE(a, b, symbol) ((a)->symbol == (b)->symbol)
+#define SAME_STRING(a, b, symbol)                                              \
+  (!strncmp((a)->symbol, (b)->symbol, sizeof((a)->symbol)))
+#define SAME_OPTIONAL_DOUBLE(a, b, symbol)                                     \
+  ((a)->symbol.present == (b)->symbol.present &&                               \
+   (!(a)->symbol.present || (a)->symbol.value == (b)->symbol.value))
+#define SAME_ACTIVITIES(a, b, symbol)                                          \
+  (!activities_difference((a)->symbol, (a)->activity_c, (b)->symbol,           \
+                          (b)->activity_c))
+
+/// First serialised field that differs between two activities, or NULL.
+static const char *activity_difference(const Activity *a, const Activity *b) {
+#define X(kind, symbol)                                                        \
+  if (!SAME_##kind(a, b, symbol)) {                                            \
+    return "activity " #symbol;                                                \
+  }
+  ACTIVITY_TABLE
+#undef X
+  return NULL;
+}
+
+static const char *activities_difference(const Activity *a, size_t a_c,
+                                         const Activity *b, size_t b_c) {
+  if (a_c != b_c) {
+    return "activity_c";
+  }
+  for (size_t i = 0; i < a_c; i++) {
+    const char *difference = activity_difference(a + i, b + i);
+    if (difference) {
+      return difference;
+    }
+  }
+  return NULL;
+}
+
+/// First serialised field that differs between two projects, or NULL.
+static const char *project_difference(const Project *a, const Project *b) {
+#define X(kind, symbol)                                                        \
+  if (!SAME_##kind(a, b, symbol)) {                                            \
+    return #symbol;                                                            \
+  }
+  PROJECT_TABLE
+#undef X
+  return NULL;
+}
+
+/// Saves with `project_yaml` and libcyaml, then checks that each reads back
+/// the other's file as the original project.
+static void check_round_trip(const Project *project, size_t case_index,
+                             const char *ours_path, const char *cyaml_path) {
+  Arena *arena = arena_create();
+  Project *loaded;
+
+  CHECK(!project_yaml_save(project, ours_path), "case %zu: save failed",
+        case_index);
+  ProjectYamlError error = project_yaml_load(ours_path, arena, &loaded);
+  CHECK(!error, "case %zu: project_yaml could not read its own file (%d)",
+        case_index, error);
+  if (!error) {
+    const char *field = project_difference(project, loaded);
+    CHECK(!field, "case %zu: %s changed through project_yaml", case_index,
+          field);
+  }
+
+  FileError file_error = fs_cyaml_load_project(ours_path, arena, &loaded);
+  CHECK(!file_error, "case %zu: libcyaml could not read project_yaml's file",
+        case_index);
+  if (!file_error) {
+    const char *field = project_difference(project, loaded);
+    CHECK(!field, "case %zu: %s read differently by libcyaml", case_index,
+          field);
+  }
+
+  // libcyaml's own layout is read as libcyaml reads it
+  Project *reference;
+  file_error = fs_cyaml_save_project(project, cyaml_path);
+  if (!file_error) {
+    file_error = fs_cyaml_load_project(cyaml_path, arena, &reference);
+  }
+  CHECK(!file_error, "case %zu: libcyaml round trip failed", case_index);
+  if (!file_error) {
+    error = project_yaml_load(cyaml_path, arena, &loaded);
+    CHECK(!error, "case %zu: project_yaml could not read libcyaml's file (%d)",
+          case_index, error);
+    if (!error) {
+      const char *field = project_difference(reference, loaded);
+      CHECK(!field, "case %zu: %s of libcyaml's file read differently",
+            case_index, field);
+    }
+  }
+
+  arena_destroy(arena);
+}
+
+static double now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/// Times saving and loading one large project both ways.
+static int bench(const char *path, size_t activity_c) {
+  Activity *activities = malloc(sizeof(Activity) * (activity_c + 1));
+  Project project = {
+      .id = 1000,
+      .name = "Bench",
+      .default_rate = 42.5,
+      .activities = activities,
+      .activity_c = activity_c,
+      .activities_loaded = true,
+  };
+  for (size_t i = 0; i < activity_c; i++) {
+    activities[i] = (Activity){
+        .hours = i % 8,
+        .minutes = i % 60,
+        .rate = {.present = i % 3 == 0, .value = 55.25},
+        .time = 1700000000 + i * 3600,
+        .project_id = project.id,
+    };
+    snprintf(activities[i].description, sizeof(activities[i].description),
+             "Activity %zu: fixed things", i);
+  }
+
+  double best[4] = {INFINITY, INFINITY, INFINITY, INFINITY};
+  for (size_t run = 0; run < BENCH_RUN_C; run++) {
+    Arena *arena = arena_create();
+    Project *loaded;
+    double start = now_ms();
+    bool ok = !project_yaml_save(&project, path);
+    double saved = now_ms();
+    ok = ok && !project_yaml_load(path, arena, &loaded);
+    double loaded_at = now_ms();
+    ok = ok && !fs_cyaml_save_project(&project, path);
+    double cyaml_saved = now_ms();
+    ok = ok && !fs_cyaml_load_project(path, arena, &loaded);
+    double cyaml_loaded = now_ms();
+    arena_destroy(arena);
+    if (!ok) {
+      printf("bench: a step failed\n");
+      free(activities);
+      return 1;
+    }
+
+    double times[] = {saved - start, loaded_at - saved,
+                      cyaml_saved - loaded_at, cyaml_loaded - cyaml_saved};
+    for (size_t i = 0; i < 4; i++) {
+      best[i] = times[i] < best[i] ? times[i] : best[i];
+    }
+  }
+  free(activities);
+
+  printf("%zu activities, best of %d runs\n", activity_c, BENCH_RUN_C);
+  printf("project_yaml: save %.1fms, load %.1fms\n", best[0], best[1]);
+  printf("libcyaml:     save %.1fms, load %.1fms\n", best[2], best[3]);
+  return 0;
+}
+
+/// `project_yaml_test [seed]` checks random projects,
+/// `project_yaml_test bench [activity_c]` times a large one.
+int main(int argc, char **argv) {
+  char directory[] = "/tmp/freeman_yaml_XXXXXX";
+  if (!mkdtemp(directory)) {
+    printf("Failed to create a temporary directory\n");
+    return 1;
+  }
+  Filepath ours_path, cyaml_path;
+  snprintf(ours_path, sizeof(ours_path), "%s/ours.yaml", directory);
+  snprintf(cyaml_path, sizeof(cyaml_path), "%s/cyaml.yaml", directory);
+
+  int result;
+  if (argc > 1 && !strcmp(argv[1], "bench")) {
+    result = bench(ours_path,
+                   argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_ACTIVITY_C);
+  } else {
+    random_state = argc > 1 ? strtoull(argv[1], NULL, 10) | 1 : 1;
+
+    Activity activities[MAX_ACTIVITY_C];
+    for (size_t i = 0; i < PROJECT_C; i++) {
+      Project project;
+      random_project(&project, activities);
+      check_round_trip(&project, i, ours_path, cyaml_path);
+    }
+    result = test_result("project_yaml");
+  }
+
+  remove(ours_path);
+  remove(cyaml_path);
+  rmdir(directory);
+  return result;
+}
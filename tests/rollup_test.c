@@ -0,0 +1,104 @@
+#include "calendar.h"
+#include "filesystem.h"
+#include "rollup.h"
+#include "test.h"
+#include "test_home.h"
+
+#include <string.h>
+
+/// ID of the project everything is logged to.
+#define PROJECT_ID (1000)
+/// Default hourly rate of the project.
+#define PROJECT_RATE (10)
+/// Noon on 2024/01/15 UTC, when the first activity is logged.
+#define FIRST_TIME (1705320000)
+/// Seconds in a day.
+#define DAY (86400)
+
+static Activity make_activity(unsigned long time, unsigned long hours) {
+  Activity activity = {
+      .hours = hours,
+      .time = time,
+      .project_id = PROJECT_ID,
+  };
+  strcpy(activity.description, "Work");
+  return activity;
+}
+
+/// Checks the rollups for `[start, end)` against a number of activities and
+/// hours, all at the project's default rate.
+static void check_sum(const char *step, time_t start, time_t end,
+                      size_t activity_c, unsigned long hours) {
+  RollupTable table;
+  RollupError error = rollup_load(&table);
+  CHECK(!error, "%s: rollups could not be loaded (%d)", step, error);
+  if (error) {
+    return;
+  }
+
+  RollupTotals totals;
+  rollup_sum(&table, calendar_day(start), calendar_day(end), &totals);
+  CHECK(totals.activity_c == activity_c,
+        "%s: rollups count %zu activities, expected %zu", step,
+        totals.activity_c, activity_c);
+  CHECK(totals.minutes == hours * 60, "%s: rollups count %lu minutes, "
+        "expected %lu", step, totals.minutes, hours * 60);
+  CHECK(totals.earnings == (double)(hours * PROJECT_RATE),
+        "%s: rollups earn %.2f, expected %.2f", step, totals.earnings,
+        (double)(hours * PROJECT_RATE));
+  rollup_free(&table);
+}
+
+/// Saves a copy of the project loaded before an activity was appended, as the
+/// project menu does. The appended activity stays in the journal and must keep
+/// its rollup row.
+static void check_stale_save(void) {
+  Project *stale;
+  if (fs_load_project(PROJECT_ID, &stale)) {
+    CHECK(false, "project could not be loaded");
+    return;
+  }
+
+  Activity appended = make_activity(FIRST_TIME + DAY, 2);
+  CHECK(!fs_append_activity(&appended), "append failed");
+  check_sum("after append", FIRST_TIME, FIRST_TIME + 2 * DAY, 2, 3);
+
+  strcpy(stale->name, "Renamed");
+  FileError error = fs_save_project(*stale);
+  CHECK(!error, "stale copy saved with %d", error);
+  fs_free_project(stale);
+  check_sum("after save", FIRST_TIME, FIRST_TIME + 2 * DAY, 2, 3);
+  check_sum("appended day", FIRST_TIME + DAY, FIRST_TIME + 2 * DAY, 1, 2);
+
+  size_t difference_c;
+  CHECK(!rollup_verify(&difference_c) && !difference_c,
+        "verify found %zu differences", difference_c);
+}
+
+int main(void) {
+  setenv("TZ", "UTC0", 1);
+  char home[] = "/tmp/freeman_rollup_XXXXXX";
+  if (!test_home_create(home)) {
+    return 1;
+  }
+
+  Activity first = make_activity(FIRST_TIME, 1);
+  Project project = {
+      .id = PROJECT_ID,
+      .name = "Rollups",
+      .default_rate = PROJECT_RATE,
+      .activities = &first,
+      .activity_c = 1,
+      .activities_loaded = true,
+  };
+  FileError error = fs_save_project(project);
+  CHECK(!error, "project could not be created (%d)", error);
+
+  if (!error) {
+    check_sum("created", FIRST_TIME, FIRST_TIME + 2 * DAY, 1, 1);
+    check_stale_save();
+  }
+
+  test_home_remove(home);
+  return test_result("rollup");
+}
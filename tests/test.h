@@ -0,0 +1,33 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+/// Failed checks printed before the rest are only counted.
+#define TEST_PRINT_MAX (20)
+
+/// Failed checks so far.
+static size_t test_failure_c = 0;
+
+/// Fails the test (without stopping it) unless `condition` holds, printing
+/// the location and a `printf` style message.
+#define CHECK(condition, ...)                                                  \
+  do {                                                                         \
+    if (!(condition) && test_failure_c++ < TEST_PRINT_MAX) {                   \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);                          \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+    }                                                                          \
+  } while (0)
+
+/// Prints a summary, returning the exit status for `main`.
+static int test_result(const char *name) {
+  if (test_failure_c) {
+    printf("%s: %zu checks failed\n", name, test_failure_c);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TEST_HOME_H_
+#define TEST_HOME_H_
+
+#include "filesystem.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Points `HOME` at a new temporary directory holding an empty projects
+/// directory. Preferences are never written, so libcyaml is not needed.
+/// `home` is a `mkdtemp` template, filled in with the directory's path.
+static bool test_home_create(char *home) {
+  if (!mkdtemp(home)) {
+    printf("Failed to create a temporary directory\n");
+    return false;
+  }
+  setenv("HOME", home, 1);
+
+  const char *directories[] = {".config", CONFIG_DIRECTORY, PROJECTS_DIRECTORY};
+  for (size_t i = 0; i < sizeof(directories) / sizeof(char *); i++) {
+    Filepath path;
+    snprintf(path, sizeof(path), "%s/%s", home, directories[i]);
+    mkdir(path, DEFAULT_PERMISSIONS);
+  }
+  return true;
+}
+
+/// Removes a directory and everything in it.
+static void test_home_remove(const char *path) {
+  DIR *directory = opendir(path);
+  if (directory) {
+    struct dirent *entry;
+    while ((entry = readdir(directory))) {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+        continue;
+      }
+      Filepath entry_path;
+      snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
+      if (entry->d_type == DT_DIR) {
+        test_home_remove(entry_path);
+      } else {
+        remove(entry_path);
+      }
+    }
+    closedir(directory);
+  }
+  rmdir(path);
+}
+
+#endif